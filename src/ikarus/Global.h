@@ -1,25 +1,9 @@
 #ifndef GLOBAL_H
 #define GLOBAL_H
 
-// global standard libraries
-
-#include <stdexcept>
-#include <cassert>
-#include <cstdlib>
-#include <cctype>
-#include <cmath>
-
-#include <algorithm>
-#include <functional>
-#include <utility>
-#include <limits>
-#include <vector>
-#include <map>
-#include <set>
-#include <string>
-#include <iostream>
-#include <fstream>
-#include <sstream>
+// the solver core (standard libraries, maths, smart pointers, etc)
+
+#include "CoreGlobal.h"
 
 // global non-standard libraries
 
@@ -34,11 +18,7 @@
 
 // global internal headers
 
-#include "refvector.h"
-#include "smartptr.h"
-#include "vmath.h"
 #include "scopedenum.h"
-#include "murmurhash.h"
 
 namespace vmath
 {
@@ -73,39 +53,9 @@ namespace vmath
 typedef vmath::vec2<int> vec2i; // useful for screen/pixel coordinates
 typedef vmath::rect<int> recti;
 
-typedef vmath::vec2<double> vec2d;
-typedef vmath::vec3<double> vec3d;
-typedef vmath::vec4<double> vec4d;
 typedef vmath::rect<double> rectd;
-
-typedef vmath::vec2<float> vec2f;
-typedef vmath::vec3<float> vec3f;
-typedef vmath::vec4<float> vec4f;
 typedef vmath::rect<float> rectf;
 
-typedef vmath::mat2<double> mat2d;
-typedef vmath::mat3<double> mat3d;
-typedef vmath::mat4<double> mat4d;
-
-typedef vmath::quat<double> quatd;
-
-static const vec3d unitX(1.0, 0.0, 0.0);
-static const vec3d unitY(0.0, 1.0, 0.0);
-static const vec3d unitZ(0.0, 0.0, 1.0);
-
-// ===== Utility Functions =====
-
-template <typename T>
-T clamp(const T &a, const T &b, const T &v)
-{
-	if (v < a)
-		return a;
-	else if (v > b)
-		return b;
-	else
-		return v;
-}
-
 // ===== Configuration Constants =====
 
 const double CameraDistance = 30.0;
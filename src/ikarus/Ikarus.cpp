@@ -7,6 +7,7 @@
 
 #include "Font.h"
 #include "Skeleton.h"
+#include "SkeletonCache.h"
 //#include "Pose.h"
 #include "IkSolver.h"
 
@@ -99,7 +100,10 @@ public:
 		if (ikMode)
 		{
 			updateTargetPos(gui);
-			if (ikEnabled)
+			// a warm-started solver solves outright each frame, otherwise it's stepped
+			if (ikEnabled && skel.solver->isWarmStartEnabled())
+				skel.solver->solveIk(30);
+			else if (ikEnabled)
 				skel.solver->iterateIk();
 		}
 		runGui(gui);
@@ -130,7 +134,11 @@ public:
 		curSkel = skelSel.run(gui, lyt).getIndex();
 
 		if (Button("reload-btn", "Reload").run(gui, lyt))
+		{
+			// (an unchanged file gives back the same skeleton; an edited one replaces it, and the old one is dropped)
 			skeletons.reset_at(curSkel, new SkeletonItem(skeletons[curSkel].fname, skeletons[curSkel].name));
+			SkeletonCache::shared().purge();
+		}
 		
 		SkeletonItem &skel = skeletons[curSkel];
 
@@ -160,6 +168,21 @@ public:
 		ikEnabled = CheckBox("ik-enabled-chk", "IK Enabled", ikEnabled, ikMode).run(gui, lyt);
 		bool constraintsOn = CheckBox("ik-constrained-chk", "Enable Constraints", skel.solver->areConstraintsEnabled(), ikMode).run(gui, lyt);
 		skel.solver->enableConstraints(constraintsOn);
+		bool quaternionsOn = CheckBox("ik-quaternions-chk", "Quaternion CCD", skel.solver->areQuaternionsEnabled(), ikMode).run(gui, lyt);
+		skel.solver->enableQuaternions(quaternionsOn);
+		bool twoBoneOn = CheckBox("ik-two-bone-chk", "Analytic Two-Bone Chains", skel.solver->isTwoBoneEnabled(), ikMode).run(gui, lyt);
+		skel.solver->enableTwoBone(twoBoneOn);
+		bool warmStartOn = CheckBox("ik-warm-start-chk", "Warm-Started Solve Per Frame", skel.solver->isWarmStartEnabled(), ikMode).run(gui, lyt);
+		skel.solver->enableWarmStart(warmStartOn);
+
+		Label("Algorithm:").run(gui, lyt);
+		ComboBox algorithmSel("algorithm-sel", WidgetID(skel.solver->getAlgorithm()), ikMode);
+		algorithmSel.add(WidgetID(IkCCD), "CCD");
+		algorithmSel.add(WidgetID(IkFABRIK), "FABRIK");
+		algorithmSel.add(WidgetID(IkJacobianTranspose), "Jacobian Transpose");
+		algorithmSel.add(WidgetID(IkPseudoInverse), "Pseudo-inverse");
+		algorithmSel.add(WidgetID(IkDampedLeastSquares), "Damped Least Squares");
+		skel.solver->setAlgorithm((IkAlgorithm)algorithmSel.run(gui, lyt).getIndex());
 
 		if (Button("solve-btn", "Solve", ikMode && !ikEnabled).run(gui, lyt))
 			skel.solver->solveIk(30);
@@ -176,22 +199,22 @@ public:
 
 		Label("Root bone:").run(gui, lyt);
 		ComboBox rootSel("root-sel", WidgetID(&skel.solver->getRootBone()));
-		for (int i = 0; i < skel.skeleton.numBones(); ++i)
+		for (int i = 0; i < skel.skeleton->numBones(); ++i)
 		{
-			const Bone &b = skel.skeleton[i];
-			if (! b.isEffector())
-				rootSel.add(WidgetID(&b), b.name);
+			const Bone &b = (*skel.skeleton)[i];
+			if (! skel.skeleton->isEffector(b))
+				rootSel.add(WidgetID(&b), skel.skeleton->getName(b));
 		}
 		const Bone *newRootBone = rootSel.run(gui, lyt).getData<const Bone>();
 		skel.solver->setRootBone(*newRootBone);
 
 		Label("Effector:").run(gui, lyt);
 		ComboBox effectorSel("effector-sel", WidgetID(&skel.solver->getEffector()));
-		for (int i = 0; i < skel.skeleton.numBones(); ++i)
+		for (int i = 0; i < skel.skeleton->numBones(); ++i)
 		{
-			const Bone &b = skel.skeleton[i];
-			if (b.isEffector())
-				effectorSel.add(WidgetID(&b), b.name);
+			const Bone &b = (*skel.skeleton)[i];
+			if (skel.skeleton->isEffector(b))
+				effectorSel.add(WidgetID(&b), skel.skeleton->getName(b));
 		}
 		const Bone *newEffector = effectorSel.run(gui, lyt).getData<const Bone>();
 		if (newEffector != &skel.solver->getEffector())
@@ -201,6 +224,13 @@ public:
 			skel.targetPos = skel.solver->getEffectorPos();
 		}
 
+		// pinned effectors hold their position while the current one moves
+		if (Button("pin-btn", "Pin Effector", ikMode).run(gui, lyt))
+			skel.solver->addEffector(skel.solver->getEffector(), skel.solver->getEffectorPos());
+
+		if (Button("unpin-btn", "Unpin All", ikMode && (skel.solver->numEffectors() > 1)).run(gui, lyt))
+			skel.solver->removeExtraEffectors();
+
 		int leftRightSplit = 250;
 		int topBottomSplit = wndSize.y - 200;
 		int a = leftRightSplit + (wndSize.x - leftRightSplit) / 3;
@@ -220,10 +250,10 @@ public:
 		}
 		else
 		{
-			SkeletonDisplay("displayP", &camPerspective, &skel.skeleton, showJointBasis, showConstraints, showGrid ? gridList : 0).run(gui, mainViewLyt);
-			SkeletonDisplay("displayX", &camX, &skel.skeleton, showJointBasis, showConstraints).run(gui, ortho0Lyt);
-			SkeletonDisplay("displayY", &camY, &skel.skeleton, showJointBasis, showConstraints).run(gui, ortho1Lyt);
-			SkeletonDisplay("displayZ", &camZ, &skel.skeleton, showJointBasis, showConstraints).run(gui, ortho2Lyt);
+			SkeletonDisplay("displayP", &camPerspective, skel.skeleton.get(), showJointBasis, showConstraints, showGrid ? gridList : 0).run(gui, mainViewLyt);
+			SkeletonDisplay("displayX", &camX, skel.skeleton.get(), showJointBasis, showConstraints).run(gui, ortho0Lyt);
+			SkeletonDisplay("displayY", &camY, skel.skeleton.get(), showJointBasis, showConstraints).run(gui, ortho1Lyt);
+			SkeletonDisplay("displayZ", &camZ, skel.skeleton.get(), showJointBasis, showConstraints).run(gui, ortho2Lyt);
 		}
 	}
 
@@ -270,12 +300,13 @@ private:
 		SkeletonItem(const std::string &fname, const std::string &name)
 			:	name(name), fname(fname)
 		{
-			skeleton.loadFromFile(fname.c_str());
-			solver.reset(new IkSolver(skeleton));
+			skeleton = SkeletonCache::shared().load(fname);
+			solver.reset(new IkSolver(*skeleton));
 			targetPos = solver->getTargetPos();
 		}
 
-		Skeleton skeleton;
+		// (shared with anything else using the same skeleton; it has to outlive the solver)
+		RCPtr<const Skeleton> skeleton;
 		ScopedPtr<IkSolver> solver;
 		vec3d targetPos;
 		std::string name;
@@ -4,6 +4,7 @@
 #include "Skeleton.h"
 #include "Pose.h"
 #include "IkSolver.h"
+#include "SkeletonRender.h"
 #include "OrbGui.h"
 #include "OrbInput.h"
 
@@ -64,15 +65,15 @@ void ThreeDDisplay::run(OrbGui &gui, OrbLayout &lyt)
 
 void SkeletonDisplay::renderScene() const
 {
-	mSkeleton->render(mShowJointBasis, mShowConstraints);
+	renderSkeleton(*mSkeleton, mShowJointBasis, mShowConstraints);
 }
 
 void PoseDisplay::renderScene() const
 {
-	//mPose->render(mShowJointBasis, mShowConstraints);
+	renderPose(*mSkeleton, *mPose, mShowJointBasis, mShowConstraints);
 }
 
 void IkSolverDisplay::renderScene() const
 {
-	mSolver->render(mShowJointBasis, mShowConstraints);
+	renderIkSolver(*mSolver, mShowJointBasis, mShowConstraints);
 }
\ No newline at end of file
@@ -5,8 +5,10 @@
 
 class Camera;
 class Skeleton;
-class Pose;
-class IkSolver;
+template <typename T> class PoseT;
+typedef PoseT<double> Pose;
+template <typename T> class IkSolverT;
+typedef IkSolverT<double> IkSolver;
 
 class ThreeDDisplay : public OrbWidget
 {
@@ -37,11 +39,12 @@ private:
 class PoseDisplay : public ThreeDDisplay
 {
 public:
-	PoseDisplay(const WidgetID &wid, Camera *camera, const Pose *pose, bool showJointBasis, bool showConstraints, GLuint gridList = 0)
-		: ThreeDDisplay(wid, camera, gridList), mPose(pose), mShowJointBasis(showJointBasis), mShowConstraints(showConstraints) {}
+	PoseDisplay(const WidgetID &wid, Camera *camera, const Skeleton *skeleton, const Pose *pose, bool showJointBasis, bool showConstraints, GLuint gridList = 0)
+		: ThreeDDisplay(wid, camera, gridList), mSkeleton(skeleton), mPose(pose), mShowJointBasis(showJointBasis), mShowConstraints(showConstraints) {}
 
 	virtual void renderScene() const;
 private:
+	const Skeleton *mSkeleton;
 	const Pose *mPose;
 	bool mShowJointBasis;
 	bool mShowConstraints;
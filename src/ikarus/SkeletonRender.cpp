@@ -0,0 +1,339 @@
+#include "Global.h"
+#include "SkeletonRender.h"
+#include "Skeleton.h"
+#include "IkSolver.h"
+#include "Pose.h"
+#include "GfxUtil.h"
+#include "MathUtil.h"
+
+// ===== Bone Rendering ======================================================
+
+void renderBone(const Bone &b, const vec3f &col)
+{
+	if ((length(b.displayVec) < 0.001))
+		renderBlob(col, vec3d(0.0, 0.0, 0.0));
+	else
+	{
+		const double len = length(b.displayVec);
+		const double offset = 0.1 * len;
+		const double invSqrt2 = 0.70710678118654746;
+
+		const vec3d dir(normalize(b.displayVec));
+
+		glColor3fv(col);
+		glBegin(GL_LINES);
+		{
+			vec3d spur0;
+			if (abs(dot(dir, unitX)) < 0.8)
+				spur0 = cross(dir, unitX);
+			else
+				spur0 = cross(dir, unitZ);
+			vec3d spur1 = cross(spur0, dir);
+
+			spur0 *= offset;
+			spur1 *= offset;
+
+			const vec3d v0 = - dir*offset;
+			const vec3d v1 = - spur0;
+			const vec3d v2 =   spur1;
+			const vec3d v3 =   spur0;
+			const vec3d v4 = - spur1;
+			const vec3d v5 = b.displayVec;
+
+			glVertex3dv(v0); glVertex3dv(v1);
+			glVertex3dv(v0); glVertex3dv(v2);
+			glVertex3dv(v0); glVertex3dv(v3);
+			glVertex3dv(v0); glVertex3dv(v4);
+
+			glVertex3dv(v1); glVertex3dv(v2);
+			glVertex3dv(v2); glVertex3dv(v3);
+			glVertex3dv(v3); glVertex3dv(v4);
+			glVertex3dv(v4); glVertex3dv(v1);
+			
+			glVertex3dv(v1); glVertex3dv(v5);
+			glVertex3dv(v2); glVertex3dv(v5);
+			glVertex3dv(v3); glVertex3dv(v5);
+			glVertex3dv(v4); glVertex3dv(v5);
+		}
+		glEnd();
+	}
+}
+
+#define RENDER_BONE_COORDS  0
+#define RENDER_JOINT_COORDS 1
+
+void renderJointCoordinates(const Skeleton &skel, const Bone &b)
+{
+	const double a = 0.75; // FIXME: shouldn't be hardcoded
+
+	// render joint coordinate spaces
+	glBegin(GL_LINES);
+	{
+#if RENDER_BONE_COORDS
+		glColor3f(1.0f, 0.0f, 0.0f);
+		glVertex3d(0.0, 0.0, 0.0);
+		glVertex3d(a, 0.0, 0.0);
+
+		glColor3f(0.0f, 1.0f, 0.0f);
+		glVertex3d(0.0, 0.0, 0.0);
+		glVertex3d(0.0, a, 0.0);
+
+		glColor3f(0.0f, 0.0f, 1.0f);
+		glVertex3d(0.0, 0.0, 0.0);
+		glVertex3d(0.0, 0.0, a);
+#endif
+
+#if RENDER_JOINT_COORDS
+		const Bone::Connection *bj = skel.getJoints(b);
+		for (int i = 0; i < b.numJoints; ++i)
+		{
+			const Bone::Connection &c = bj[i];
+			const Bone &child = skel[c.to];
+
+			if (skel.getParent(child) == &b)
+			{
+				// don't bother with joints going to effectors
+				// effectors can't do anything anyway (they're just points)
+				if (skel.isEffector(child)) continue;
+
+				vec3d ux( a , 0.0, 0.0);
+				vec3d uy(0.0,  a , 0.0);
+				vec3d uz(0.0, 0.0,  a );
+
+				ux += c.pos;
+				uy += c.pos;
+				uz += c.pos;
+
+				glColor3f(1.0f, 0.0f, 0.0f);
+				glVertex3d(c.pos.x, c.pos.y, c.pos.z);
+				glVertex3d(ux.x, ux.y, ux.z);
+
+				glColor3f(0.0f, 1.0f, 0.0f);
+				glVertex3d(c.pos.x, c.pos.y, c.pos.z);
+				glVertex3d(uy.x, uy.y, uy.z);
+
+				glColor3f(0.0f, 0.0f, 1.0f);
+				glVertex3d(c.pos.x, c.pos.y, c.pos.z);
+				glVertex3d(uz.x, uz.y, uz.z);
+			}
+		}
+#endif
+	}
+	glEnd();
+}
+
+void renderJointConstraints(const Skeleton &skel, const Bone &b, const mat3d &boneToParent)
+{
+	const double radius = 0.75;
+
+	// render joint constraints with the parent bone
+	// twist is constrained in bone-space
+	if ((b.primaryJointIdx >= 0) && (b.constraints.minTwist < b.constraints.maxTwist))
+	{
+		const double twistRadius = radius*0.75;
+
+		vec3d dir(boneToParent.elem[1][0], boneToParent.elem[1][1], boneToParent.elem[1][2]);
+		mat3d simpleM = calcDirectRotation(unitY, dir);
+		mat3d twistM = transpose(simpleM) * boneToParent;
+		twistM = transpose(twistM);
+
+		const vec3d jpos = skel.getJoints(b)[b.primaryJointIdx].pos;
+		glColor3f(1.0f, 0.0f, 0.0f);
+		glBegin(GL_LINE_STRIP);
+		arcPoints(
+			jpos,
+			twistM*vec3d(0.0, 1.0, 0.0),
+			twistM*vec3d(0.0, 0.0, 1.0),
+			twistRadius,
+			b.constraints.minTwist,
+			b.constraints.maxTwist
+		);
+		glEnd();
+
+		// render a line to indicate where in the twist-range the bone is
+		glColor3f(0.0f, 0.0f, 1.0f);
+		glBegin(GL_LINES);
+		glVertex3d(jpos.x, jpos.y, jpos.z);
+		glVertex3d(jpos.x, jpos.y, jpos.z + twistRadius);
+		glEnd();
+	}
+
+	// render joint constraints for joints with child bones
+	// azimuth & elevation are constrained in the parent bone-space
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone::Connection &c = bj[i];
+		const Bone &child = skel[c.to];
+
+		if (skel.getParent(child) == &b)
+		{
+			// don't bother with joints going to effectors
+			// effectors can't do anything anyway (they're just points)
+			if (skel.isEffector(child)) continue;
+
+			const JointConstraints &cnst = child.constraints;
+
+			// draw the real azimuth range
+			glLineWidth(1.25f);
+			glColor3f(0.0f, 1.0f, 0.0f);
+			glBegin(GL_LINE_STRIP);
+			arcPoints(
+				c.pos,
+				vec3d(0.0, 1.0, 0.0),
+				vec3d(0.0, 0.0, 1.0),
+				radius,
+				cnst.minAzimuth,
+				cnst.maxAzimuth
+			);
+			glEnd();
+
+			if (cnst.minAzimuth >= cnst.maxAzimuth)
+			{
+				double a = cnst.minAzimuth;
+				glPointSize(3.5f);
+				glBegin(GL_POINTS);
+				glVertex3d(c.pos.x + radius*sin(a), c.pos.y, c.pos.z + radius*cos(a));
+				glEnd();
+			}
+
+			// draw the rest of the azimuth range in a fainter green
+			// so that it's possible to see where the joint plane is when the azimuth is fixed
+			glLineWidth(0.75f);
+			glColor3f(0.2f, 0.5f, 0.2f);
+			glBegin(GL_LINE_STRIP);
+			arcPoints(
+				c.pos,
+				vec3d(0.0, 1.0, 0.0),
+				vec3d(0.0, 0.0, 1.0),
+				radius,
+				cnst.maxAzimuth,
+				cnst.minAzimuth+(2.0*M_PI)
+			);
+			glEnd();
+
+			glColor3f(0.0f, 0.0f, 1.0f);
+			double range = cnst.maxAzimuth - cnst.minAzimuth;
+			int N = 1 + (int)(range / (M_PI/6.0));
+			for (int i = 0; i <= N; ++i)
+			{
+				double a = cnst.minAzimuth + i*(range/N);
+
+				glBegin(GL_LINE_STRIP);
+				arcPoints(
+					c.pos,
+					vec3d(cos(a), 0.0, -sin(a)),
+					vec3d(0.0, 1.0, 0.0),
+					radius,
+					cnst.minElevation,
+					cnst.maxElevation
+				);
+				glEnd();
+			}
+		}
+	}
+}
+
+// ===== Skeleton Rendering ==================================================
+
+static void renderSkeletonBone(const Skeleton &skel, const Bone *from, const Bone &b, const vec3d &pos, bool showJointBasis, bool showJointConstraints)
+{
+	const mat3d &basis = b.defaultOrient;
+	// render the bone...
+	glPushMatrix();
+	const mat4d frame(vmath::translation_matrix(pos) * mat4d(basis));
+	glMultMatrixd(frame);
+	renderBone(b, vec3f(1.0f, 1.0f, 1.0f));
+	if (showJointBasis && !skel.isEffector(b))
+		renderJointCoordinates(skel, b);
+	if (showJointConstraints && !skel.isEffector(b))
+	{
+		mat3d rot;
+		if (from != 0)
+			rot = transpose(from->defaultOrient) * b.defaultOrient;
+		else
+			rot = b.defaultOrient;
+		renderJointConstraints(skel, b, rot);
+	}
+	glPopMatrix();
+
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone::Connection &c = bj[i];
+		const Bone &bn = skel[c.to];
+		if (&bn != from)
+			renderSkeletonBone(skel, &b, bn, pos + basis*c.pos, showJointBasis, showJointConstraints);
+	}
+}
+
+void renderSkeleton(const Skeleton &skel, bool showJointBasis, bool showJointConstraints)
+{
+	const vec3d rootPos = skel[0].worldPos;
+	renderBlob(vec3f(1.0f, 0.0f, 0.0f), rootPos);
+	renderSkeletonBone(skel, 0, skel[0], rootPos, showJointBasis, showJointConstraints);
+}
+
+// ===== Pose Rendering ======================================================
+
+void renderPose(const Skeleton &skel, const Pose &pose, bool showJointBasis, bool showJointConstraints)
+{
+	std::vector<mat4d> boneToWorld;
+	pose.getBoneToWorld(skel, boneToWorld);
+
+	for (int i = 0; i < skel.numBones(); ++i)
+	{
+		const Bone &b = skel[i];
+
+		glPushMatrix();
+		glMultMatrixd(boneToWorld[i]);
+
+		renderBone(b, vec3f(1.0f, 1.0f, 1.0f));
+
+		if (showJointBasis && !skel.isEffector(b))
+			renderJointCoordinates(skel, b);
+
+		if (showJointConstraints && !skel.isEffector(b))
+			renderJointConstraints(skel, b, vmath::quat_to_mat3(pose.getRotation(i)));
+
+		glPopMatrix();
+	}
+
+	renderBlob(vec3f(1.0f, 0.0f, 0.0f), pose.getRootPos());
+}
+
+// ===== IkSolver Rendering ==================================================
+
+void renderIkSolver(const IkSolver &solver, bool showJointBasis, bool showJointConstraints)
+{
+	const Skeleton &skel = solver.getSkeleton();
+	const Bone *effectorBone = &solver.getEffector();
+
+	for (int i = 0; i < skel.numBones(); ++i)
+	{
+		const Bone &b = skel[i];
+
+		glPushMatrix();
+		glMultMatrixd(solver.getBoneToWorld(b));
+
+		if (&b == effectorBone)
+			renderBone(b, vec3f(1.0f, 1.0f, 0.0f));
+		else
+			renderBone(b, vec3f(1.0f, 1.0f, 1.0f));
+
+		if (showJointBasis && !skel.isEffector(b))
+			renderJointCoordinates(skel, b);
+		
+		if (showJointConstraints && !skel.isEffector(b))
+			renderJointConstraints(skel, b, solver.getBoneRotation(b));
+
+		glPopMatrix();
+	}
+
+	renderBlob(vec3f(1.0f, 0.0f, 0.0f), solver.getRootPos());
+	renderBlob(vec3f(0.0f, 1.0f, 0.0f), solver.getTargetPos());
+
+	// the pinned effectors
+	for (int i = 1; i < solver.numEffectors(); ++i)
+		renderBlob(vec3f(0.0f, 0.5f, 1.0f), solver.getTargetPos(i));
+}
@@ -0,0 +1,29 @@
+#ifndef SKELETON_RENDER_H
+#define SKELETON_RENDER_H
+
+// OpenGL rendering for skeletons and IK solver state
+// (kept separate from the skeleton and solver themselves,
+// so that the ikcore library doesn't depend on OpenGL)
+
+class Bone;
+class Skeleton;
+template <typename T> class IkSolverT;
+typedef IkSolverT<double> IkSolver;
+template <typename T> class PoseT;
+typedef PoseT<double> Pose;
+
+// expects the matrices to be set up to put vertices in bone-space
+void renderBone(const Bone &b, const vec3f &col);
+void renderJointCoordinates(const Skeleton &skel, const Bone &b);
+void renderJointConstraints(const Skeleton &skel, const Bone &b, const mat3d &boneToParent);
+
+// render the skeleton in its default pose
+void renderSkeleton(const Skeleton &skel, bool showJointBasis, bool showJointConstraints);
+
+// render the skeleton in a pose, with its root highlighted
+void renderPose(const Skeleton &skel, const Pose &pose, bool showJointBasis, bool showJointConstraints);
+
+// render the skeleton, with root, effector and target highlighted
+void renderIkSolver(const IkSolver &solver, bool showJointBasis, bool showJointConstraints);
+
+#endif
@@ -0,0 +1,482 @@
+#include "CoreGlobal.h"
+#include "Skeleton.h"
+#include "SkeletonCache.h"
+#include "IkSolver.h"
+#include "IkKernel.h"
+#include "MathUtil.h"
+#include "Thread.h"
+
+#include <cstdio>
+
+// ikbench: microbenchmarks for the solver core (the rotation maths, the constraints, vmath,
+// solving and skeleton loading), for tracking performance changes from one build to the next
+//
+// usage: ikbench [skeleton directory] [output file]
+// (by default, the skeletons are read from release/, and the results are written to stdout)
+//
+// The results are written as JSON, one record per benchmark, always in the same order and with the
+// same fields, so two runs can be compared line by line. Every benchmark is run several times over,
+// and the fastest and the median run are both reported (in nanoseconds per operation); the random
+// inputs come from a fixed seed, so they're the same on every run and every machine.
+
+// ===== Benchmark Framework =================================================
+
+// a small, fixed-seed generator, so the inputs don't depend on the C library's rand()
+class Random
+{
+public:
+	explicit Random(unsigned int seed)
+	:	state(seed)
+	{}
+
+	// uniform in [0, 1)
+	double next()
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.0 / 16777216.0);
+	}
+
+	double range(double a, double b)
+	{ return a + (b - a) * next(); }
+
+	vec3d unitVec()
+	{
+		// (rejection sampling, so the directions are spread evenly)
+		for (;;)
+		{
+			const vec3d v(range(-1.0, 1.0), range(-1.0, 1.0), range(-1.0, 1.0));
+			const double lenSqr = dot(v, v);
+			if ((lenSqr > 0.0001) && (lenSqr <= 1.0))
+				return v / std::sqrt(lenSqr);
+		}
+	}
+
+	mat3d rotation()
+	{ return rotationFromAzElTwist(range(-M_PI, M_PI), range(0.0, M_PI), range(-M_PI, M_PI)); }
+
+private:
+	unsigned int state;
+};
+
+// results that go alongside the timings (eg, how many iterations the solves took)
+typedef std::vector< std::pair<std::string, double> > BenchExtras;
+
+struct BenchResult
+{
+	std::string name;
+	int ops;
+	int runs;
+	double minNs;
+	double medianNs;
+	BenchExtras extras;
+};
+
+// a benchmark performs a fixed number of operations each time it's run;
+// anything it computes goes into sink, so that the work can't be optimised away
+class Benchmark
+{
+public:
+	Benchmark(const std::string &name, int ops)
+	:	name(name), ops(ops), sink(0.0)
+	{}
+
+	virtual ~Benchmark() {}
+
+	// performs the operations, and returns the time they took, in seconds
+	// (by default, the whole run is timed)
+	virtual double run()
+	{
+		const double start = monotonicSeconds();
+		body();
+		return monotonicSeconds() - start;
+	}
+
+	// the results other than the timings, once the runs are done
+	virtual void getExtras(BenchExtras &/*extras*/) const {}
+
+	const std::string name;
+	const int ops;
+	double sink;
+
+protected:
+	virtual void body() {}
+};
+
+static BenchResult runBenchmark(Benchmark &bench, int runs)
+{
+	// one run to warm up the caches, which isn't counted
+	bench.run();
+
+	std::vector<double> times;
+	for (int r = 0; r < runs; ++r)
+		times.push_back(bench.run() * 1e9 / bench.ops);
+	std::sort(times.begin(), times.end());
+
+	BenchResult result;
+	result.name = bench.name;
+	result.ops = bench.ops;
+	result.runs = runs;
+	result.minNs = times.front();
+	result.medianNs = times[runs / 2];
+	bench.getExtras(result.extras);
+	return result;
+}
+
+static std::string formatNumber(double v)
+{
+	char buf[64];
+	sprintf(buf, "%.3f", v);
+	return buf;
+}
+
+static void writeResults(std::ostream &os, const std::vector<BenchResult> &results)
+{
+	os << "{\n";
+	os << "  \"format\": 1,\n";
+	os << "  \"benchmarks\": [\n";
+	for (int i = 0; i < (int)results.size(); ++i)
+	{
+		const BenchResult &r = results[i];
+		os << "    {\"name\": \"" << r.name << "\", \"ops\": " << r.ops << ", \"runs\": " << r.runs
+		   << ", \"min_ns\": " << formatNumber(r.minNs) << ", \"median_ns\": " << formatNumber(r.medianNs);
+		for (int j = 0; j < (int)r.extras.size(); ++j)
+			os << ", \"" << r.extras[j].first << "\": " << formatNumber(r.extras[j].second);
+		os << "}" << ((i + 1 < (int)results.size()) ? ",\n" : "\n");
+	}
+	os << "  ]\n";
+	os << "}\n";
+}
+
+// ===== Maths Benchmarks ====================================================
+
+template <typename T>
+class DirectRotationBench : public Benchmark
+{
+public:
+	DirectRotationBench(const std::string &name, int count)
+	:	Benchmark(name, count)
+	{
+		Random rnd(1);
+		for (int i = 0; i < count; ++i)
+		{
+			from.push_back(convertVec<T>(rnd.unitVec() * rnd.range(0.5, 2.0)));
+			to.push_back(convertVec<T>(rnd.unitVec() * rnd.range(0.5, 2.0)));
+		}
+	}
+
+protected:
+	virtual void body()
+	{
+		T sum = T(0);
+		for (int i = 0; i < ops; ++i)
+			sum += calcDirectRotation(from[i], to[i]).elem[0][1];
+		sink += sum;
+	}
+
+private:
+	std::vector< vmath::vec3<T> > from, to;
+};
+
+class ConstrainRotBench : public Benchmark
+{
+public:
+	// the rotations are clamped by each bone's constraints in turn
+	ConstrainRotBench(const std::string &name, const Skeleton &skel, int count)
+	:	Benchmark(name, count)
+	{
+		Random rnd(2);
+		for (int i = 0; i < count; ++i)
+		{
+			rots.push_back(rnd.rotation());
+			constraints.push_back(&skel[i % skel.numBones()].constraints);
+		}
+	}
+
+protected:
+	virtual void body()
+	{
+		double sum = 0.0;
+		for (int i = 0; i < ops; ++i)
+			sum += constrainRot(*constraints[i], rots[i]).elem[1][1];
+		sink += sum;
+	}
+
+private:
+	std::vector<mat3d> rots;
+	std::vector<const JointConstraints*> constraints;
+};
+
+class AzElTwistBench : public Benchmark
+{
+public:
+	AzElTwistBench(const std::string &name, int count)
+	:	Benchmark(name, count)
+	{
+		Random rnd(3);
+		for (int i = 0; i < count; ++i)
+			rots.push_back(rnd.rotation());
+	}
+
+protected:
+	virtual void body()
+	{
+		double sum = 0.0;
+		for (int i = 0; i < ops; ++i)
+		{
+			vec3d dir;
+			double az, el, twist;
+			rotationToAzimuthElevationTwist(rots[i], dir, az, el, twist);
+			sum += az + el + twist;
+		}
+		sink += sum;
+	}
+
+private:
+	std::vector<mat3d> rots;
+};
+
+// the mat4 operations that the transform updates are made of
+class Mat4Bench : public Benchmark
+{
+public:
+	enum Op { Multiply, TransformPoint, Inverse };
+
+	Mat4Bench(const std::string &name, Op op, int count)
+	:	Benchmark(name, count), op(op)
+	{
+		Random rnd(4);
+		for (int i = 0; i < count; ++i)
+		{
+			const vec3d pos(rnd.range(-1.0, 1.0), rnd.range(-1.0, 1.0), rnd.range(-1.0, 1.0));
+			mats.push_back(vmath::translation_matrix(pos) * mat4d(rnd.rotation()));
+			points.push_back(rnd.unitVec());
+		}
+	}
+
+protected:
+	virtual void body()
+	{
+		double sum = 0.0;
+		const int n = ops;
+		if (op == Multiply)
+		{
+			// a running product, as when walking down a chain of bones
+			mat4d m(1.0);
+			for (int i = 0; i < n; ++i)
+			{
+				m = m * mats[i];
+				m.elem[3][0] *= 0.5; // (keep the translation from running away)
+			}
+			sum = m.elem[3][0];
+		}
+		else if (op == TransformPoint)
+		{
+			for (int i = 0; i < n; ++i)
+				sum += transform_point(mats[i], points[i]).x;
+		}
+		else
+		{
+			for (int i = 0; i < n; ++i)
+				sum += inverse(mats[i]).elem[3][1];
+		}
+		sink += sum;
+	}
+
+private:
+	Op op;
+	std::vector<mat4d> mats;
+	std::vector<vec3d> points;
+};
+
+// ===== Solver Benchmarks ===================================================
+
+// solves a set of targets spread across the skeleton's effectors, each from the default pose
+// only the solves themselves are timed, with the stats off; the iterations and the final error reported
+// alongside come from a separate pass over the same targets with them on
+class SolveBench : public Benchmark
+{
+public:
+	SolveBench(const std::string &name, const Skeleton &skel, bool reachable, int count)
+	:	Benchmark(name, count), solver(skel)
+	{
+		std::vector<const Bone*> effectors;
+		for (int i = 0; i < skel.numBones(); ++i)
+		{
+			if (skel.isEffector(skel[i]))
+				effectors.push_back(&skel[i]);
+		}
+
+		// a reachable target is where the effector ends up in a pose solved for without constraints
+		// (so it's reachable with them turned off, and mostly with them on); an unreachable one is
+		// further from the effector's default position than the whole chain can stretch
+		Random rnd(reachable ? 5 : 6);
+		IkSolver posed(skel);
+		posed.enableConstraints(false);
+		for (int i = 0; i < count; ++i)
+		{
+			const Bone &eff = *effectors[i % effectors.size()];
+			vec3d target;
+			if (reachable)
+			{
+				posed.resetAll();
+				posed.setEffector(eff);
+				posed.setTargetPos(eff.worldPos + rnd.unitVec() * rnd.range(0.25, 2.0));
+				posed.solveIk(100);
+				target = posed.getEffectorPos();
+			}
+			else
+			{
+				IkChain chain;
+				ikBuildChain(skel, skel[0], eff, chain);
+				target = eff.worldPos + rnd.unitVec() * (3.0 * chain.reach + 1.0);
+			}
+			targets.push_back(std::make_pair(&eff, target));
+		}
+
+		// the solves are the same every run, so one pass gives the stats for all of them
+		solver.enableStats();
+		solve(count);
+		meanIterations = solver.getStats().meanIterations();
+		meanError = solver.getStats().meanError();
+		solver.enableStats(false);
+	}
+
+	virtual double run()
+	{
+		const double total = solve(ops);
+		sink += solver.getEffectorPos().x;
+		return total;
+	}
+
+	virtual void getExtras(BenchExtras &extras) const
+	{
+		extras.push_back(std::make_pair(std::string("mean_iterations"), meanIterations));
+		extras.push_back(std::make_pair(std::string("mean_error"), meanError));
+	}
+
+private:
+	// solves for the first n targets, returning the time taken by the solves
+	double solve(int n)
+	{
+		double total = 0.0;
+		for (int i = 0; i < n; ++i)
+		{
+			solver.resetAll();
+			solver.setEffector(*targets[i].first);
+			solver.setTargetPos(targets[i].second);
+
+			const double start = monotonicSeconds();
+			solver.solveIk(100);
+			total += monotonicSeconds() - start;
+		}
+		return total;
+	}
+
+	IkSolver solver;
+	double meanIterations;
+	double meanError;
+	std::vector< std::pair<const Bone*, vec3d> > targets;
+};
+
+// ===== Loader Benchmark ====================================================
+
+// (through the skeleton cache, loading a skeleton that's already there still reads and hashes the file)
+class LoadBench : public Benchmark
+{
+public:
+	LoadBench(const std::string &name, const std::string &fname, bool cached, int count)
+	:	Benchmark(name, count), fname(fname), cached(cached)
+	{}
+
+protected:
+	virtual void body()
+	{
+		for (int i = 0; i < ops; ++i)
+		{
+			if (cached)
+				sink += SkeletonCache::shared().load(fname)->numBones();
+			else
+			{
+				Skeleton skel;
+				skel.loadFromFile(fname);
+				sink += skel.numBones();
+			}
+		}
+	}
+
+private:
+	std::string fname;
+	bool cached;
+};
+
+// ===== Main ================================================================
+
+int main(int argc, char *argv[])
+{
+	const std::string dir = (argc > 1) ? argv[1] : "release";
+	const int runs = 5;
+
+	const char *const skeletonNames[] = { "simple", "snake", "human" };
+	const int numSkeletons = sizeof(skeletonNames) / sizeof(skeletonNames[0]);
+
+	try
+	{
+		refvector<Skeleton> skeletons;
+		for (int s = 0; s < numSkeletons; ++s)
+		{
+			skeletons.push_back(new Skeleton());
+			skeletons.back().loadFromFile(dir + "/" + skeletonNames[s] + ".skl");
+		}
+		const Skeleton &human = skeletons[numSkeletons - 1];
+
+		refvector<Benchmark> benches;
+		benches.push_back(new DirectRotationBench<double>("math/calcDirectRotation/double", 100000));
+		benches.push_back(new DirectRotationBench<float>("math/calcDirectRotation/float", 100000));
+		benches.push_back(new ConstrainRotBench("math/constrainRot", human, 100000));
+		benches.push_back(new AzElTwistBench("math/rotationToAzimuthElevationTwist", 100000));
+		benches.push_back(new Mat4Bench("vmath/mat4/multiply", Mat4Bench::Multiply, 100000));
+		benches.push_back(new Mat4Bench("vmath/mat4/transform_point", Mat4Bench::TransformPoint, 100000));
+		benches.push_back(new Mat4Bench("vmath/mat4/inverse", Mat4Bench::Inverse, 100000));
+
+		for (int s = 0; s < numSkeletons; ++s)
+		{
+			const std::string name = skeletonNames[s];
+			benches.push_back(new SolveBench("solve/" + name + "/reachable", skeletons[s], true, 200));
+			benches.push_back(new SolveBench("solve/" + name + "/unreachable", skeletons[s], false, 200));
+		}
+
+		for (int s = 0; s < numSkeletons; ++s)
+		{
+			const std::string name = skeletonNames[s];
+			benches.push_back(new LoadBench("load/" + name, dir + "/" + name + ".skl", false, 50));
+			benches.push_back(new LoadBench("load/" + name + "/cached", dir + "/" + name + ".skl", true, 50));
+		}
+
+		std::vector<BenchResult> results;
+		double sink = 0.0;
+		for (int i = 0; i < (int)benches.size(); ++i)
+		{
+			std::cerr << benches[i].name << "\n";
+			results.push_back(runBenchmark(benches[i], runs));
+			sink += benches[i].sink;
+		}
+
+		if (argc > 2)
+		{
+			std::ofstream fs(argv[2]);
+			writeResults(fs, results);
+		}
+		else
+			writeResults(std::cout, results);
+
+		// (so the results can't be thrown away)
+		if (sink == 12345.678)
+			std::cerr << "\n";
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << "ikbench: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef CORE_GLOBAL_H
+#define CORE_GLOBAL_H
+
+// global header for the ikcore library
+// (solver, skeleton loading and maths)
+// nb: nothing in here may depend on windows.h or OpenGL;
+// the library has to build and run on machines with no display
+
+// global standard libraries
+
+#include <stdexcept>
+#include <cassert>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+// make sure abs() picks up the floating point overloads
+// (otherwise some compilers silently call abs(int) for doubles)
+using std::abs;
+
+// global internal headers
+
+#include "refvector.h"
+#include "smartptr.h"
+#include "vmath.h"
+#include "murmurhash.h"
+
+typedef vmath::vec2<double> vec2d;
+typedef vmath::vec3<double> vec3d;
+typedef vmath::vec4<double> vec4d;
+
+typedef vmath::vec2<float> vec2f;
+typedef vmath::vec3<float> vec3f;
+typedef vmath::vec4<float> vec4f;
+
+typedef vmath::mat2<double> mat2d;
+typedef vmath::mat3<double> mat3d;
+typedef vmath::mat4<double> mat4d;
+
+typedef vmath::mat2<float> mat2f;
+typedef vmath::mat3<float> mat3f;
+typedef vmath::mat4<float> mat4f;
+
+typedef vmath::quat<double> quatd;
+typedef vmath::quat<float> quatf;
+
+static const vec3d unitX(1.0, 0.0, 0.0);
+static const vec3d unitY(0.0, 1.0, 0.0);
+static const vec3d unitZ(0.0, 0.0, 1.0);
+
+// ===== Utility Functions =====
+
+template <typename T>
+T clamp(const T &a, const T &b, const T &v)
+{
+	if (v < a)
+		return a;
+	else if (v > b)
+		return b;
+	else
+		return v;
+}
+
+#endif
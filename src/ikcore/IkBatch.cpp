@@ -0,0 +1,821 @@
+#include "CoreGlobal.h"
+#include "IkBatch.h"
+#include "IkSolver.h"
+#include "Skeleton.h"
+#include "TaskScheduler.h"
+#include "Thread.h"
+#include "MathUtil.h"
+
+// ===== IkBatch =============================================================
+
+template <typename T>
+IkBatchT<T>::IkBatchT(const Skeleton &skel, int numInstances)
+:	skeleton(skel),
+	bonesPerInstance(skel.numBones()),
+	mApplyConstraints(true),
+	mQuaternions(false),
+	mTwoBone(true),
+	mAlgorithm(IkCCD),
+	mDamping(T(0.1)),
+	mStallRate(T(0)),
+	mLockstep(false),
+	mStats(false)
+{
+	scratch.resize(1);
+	resize(numInstances);
+}
+
+template <typename T>
+const Skeleton &IkBatchT<T>::getSkeleton() const
+{
+	return skeleton;
+}
+
+template <typename T>
+int IkBatchT<T>::numInstances() const
+{
+	return (int)instances.size();
+}
+
+template <typename T>
+int IkBatchT<T>::addInstance()
+{
+	const int inst = numInstances();
+	resize(inst + 1);
+	return inst;
+}
+
+template <typename T>
+void IkBatchT<T>::resize(int numInstances)
+{
+	assert(numInstances >= 0);
+	const int oldSize = this->numInstances();
+
+	instances.resize(numInstances);
+	boneStates.resize(numInstances * bonesPerInstance);
+
+	for (int i = oldSize; i < numInstances; ++i)
+		resetAll(i);
+}
+
+template <typename T>
+typename IkBatchT<T>::BoneState *IkBatchT<T>::getBoneStates(int inst)
+{
+	assert(inst >= 0 && inst < numInstances());
+	return &boneStates[inst * bonesPerInstance];
+}
+
+template <typename T>
+const typename IkBatchT<T>::BoneState *IkBatchT<T>::getBoneStates(int inst) const
+{
+	assert(inst >= 0 && inst < numInstances());
+	return &boneStates[inst * bonesPerInstance];
+}
+
+template <typename T>
+const typename IkBatchT<T>::vec3t &IkBatchT<T>::getTargetPos(int inst) const
+{
+	return instances[inst].targetPos;
+}
+
+template <typename T>
+const Bone &IkBatchT<T>::getRootBone(int inst) const
+{
+	return skeleton[instances[inst].rootId];
+}
+
+template <typename T>
+const Bone &IkBatchT<T>::getEffector(int inst) const
+{
+	assert(instances[inst].effectorId >= 0);
+	return skeleton[instances[inst].effectorId];
+}
+
+template <typename T>
+typename IkBatchT<T>::vec3t IkBatchT<T>::getEffectorPos(int inst) const
+{
+	const Instance &in = instances[inst];
+	assert(in.effectorId >= 0);
+	return getBoneStates(inst)[in.effectorId].boneToWorld.translation();
+}
+
+template <typename T>
+const typename IkBatchT<T>::vec3t &IkBatchT<T>::getRootPos(int inst) const
+{
+	return instances[inst].rootPos;
+}
+
+template <typename T>
+const typename IkBatchT<T>::mat4t &IkBatchT<T>::getBoneToWorld(int inst, const Bone &b) const
+{
+	return getBoneStates(inst)[b.id].boneToWorld;
+}
+
+template <typename T>
+const typename IkBatchT<T>::mat3t &IkBatchT<T>::getBoneRotation(int inst, const Bone &b) const
+{
+	return getBoneStates(inst)[b.id].rot;
+}
+
+template <typename T>
+void IkBatchT<T>::setTargetPos(int inst, const vec3t &target)
+{
+	instances[inst].targetPos = target;
+}
+
+template <typename T>
+void IkBatchT<T>::setRootBone(int inst, const Bone &bone)
+{
+	Instance &in = instances[inst];
+
+	// early out if we're not changing anything
+	if (in.rootId == bone.id) return;
+
+	BoneState *states = getBoneStates(inst);
+	ikChangeRoot(skeleton, skeleton[in.rootId], bone, states);
+
+	in.rootId = bone.id;
+	in.rootPos = states[bone.id].boneToWorld.translation();
+	in.chainIdx = findChain(in.rootId, in.effectorId);
+
+	ikUpdateBoneTransforms(skeleton, bone, in.rootPos, states);
+}
+
+template <typename T>
+void IkBatchT<T>::setEffector(int inst, const Bone &bone)
+{
+	Instance &in = instances[inst];
+	in.effectorId = bone.id;
+	in.chainIdx = findChain(in.rootId, in.effectorId);
+}
+
+template <typename T>
+bool IkBatchT<T>::areConstraintsEnabled() const
+{
+	return mApplyConstraints;
+}
+
+template <typename T>
+void IkBatchT<T>::enableConstraints(bool enabled)
+{
+	mApplyConstraints = enabled;
+}
+
+template <typename T>
+bool IkBatchT<T>::areQuaternionsEnabled() const
+{
+	return mQuaternions;
+}
+
+template <typename T>
+void IkBatchT<T>::enableQuaternions(bool enabled)
+{
+	mQuaternions = enabled;
+}
+
+template <typename T>
+bool IkBatchT<T>::isTwoBoneEnabled() const
+{
+	return mTwoBone;
+}
+
+template <typename T>
+void IkBatchT<T>::enableTwoBone(bool enabled)
+{
+	mTwoBone = enabled;
+}
+
+template <typename T>
+IkAlgorithm IkBatchT<T>::getAlgorithm() const
+{
+	return mAlgorithm;
+}
+
+template <typename T>
+void IkBatchT<T>::setAlgorithm(IkAlgorithm algorithm)
+{
+	mAlgorithm = algorithm;
+}
+
+template <typename T>
+T IkBatchT<T>::getDamping() const
+{
+	return mDamping;
+}
+
+template <typename T>
+void IkBatchT<T>::setDamping(T damping)
+{
+	mDamping = damping;
+}
+
+template <typename T>
+T IkBatchT<T>::getStallRate() const
+{
+	return mStallRate;
+}
+
+template <typename T>
+void IkBatchT<T>::setStallRate(T rate)
+{
+	mStallRate = clamp(T(0), T(1), rate);
+}
+
+template <typename T>
+bool IkBatchT<T>::isLockstepEnabled() const
+{
+	return mLockstep;
+}
+
+template <typename T>
+void IkBatchT<T>::enableLockstep(bool enabled)
+{
+	mLockstep = enabled;
+}
+
+template <typename T>
+bool IkBatchT<T>::areStatsEnabled() const
+{
+	return mStats;
+}
+
+template <typename T>
+void IkBatchT<T>::enableStats(bool enabled)
+{
+	mStats = enabled;
+}
+
+template <typename T>
+IkStats IkBatchT<T>::getStats() const
+{
+	IkStats total;
+	for (int i = 0; i < (int)scratch.size(); ++i)
+		total.add(scratch[i].stats);
+	return total;
+}
+
+template <typename T>
+void IkBatchT<T>::resetStats()
+{
+	for (int i = 0; i < (int)scratch.size(); ++i)
+		scratch[i].stats.reset();
+}
+
+template <typename T>
+void IkBatchT<T>::resetAll(int inst)
+{
+	Instance &in = instances[inst];
+
+	in.rootId = 0;
+	in.effectorId = -1;
+	in.targetPos = vec3t(T(0), T(0), T(0));
+	for (int i = 0; i < (int)skeleton.numBones(); ++i)
+	{
+		const Bone &b = skeleton[i];
+		if (skeleton.isEffector(b))
+		{
+			in.effectorId = b.id;
+			in.targetPos = convertVec<T>(b.worldPos);
+			break;
+		}
+	}
+	in.chainIdx = findChain(in.rootId, in.effectorId);
+
+	resetPose(inst);
+}
+
+template <typename T>
+void IkBatchT<T>::resetPose(int inst)
+{
+	Instance &in = instances[inst];
+	const Bone &root = skeleton[in.rootId];
+	in.rootPos = convertVec<T>(root.worldPos);
+	ikResetPose(skeleton, root, getBoneStates(inst));
+}
+
+template <typename T>
+int IkBatchT<T>::findChain(int rootId, int effectorId)
+{
+	if (effectorId < 0)
+		return -1;
+
+	const std::pair<int, int> key(rootId, effectorId);
+	std::map<std::pair<int, int>, int>::const_iterator it = chainLookup.find(key);
+	if (it != chainLookup.end())
+		return it->second;
+
+	const int idx = (int)chains.size();
+	chains.push_back(IkChainT<T>());
+	ikBuildChain(skeleton, skeleton[rootId], skeleton[effectorId], chains.back());
+	chainLookup[key] = idx;
+	return idx;
+}
+
+template <typename T>
+int IkBatchT<T>::numWorkers() const
+{
+	return (int)scratch.size();
+}
+
+template <typename T>
+void IkBatchT<T>::setNumWorkers(int numWorkers)
+{
+	// (the statistics gathered so far are kept, as long as their workers are)
+	assert(numWorkers >= 1);
+	scratch.resize(numWorkers);
+}
+
+template <typename T>
+void IkBatchT<T>::solveIk(int maxIterations, T threshold)
+{
+	solveIk(0, numInstances(), maxIterations, threshold);
+}
+
+template <typename T>
+void IkBatchT<T>::solveIk(int first, int count, int maxIterations, T threshold, int worker)
+{
+	// (the working space isn't added to here, as other threads may be solving with theirs)
+	assert(first >= 0 && first + count <= numInstances());
+	assert(worker >= 0 && worker < numWorkers());
+	solveRange(first, count, maxIterations, threshold, scratch[worker]);
+}
+
+// solves a range of instances on whichever worker picks it up
+// instances are completely independent, and only the instance's own
+// bone states and the worker's own scratch space are written,
+// so no synchronisation is needed
+template <typename T>
+class IkBatchT<T>::SolveTask : public RangeTask
+{
+public:
+	SolveTask(IkBatchT &batch, int maxIterations, T threshold)
+	:	batch(batch), maxIterations(maxIterations), threshold(threshold)
+	{}
+
+	virtual void run(int begin, int end, int worker)
+	{
+		batch.solveRange(begin, end - begin, maxIterations, threshold, batch.scratch[worker]);
+	}
+
+private:
+	IkBatchT &batch;
+	int maxIterations;
+	T threshold;
+};
+
+template <typename T>
+void IkBatchT<T>::solveIk(TaskScheduler &scheduler, int maxIterations, T threshold, int grainSize)
+{
+	if ((int)scratch.size() < scheduler.numWorkers())
+		scratch.resize(scheduler.numWorkers());
+
+	if (mLockstep && (mAlgorithm == IkCCD))
+	{
+		const int width = ikLaneWidth<T>();
+		grainSize = ((grainSize + width - 1) / width) * width;
+	}
+
+	SolveTask task(*this, maxIterations, threshold);
+	scheduler.parallelFor(numInstances(), grainSize, task);
+}
+
+template <typename T>
+int IkBatchT<T>::solveIkWithin(double seconds, int maxIterations, T threshold)
+{
+	return solveIkWithin(0, numInstances(), seconds, maxIterations, threshold);
+}
+
+template <typename T>
+int IkBatchT<T>::solveIkWithin(int first, int count, double seconds, int maxIterations, T threshold, int worker)
+{
+	// a few iterations per round is enough to tell whether an instance has stalled
+	const int iterationsPerRound = 4;
+	const double deadline = monotonicSeconds() + seconds;
+
+	assert(first >= 0 && first + count <= numInstances());
+	assert(worker >= 0 && worker < numWorkers());
+	Scratch &scr = scratch[worker];
+	std::vector<int> &pending = scr.pending;
+
+	pending.clear();
+	for (int i = first; i < first + count; ++i)
+		pending.push_back(i);
+
+	for (int done = 0; (done < maxIterations) && !pending.empty(); done += iterationsPerRound)
+	{
+		const int iterations = std::min(iterationsPerRound, maxIterations - done);
+
+		// the instances that are still going after this round are kept, in order
+		int kept = 0;
+		for (int k = 0; k < (int)pending.size(); ++k)
+		{
+			if (monotonicSeconds() >= deadline)
+			{
+				// out of time: the rest of the round are still going too
+				kept += (int)pending.size() - k;
+				pending.resize(kept);
+				return kept;
+			}
+
+			if (!solveInstance(pending[k], iterations, threshold, scr))
+				pending[kept++] = pending[k];
+		}
+		pending.resize(kept);
+	}
+	return (int)pending.size();
+}
+
+template <typename T>
+void IkBatchT<T>::iterateIk()
+{
+	solveIk(0, numInstances(), 1, T(0));
+}
+
+template <typename T>
+void IkBatchT<T>::solveRange(int first, int count, int maxIterations, T threshold, Scratch &scr)
+{
+	if (mLockstep && (mAlgorithm == IkCCD))
+		solveLockstep(first, count, maxIterations, threshold, scr);
+	else
+	{
+		for (int i = first; i < first + count; ++i)
+			solveInstance(i, maxIterations, threshold, scr);
+	}
+}
+
+template <typename T>
+bool IkBatchT<T>::solveInstance(int inst, int maxIterations, T threshold, Scratch &scr)
+{
+	IkChainStateT<T> &cs = scr.chain;
+	const Instance &in = instances[inst];
+	if (in.chainIdx < 0)
+		return true;
+
+	cs.stats = mStats ? &scr.stats : 0;
+	IkPhaseTimer timer(cs.stats);
+
+	const IkChainT<T> &chain = chains[in.chainIdx];
+	BoneState *states = getBoneStates(inst);
+
+	// see IkSolver::solveIk
+	const bool quaternions = mQuaternions && (mAlgorithm == IkCCD);
+	ikLoadChain(chain, states, cs);
+
+	IkConvergenceT<T> convergence(threshold, ikReachGap(chain, cs, in.targetPos), mStallRate);
+	IkStopReason stop = IkRanOut;
+	timer.mark(IkPhaseBuild);
+
+	bool solved = false;
+	if (mTwoBone && (maxIterations > 0) && ikIsTwoBoneChain(chain))
+	{
+		solved = ikSolveTwoBone(chain, cs, in.targetPos, mApplyConstraints);
+		if (solved)
+			stop = (convergence.gap > T(0)) ? IkReachedClosest : IkReachedTarget;
+		timer.mark(IkPhaseStep);
+	}
+
+	if (quaternions)
+		ikLoadChainQuat(cs);
+
+	int iterations = 0;
+	while (!solved && (iterations < maxIterations))
+	{
+		++iterations;
+		if (mAlgorithm == IkFABRIK)
+		{
+			ikStepFABRIK(chain, cs, in.targetPos, mApplyConstraints);
+			timer.mark(IkPhaseStep);
+		}
+		else
+		{
+			if (mAlgorithm != IkCCD)
+				ikStepJacobian(mAlgorithm, chain, cs, scr.jacobian, in.targetPos, mDamping, mApplyConstraints);
+			else if (quaternions) // perform basic CCD
+				ikStepCCDQuat(chain, cs, in.targetPos, mApplyConstraints);
+			else
+				ikStepCCD(chain, cs, in.targetPos, mApplyConstraints);
+			timer.mark(IkPhaseStep);
+
+			ikUpdateChainTransforms(chain, in.rootPos, cs);
+			timer.mark(IkPhaseTransforms);
+		}
+
+		solved = convergence.update(length(cs.worldPos[0] - in.targetPos), stop);
+	}
+	if (cs.stats)
+		cs.stats->addSolve(iterations, stop, length(cs.worldPos[0] - in.targetPos));
+
+	// need the bone transforms to be valid again afterwards for consistency
+	// (but only the bones at or below the ones that moved can have changed)
+	const int last = ikStoreChain(chain, cs, states);
+	timer.mark(IkPhaseBuild);
+	if (last >= 0)
+	{
+		ikUpdateChainBoneTransforms(skeleton, chain, last, in.rootPos, states);
+		timer.mark(IkPhaseTransforms);
+	}
+	return solved;
+}
+
+template <typename T>
+void IkBatchT<T>::solveLockstep(int first, int count, int maxIterations, T threshold, Scratch &scr)
+{
+	// group the instances by chain, so that each group of lanes shares one chain
+	// (two-bone chains have a faster path than CCD, so those instances are solved on their own)
+	scr.order.clear();
+	for (int i = first; i < first + count; ++i)
+	{
+		const int chainIdx = instances[i].chainIdx;
+		if (chainIdx < 0)
+			continue;
+
+		if (mTwoBone && ikIsTwoBoneChain(chains[chainIdx]))
+			solveInstance(i, maxIterations, threshold, scr);
+		else
+			scr.order.push_back(std::make_pair(chainIdx, i));
+	}
+	std::sort(scr.order.begin(), scr.order.end());
+
+	scr.lanes.stats = mStats ? &scr.stats : 0;
+	const int width = ikLaneWidth<T>();
+	scr.laneStates.resize(width);
+	scr.laneTargets.resize(width);
+	scr.laneRootPositions.resize(width);
+
+	int next = 0;
+	while (next < (int)scr.order.size())
+	{
+		const int chainIdx = scr.order[next].first;
+
+		int lanes = 0;
+		while ((lanes < width) && (next < (int)scr.order.size()) && (scr.order[next].first == chainIdx))
+		{
+			const Instance &in = instances[scr.order[next].second];
+			scr.laneStates[lanes] = getBoneStates(scr.order[next].second);
+			scr.laneTargets[lanes] = in.targetPos;
+			scr.laneRootPositions[lanes] = in.rootPos;
+			++lanes;
+			++next;
+		}
+
+		ikSolveLanes(chains[chainIdx], lanes, &scr.laneStates[0], &scr.laneTargets[0], &scr.laneRootPositions[0], maxIterations, threshold, mStallRate, mApplyConstraints, scr.lanes);
+
+		// need the bone transforms to be valid again afterwards for consistency
+		// (CCD never rotates the root, so only the bones below it along the chain can have moved)
+		const IkChainT<T> &chain = chains[chainIdx];
+		IkPhaseTimer timer(scr.lanes.stats);
+		for (int l = next - lanes; l < next; ++l)
+		{
+			const int inst = scr.order[l].second;
+			const Instance &in = instances[inst];
+			ikUpdateChainBoneTransforms(skeleton, chain, chain.length() - 2, in.rootPos, getBoneStates(inst));
+		}
+		timer.mark(IkPhaseTransforms);
+	}
+}
+
+// ===== Batch Test ==========================================================
+
+// sets up a batch's instances with a mix of chains: every effector of the skeleton in turn, rooted at bone 0,
+// at another effector, or three bones up (which makes a two-bone chain), each with a target of its own
+static void setUpTestInstances(const Skeleton &skel, IkBatch &batch)
+{
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	const int ne = (int)effectors.size();
+
+	batch.resize(ne * 6);
+	for (int k = 0; k < batch.numInstances(); ++k)
+	{
+		const Bone &eff = *effectors[k % ne];
+		const Bone *root = &skel[0];
+		if ((k % 3 == 1) && (ne > 1))
+			root = effectors[(k + 1) % ne];
+		else if (k % 3 == 2)
+		{
+			const Bone *up = &eff;
+			for (int j = 0; (j < 3) && up; ++j)
+				up = skel.getParent(*up);
+			if (up)
+				root = up;
+		}
+
+		batch.resetAll(k);
+		batch.setRootBone(k, *root);
+		batch.setEffector(k, eff);
+		batch.setTargetPos(k, testTarget(eff, k, 0.25));
+	}
+}
+
+// checks that every bone of a batch instance is in exactly the same place as a solver's
+static void checkSameBones(const Skeleton &skel, const IkBatch &batch, int inst, const IkSolver &solver)
+{
+	for (int i = 0; i < skel.numBones(); ++i)
+		assert(batch.getBoneToWorld(inst, skel[i]) == solver.getBoneToWorld(skel[i]));
+}
+
+// checks that every bone of every instance of two batches is in exactly the same place
+static void checkSameBatchPoses(const Skeleton &skel, const IkBatch &a, const IkBatch &b)
+{
+	for (int k = 0; k < a.numInstances(); ++k)
+	for (int i = 0; i < skel.numBones(); ++i)
+		assert(a.getBoneToWorld(k, skel[i]) == b.getBoneToWorld(k, skel[i]));
+}
+
+// a range of a batch's instances, solved on a thread of its own with a worker of its own
+struct TestRangeSolve
+{
+	IkBatch *batch;
+	int first;
+	int count;
+	int worker;
+	int maxIterations;
+};
+
+static void testRangeSolveThread(void *arg)
+{
+	const TestRangeSolve &r = *static_cast<TestRangeSolve*>(arg);
+	r.batch->solveIk(r.first, r.count, r.maxIterations, 0.001, r.worker);
+}
+
+void testBatchSolver(const Skeleton &skel)
+{
+	const IkAlgorithm algorithms[] = { IkCCD, IkFABRIK, IkJacobianTranspose, IkPseudoInverse, IkDampedLeastSquares };
+	const int numAlgorithms = sizeof(algorithms) / sizeof(algorithms[0]);
+	const int maxIterations = 20;
+
+	for (int a = 0; a < numAlgorithms; ++a)
+	{
+		IkBatch batch(skel);
+		batch.setAlgorithm(algorithms[a]);
+		setUpTestInstances(skel, batch);
+		batch.solveIk(maxIterations);
+
+		// every instance ends up exactly where a solver doing the same solve does
+		// (the instances' chains are solved in the same way, from the same start)
+		IkSolver solver(skel);
+		solver.setAlgorithm(algorithms[a]);
+		for (int k = 0; k < batch.numInstances(); ++k)
+		{
+			solver.resetAll();
+			solver.setRootBone(batch.getRootBone(k));
+			solver.setEffector(batch.getEffector(k));
+			solver.setTargetPos(batch.getTargetPos(k));
+			solver.solveIk(maxIterations);
+
+			assert(batch.getEffectorPos(k) == solver.getEffectorPos());
+			checkSameBones(skel, batch, k, solver);
+		}
+
+		// spread across a scheduler's workers, with grains small enough that the workers run out of
+		// their own shares and steal from each other, and large enough that some don't get any,
+		// the instances still end up exactly where they do on one thread
+		const int workerCounts[] = { 1, 2, 5 };
+		const int grainSizes[] = { 1, 3, 64 };
+		for (int w = 0; w < 3; ++w)
+		{
+			TaskScheduler scheduler(workerCounts[w]);
+			for (int g = 0; g < 3; ++g)
+			{
+				IkBatch spread(skel);
+				spread.setAlgorithm(algorithms[a]);
+				setUpTestInstances(skel, spread);
+				spread.solveIk(scheduler, maxIterations, 0.001, grainSizes[g]);
+				assert(spread.numWorkers() >= workerCounts[w]);
+				checkSameBatchPoses(skel, batch, spread);
+			}
+		}
+
+		// and so do ranges solved on threads of their own, each with its own worker
+		const int numThreads = 3;
+		IkBatch ranged(skel);
+		ranged.setAlgorithm(algorithms[a]);
+		setUpTestInstances(skel, ranged);
+		ranged.setNumWorkers(numThreads);
+
+		TestRangeSolve ranges[numThreads];
+		Thread threads[numThreads];
+		const int n = ranged.numInstances();
+		for (int t = 0; t < numThreads; ++t)
+		{
+			ranges[t].batch = &ranged;
+			ranges[t].first = n*t / numThreads;
+			ranges[t].count = n*(t + 1) / numThreads - ranges[t].first;
+			ranges[t].worker = t;
+			ranges[t].maxIterations = maxIterations;
+			threads[t].start(testRangeSolveThread, &ranges[t]);
+		}
+		for (int t = 0; t < numThreads; ++t)
+			threads[t].join();
+		checkSameBatchPoses(skel, batch, ranged);
+	}
+}
+
+// ===== Lockstep Test =======================================================
+
+// sets up a batch's instances for lockstep: each effector rooted at bone 0 has a group and a bit of lanes
+// (so most groups are partial), with a mix of targets within reach (which stop early, and are masked off), out of
+// reach (which keep going) and behind the effector's parent joint (which turns more than 90 degrees, and so falls
+// back to the scalar rotation); and each effector with three ancestors also has a pair of two-bone instances
+template <typename T>
+static void setUpLockstepInstances(const Skeleton &skel, IkBatchT<T> &batch, std::vector<bool> &twoBone)
+{
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	const int width = ikLaneWidth<T>();
+
+	batch.resize(0);
+	twoBone.clear();
+	for (int i = 0; i < (int)effectors.size(); ++i)
+	{
+		const Bone &eff = *effectors[i];
+		const Bone *parent = skel.getParent(eff);
+		for (int j = 0; j < width + 1 + i % width; ++j)
+		{
+			vec3d target;
+			if ((j % 3 == 2) && parent)
+				target = testTarget(*parent, j, 0.1) + (parent->worldPos - eff.worldPos);
+			else
+				target = testTarget(eff, j, (j % 3 == 1) ? 25.0 : 0.25);
+
+			const int k = batch.addInstance();
+			batch.setEffector(k, eff);
+			batch.setTargetPos(k, convertVec<T>(target));
+			twoBone.push_back(false);
+		}
+
+		const Bone *root = &eff;
+		for (int j = 0; (j < 3) && root; ++j)
+			root = skel.getParent(*root);
+		for (int j = 0; root && (j < 2); ++j)
+		{
+			const int k = batch.addInstance();
+			batch.setRootBone(k, *root);
+			batch.setEffector(k, eff);
+			batch.setTargetPos(k, convertVec<T>(testTarget(eff, j, 0.5)));
+			twoBone.push_back(true);
+		}
+	}
+}
+
+// (in float, the scalar solver's rotations are less accurate than the lanes' trig-free ones, so the two drift
+// apart as they go, and are only compared over the first few iterations)
+template <typename T>
+static void testLockstep(const Skeleton &skel, int maxIterations, double tolerance)
+{
+	for (int con = 0; con < 2; ++con)
+	{
+		IkBatchT<T> single(skel);
+		IkBatchT<T> lockstep(skel);
+		std::vector<bool> twoBone;
+		setUpLockstepInstances(skel, single, twoBone);
+		setUpLockstepInstances(skel, lockstep, twoBone);
+		single.enableConstraints(con != 0);
+		lockstep.enableConstraints(con != 0);
+		lockstep.enableLockstep();
+		single.enableStats();
+		lockstep.enableStats();
+
+		single.solveIk(maxIterations);
+		lockstep.solveIk(maxIterations);
+
+		double worst = 0.0;
+		for (int k = 0; k < single.numInstances(); ++k)
+		for (int i = 0; i < skel.numBones(); ++i)
+		{
+			const vmath::mat4<T> &a = single.getBoneToWorld(k, skel[i]);
+			const vmath::mat4<T> &b = lockstep.getBoneToWorld(k, skel[i]);
+			for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 3; ++r)
+			{
+				const double d = std::abs((double)a.elem[c][r] - (double)b.elem[c][r]);
+				worst = std::max(worst, d);
+				// the two-bone instances are taken out of the lanes, and solved exactly as they are on their own
+				if (twoBone[k])
+					assert(d == 0.0);
+			}
+		}
+		assert(worst < tolerance);
+
+		// and every lane stops when it would on its own (the lanes that stop early are masked off, rather
+		// than being carried along by the others)
+		const IkStats a = single.getStats();
+		const IkStats b = lockstep.getStats();
+		(void)a; (void)b;
+		assert(a.solves == b.solves);
+		assert(a.iterations == b.iterations);
+		for (int r = 0; r <= IkRanOut; ++r)
+			assert(a.stops[r] == b.stops[r]);
+	}
+}
+
+void testLockstepBatch(const Skeleton &skel)
+{
+	testLockstep<double>(skel, 30, 1e-6);
+	testLockstep<float>(skel, 5, 1e-2);
+}
+
+// ===== Explicit Instantiations =============================================
+
+template class IkBatchT<float>;
+template class IkBatchT<double>;
@@ -0,0 +1,218 @@
+#ifndef IK_BATCH_H
+#define IK_BATCH_H
+
+#include "Skeleton.h"
+#include "IkKernel.h"
+#include "IkLanes.h"
+#include "IkJacobian.h"
+#include "IkStats.h"
+
+class Skeleton;
+class Bone;
+class TaskScheduler;
+
+// An IkBatch solves many IK instances which share one skeleton
+// (eg, a crowd of characters all using the same rig)
+// Each instance has its own root, effector, target and pose, in the same
+// way as an IkSolver, but the instance records and the bone states for all
+// instances are held in contiguous arrays, and the IK chains are shared
+// between all instances that use the same root and effector.
+// Like the IkSolver, it's templated on the scalar type; use IkBatch or IkBatchf
+template <typename T>
+class IkBatchT : public RefCounted
+{
+public:
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat3<T> mat3t;
+	typedef vmath::mat4<T> mat4t;
+
+	explicit IkBatchT(const Skeleton &skel, int numInstances = 0);
+
+	const Skeleton &getSkeleton() const;
+
+	int numInstances() const;
+
+	// new instances start with the default root, effector and pose (see resetAll)
+	int addInstance();
+	void resize(int numInstances);
+
+	const vec3t &getTargetPos(int inst) const;
+	const Bone &getRootBone(int inst) const;
+	const Bone &getEffector(int inst) const;
+	vec3t getEffectorPos(int inst) const;
+	const vec3t &getRootPos(int inst) const;
+
+	const mat4t &getBoneToWorld(int inst, const Bone &b) const;
+	const mat3t &getBoneRotation(int inst, const Bone &b) const;
+
+	void setTargetPos(int inst, const vec3t &target);
+	void setRootBone(int inst, const Bone &bone);
+	void setEffector(int inst, const Bone &bone);
+
+	// constraints are enabled or disabled for the whole batch
+	bool areConstraintsEnabled() const;
+	void enableConstraints(bool enabled = true);
+
+	// quaternion CCD is enabled or disabled for the whole batch (see IkSolver::enableQuaternions)
+	// it only applies outside lockstep mode, which has its own trig-free rotations
+	bool areQuaternionsEnabled() const;
+	void enableQuaternions(bool enabled = true);
+
+	// the two-bone fast path is enabled or disabled for the whole batch (see IkSolver::enableTwoBone)
+	// in lockstep mode, two-bone instances are taken out of the lanes and solved on their own
+	bool isTwoBoneEnabled() const;
+	void enableTwoBone(bool enabled = true);
+
+	// the algorithm is chosen for the whole batch (see IkSolver::setAlgorithm)
+	// lockstep mode only implements CCD, so other algorithms solve each instance on its own
+	IkAlgorithm getAlgorithm() const;
+	void setAlgorithm(IkAlgorithm algorithm);
+
+	// the damping for the Jacobian methods, for the whole batch (see IkSolver::setDamping)
+	T getDamping() const;
+	void setDamping(T damping);
+
+	// the stall rate for the whole batch (see IkSolver::setStallRate); lockstep lanes stop in the same way
+	T getStallRate() const;
+	void setStallRate(T rate);
+
+	// in lockstep mode, instances that share a chain are solved several at a time,
+	// one per SIMD lane (see IkLanes.h); the results are very close to,
+	// but not bit-identical with, solving each instance on its own
+	bool isLockstepEnabled() const;
+	void enableLockstep(bool enabled = true);
+
+	// statistics for the whole batch (see IkSolver::enableStats); each thread gathers its own, and getStats
+	// adds them up (in lockstep mode, each lane is a solve of its own; in solveIkWithin, each round is)
+	bool areStatsEnabled() const;
+	void enableStats(bool enabled = true);
+	IkStats getStats() const;
+	void resetStats();
+
+	// resets the root bone, effector and target position of an instance
+	void resetAll(int inst);
+
+	// resets the pose of an instance to be the neutral (skeleton-default) pose
+	void resetPose(int inst);
+
+	// the solves' working space is kept per worker, and each thread solving at once needs a worker of its own;
+	// there's one to begin with, and solving through a TaskScheduler adds as many as it has workers
+	// (changing the number of workers mustn't overlap with any solve)
+	int numWorkers() const;
+	void setNumWorkers(int numWorkers);
+
+	// try to completely solve every instance for its current target
+	void solveIk(int maxIterations, T threshold = T(0.001));
+
+	// try to completely solve instances [first, first + count), with the given worker's working space
+	// different ranges can be solved independently (eg, on different threads), as long as each thread
+	// uses a different worker
+	void solveIk(int first, int count, int maxIterations, T threshold = T(0.001), int worker = 0);
+
+	// try to completely solve every instance, spreading the instances across the scheduler's workers
+	// instances are handed out 'grainSize' at a time
+	// (in lockstep mode, the grain size is rounded up to a whole number of lane groups)
+	void solveIk(TaskScheduler &scheduler, int maxIterations, T threshold = T(0.001), int grainSize = 16);
+
+	// try to solve every instance within a time budget (in seconds): the instances are taken a few iterations
+	// at a time, round after round, and each one drops out as soon as it stops (see IkConvergenceT), so the time
+	// goes to the instances that still need it, rather than to whichever come first (instances stuck against
+	// their constraints only drop out early with a stall rate set, see setStallRate)
+	// no instance is given more than maxIterations in all, and lockstep mode doesn't apply
+	// returns the number of instances that were still going when the time (or the iterations) ran out
+	int solveIkWithin(double seconds, int maxIterations, T threshold = T(0.001));
+
+	// the same, for instances [first, first + count), with the given worker's working space
+	// (so, as for solveIk, different ranges can be solved at once by threads with different workers)
+	int solveIkWithin(int first, int count, double seconds, int maxIterations, T threshold = T(0.001), int worker = 0);
+
+	// perform one iteration for every instance
+	void iterateIk();
+
+private:
+	typedef IkBoneStateT<T> BoneState;
+
+	struct Instance
+	{
+		int rootId;
+		int effectorId;
+		int chainIdx;
+
+		vec3t targetPos;
+		vec3t rootPos;
+	};
+
+	// an IkBatch is linked at construction with a skeleton
+	// and cannot be switched to a different skeleton
+	const Skeleton &skeleton;
+	const int bonesPerInstance;
+
+	std::vector<Instance> instances;
+
+	// bone states for instance i are at [i*bonesPerInstance, (i+1)*bonesPerInstance)
+	std::vector<BoneState> boneStates;
+
+	// chains are looked up (and built if necessary) when the root or effector is set
+	// so that solving never modifies anything shared between instances
+	std::vector< IkChainT<T> > chains;
+	std::map<std::pair<int, int>, int> chainLookup;
+
+	bool mApplyConstraints;
+	bool mQuaternions;
+	bool mTwoBone;
+	IkAlgorithm mAlgorithm;
+	T mDamping;
+	T mStallRate;
+	bool mLockstep;
+	bool mStats;
+
+	// working space for one thread
+	struct Scratch
+	{
+		IkChainStateT<T> chain;
+		IkJacobianStateT<T> jacobian;
+		IkLaneStateT<T> lanes;
+		IkStats stats;
+
+		// the instances that are still going, for solveIkWithin
+		std::vector<int> pending;
+
+		// (chain, instance) pairs, for grouping the instances in a range by chain
+		std::vector< std::pair<int, int> > order;
+
+		// the instances in the current group of lanes
+		std::vector<BoneState*> laneStates;
+		std::vector<vec3t> laneTargets;
+		std::vector<vec3t> laneRootPositions;
+	};
+
+	// one per worker (see setNumWorkers)
+	std::vector<Scratch> scratch;
+
+	BoneState *getBoneStates(int inst);
+	const BoneState *getBoneStates(int inst) const;
+
+	int findChain(int rootId, int effectorId);
+	void solveRange(int first, int count, int maxIterations, T threshold, Scratch &scr);
+	bool solveInstance(int inst, int maxIterations, T threshold, Scratch &scr);
+	void solveLockstep(int first, int count, int maxIterations, T threshold, Scratch &scr);
+
+	class SolveTask;
+	friend class SolveTask;
+};
+
+typedef IkBatchT<double> IkBatch;
+typedef IkBatchT<float> IkBatchf;
+
+// solves instances with a mix of roots and effectors (including two-bone chains) with each algorithm,
+// and checks that every instance ends up exactly where an IkSolver doing the same solve does; and solves them
+// again through task schedulers with different numbers of workers and grain sizes, and in ranges on threads
+// of their own, and checks that they end up exactly where they do on one thread
+void testBatchSolver(const Skeleton &skel);
+
+// solves a mix of instances (partial groups of lanes, lanes that stop early, lanes that turn more than 90 degrees,
+// and two-bone instances) in lockstep and one at a time, in float and double, with and without constraints,
+// and checks that they end up within rounding of each other, and stop after the same number of iterations
+void testLockstepBatch(const Skeleton &skel);
+
+#endif
@@ -0,0 +1,360 @@
+#include "CoreGlobal.h"
+#include "IkJacobian.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+#include "SimdLanes.h"
+
+// ===== Small Dense Kernels =================================================
+
+// the rows are streamed through a lane group at a time, with a scalar tail
+
+template <typename T>
+static T sumLanes(const typename SimdLanes<T>::reg &a)
+{
+	typedef SimdLanes<T> L;
+	T lanes[L::Width];
+	L::store(lanes, a);
+	T sum = lanes[0];
+	for (int l = 1; l < L::Width; ++l)
+		sum += lanes[l];
+	return sum;
+}
+
+template <typename T>
+void ikJacobianGram(const T *jx, const T *jy, const T *jz, int n, T *gram)
+{
+	typedef SimdLanes<T> L;
+	typedef typename L::reg reg;
+	const int W = L::Width;
+
+	reg xx = L::splat(T(0)), xy = xx, xz = xx, yy = xx, yz = xx, zz = xx;
+	int i = 0;
+	for (; i + W <= n; i += W)
+	{
+		const reg x = L::load(jx + i);
+		const reg y = L::load(jy + i);
+		const reg z = L::load(jz + i);
+		xx = L::add(xx, L::mul(x, x));
+		xy = L::add(xy, L::mul(x, y));
+		xz = L::add(xz, L::mul(x, z));
+		yy = L::add(yy, L::mul(y, y));
+		yz = L::add(yz, L::mul(y, z));
+		zz = L::add(zz, L::mul(z, z));
+	}
+
+	gram[0] = sumLanes<T>(xx);
+	gram[1] = sumLanes<T>(xy);
+	gram[2] = sumLanes<T>(xz);
+	gram[3] = sumLanes<T>(yy);
+	gram[4] = sumLanes<T>(yz);
+	gram[5] = sumLanes<T>(zz);
+
+	for (; i < n; ++i)
+	{
+		gram[0] += jx[i]*jx[i];
+		gram[1] += jx[i]*jy[i];
+		gram[2] += jx[i]*jz[i];
+		gram[3] += jy[i]*jy[i];
+		gram[4] += jy[i]*jz[i];
+		gram[5] += jz[i]*jz[i];
+	}
+}
+
+template <typename T>
+void ikJacobianTransposeMul(const T *jx, const T *jy, const T *jz, int n, const vmath::vec3<T> &v, T *result)
+{
+	typedef SimdLanes<T> L;
+	typedef typename L::reg reg;
+	const int W = L::Width;
+
+	const reg vx = L::splat(v.x);
+	const reg vy = L::splat(v.y);
+	const reg vz = L::splat(v.z);
+	int i = 0;
+	for (; i + W <= n; i += W)
+	{
+		const reg r = L::add(L::add(L::mul(L::load(jx + i), vx), L::mul(L::load(jy + i), vy)), L::mul(L::load(jz + i), vz));
+		L::store(result + i, r);
+	}
+
+	for (; i < n; ++i)
+		result[i] = jx[i]*v.x + jy[i]*v.y + jz[i]*v.z;
+}
+
+template <typename T>
+bool ikSolveSymmetric3(const T *a, T lambdaSqr, const vmath::vec3<T> &b, vmath::vec3<T> &x)
+{
+	// LDL^T factorisation (no square roots); the matrix is positive semi-definite,
+	// so a pivot that's tiny compared to the matrix means it's (near) singular
+	const T a00 = a[0] + lambdaSqr, a01 = a[1], a02 = a[2];
+	const T a11 = a[3] + lambdaSqr, a12 = a[4];
+	const T a22 = a[5] + lambdaSqr;
+	const T tolerance = (a00 + a11 + a22) * (T(64) * std::numeric_limits<T>::epsilon());
+
+	const T d0 = a00;
+	if (!(d0 > tolerance)) return false;
+	const T l10 = a01 / d0;
+	const T l20 = a02 / d0;
+
+	const T d1 = a11 - l10*a01;
+	if (!(d1 > tolerance)) return false;
+	const T l21 = (a12 - l20*a01) / d1;
+
+	const T d2 = a22 - l20*a02 - l21*l21*d1;
+	if (!(d2 > tolerance)) return false;
+
+	// forward substitution, scale, back substitution
+	const T y0 = b.x;
+	const T y1 = b.y - l10*y0;
+	const T y2 = b.z - l20*y0 - l21*y1;
+
+	x.z = y2 / d2;
+	x.y = y1 / d1 - l21*x.z;
+	x.x = y0 / d0 - l10*x.y - l20*x.z;
+	return true;
+}
+
+// ===== Degrees of Freedom ==================================================
+
+// appends the degrees of freedom of chain joint i (see IkJacobian.h)
+template <typename T>
+static void addJointDofs(const IkChainT<T> &chain, const IkChainStateT<T> &cs, int i, bool applyConstraints, IkJacobianStateT<T> &js)
+{
+	typedef vmath::vec3<T> vec3t;
+
+	// the constraints apply to the rotation of the skeleton's child bone, relative to its parent;
+	// if the chain runs the other way at this joint, that's the next bone along
+	const vmath::mat3<T> &childRot = cs.worldRot[(chain.reversed[i] != 0) ? i + 1 : i];
+
+	bool swing = true, twist = true;
+	if (applyConstraints)
+	{
+		// a hinge only changes its elevation
+		vec3t axis;
+		if (ikHingeAxis(chain, cs, i, axis))
+		{
+			js.axes.push_back(axis);
+			js.joints.push_back(i);
+			return;
+		}
+
+		const JointConstraints &cnst = *chain.constraints[i];
+		const bool azFixed = (cnst.minAzimuth == cnst.maxAzimuth);
+		const bool elFixed = (cnst.minElevation == cnst.maxElevation);
+		const bool twistFixed = (cnst.minTwist == cnst.maxTwist);
+
+		swing = !(azFixed && elFixed);
+		twist = !twistFixed;
+	}
+
+	if (swing)
+	{
+		js.axes.push_back(childRot * vec3t(T(1), T(0), T(0)));
+		js.joints.push_back(i);
+		js.axes.push_back(childRot * vec3t(T(0), T(0), T(1)));
+		js.joints.push_back(i);
+	}
+	if (twist)
+	{
+		js.axes.push_back(childRot * vec3t(T(0), T(1), T(0)));
+		js.joints.push_back(i);
+	}
+}
+
+// ===== Jacobian Step =======================================================
+
+template <typename T>
+void ikStepJacobian(
+	IkAlgorithm method, const IkChainT<T> &chain, IkChainStateT<T> &cs, IkJacobianStateT<T> &js,
+	const vmath::vec3<T> &target, T damping, bool applyConstraints)
+{
+	typedef vmath::vec3<T> vec3t;
+
+	const int n = chain.length();
+	assert(n > 0);
+
+	// as in CCD, the effector and root bones are never rotated
+	if (n < 3)
+		return;
+
+	const vec3t tip = cs.worldPos[0];
+
+	// the degrees of freedom, and the Jacobian (the effect on the tip of turning each joint about each axis)
+	js.axes.clear();
+	js.joints.clear();
+	for (int i = 1; i < n - 1; ++i)
+		addJointDofs(chain, cs, i, applyConstraints, js);
+
+	const int m = (int)js.axes.size();
+	if (m == 0)
+		return;
+
+	js.jx.resize(m);
+	js.jy.resize(m);
+	js.jz.resize(m);
+	js.delta.resize(m);
+
+	// the joint positions (in the FABRIK scratch space, which isn't in use)
+	cs.points.resize(n - 1);
+	T reach = T(0);
+	for (int i = 1; i < n - 1; ++i)
+	{
+		cs.points[i] = cs.worldRot[i] * chain.jointPos[i] + cs.worldPos[i];
+		reach += length(((i > 1) ? cs.points[i - 1] : tip) - cs.points[i]);
+	}
+
+	for (int k = 0; k < m; ++k)
+	{
+		const vec3t col = cross(js.axes[k], tip - cs.points[js.joints[k]]);
+		js.jx[k] = col.x;
+		js.jy[k] = col.y;
+		js.jz[k] = col.z;
+	}
+
+	// the Jacobian is only good for small changes, so don't try to cover more than one bone's length in a step
+	vec3t error = target - tip;
+	const T maxStep = reach / T(n - 2);
+	const T errorSqr = dot(error, error);
+	if (errorSqr > maxStep*maxStep)
+		error *= maxStep * vmath::rsqrt(errorSqr);
+
+	T gram[6];
+	ikJacobianGram(&js.jx[0], &js.jy[0], &js.jz[0], m, gram);
+
+	if (method == IkJacobianTranspose)
+	{
+		// delta = alpha J^T e, with alpha chosen to get as close to e as possible along J J^T e
+		const vec3t jjte(
+			gram[0]*error.x + gram[1]*error.y + gram[2]*error.z,
+			gram[1]*error.x + gram[3]*error.y + gram[4]*error.z,
+			gram[2]*error.x + gram[4]*error.y + gram[5]*error.z);
+		const T denom = dot(jjte, jjte);
+		if (!(denom > T(0)))
+			return;
+		ikJacobianTransposeMul(&js.jx[0], &js.jy[0], &js.jz[0], m, error * (dot(error, jjte) / denom), &js.delta[0]);
+	}
+	else
+	{
+		// delta = J^T (J J^T + lambda^2 I)^-1 e, with lambda = 0 for the pseudo-inverse
+		// (which falls back to damping if J J^T is singular, eg, when the chain is straight)
+		const T lambdaSqr = damping*damping;
+		vec3t y;
+		if ((method == IkDampedLeastSquares) || !ikSolveSymmetric3(gram, T(0), error, y))
+		{
+			if (!ikSolveSymmetric3(gram, lambdaSqr, error, y))
+				return;
+		}
+		ikJacobianTransposeMul(&js.jx[0], &js.jy[0], &js.jz[0], m, y, &js.delta[0]);
+	}
+
+	if (applyConstraints)
+		js.savedRot.assign(cs.rot.begin(), cs.rot.end());
+
+	// turn each joint by the combination of its degrees of freedom
+	for (int k = 0; k < m; )
+	{
+		const int i = js.joints[k];
+		vec3t w(T(0), T(0), T(0));
+		for (; (k < m) && (js.joints[k] == i); ++k)
+			w += js.axes[k] * js.delta[k];
+
+		// into the bone's space (v * worldRot is transpose(worldRot) * v)
+		const vec3t wB = w * cs.worldRot[i];
+		const T angle = length(wB);
+		if (!(angle > T(0)))
+			continue;
+
+		vmath::mat3<T> &boneRot = cs.rot[i];
+		boneRot = boneRot * vmath::rotation_matrix3(angle, wB);
+		if (applyConstraints)
+			ikConstrainJoint(*chain.constraints[i], chain.reversed[i] != 0, boneRot, cs.stats);
+	}
+
+	// if the constraints have stopped the step from making progress, fall back to CCD (see IkJacobian.h)
+	if (applyConstraints)
+	{
+		const vec3t rootPos = cs.worldPos[n - 1];
+		ikUpdateChainTransforms(chain, rootPos, cs);
+		if (length_squared(cs.worldPos[0] - target) >= length_squared(tip - target))
+		{
+			std::copy(js.savedRot.begin(), js.savedRot.end(), cs.rot.begin());
+			ikUpdateChainTransforms(chain, rootPos, cs);
+			ikStepCCD(chain, cs, target, applyConstraints);
+		}
+	}
+}
+
+// ===== Kernel Test =========================================================
+
+void testJacobianKernels()
+{
+	// sizes either side of every lane width, so the tails are exercised
+	for (int n = 1; n <= 19; ++n)
+	{
+		std::vector<double> jx(n), jy(n), jz(n), result(n);
+		for (int i = 0; i < n; ++i)
+		{
+			jx[i] = std::sin(i*1.3 + n);
+			jy[i] = std::cos(i*0.7 - n);
+			jz[i] = std::sin(i*2.9 + 0.5);
+		}
+
+		double gram[6];
+		ikJacobianGram(&jx[0], &jy[0], &jz[0], n, gram);
+
+		double expected[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+		for (int i = 0; i < n; ++i)
+		{
+			expected[0] += jx[i]*jx[i];
+			expected[1] += jx[i]*jy[i];
+			expected[2] += jx[i]*jz[i];
+			expected[3] += jy[i]*jy[i];
+			expected[4] += jy[i]*jz[i];
+			expected[5] += jz[i]*jz[i];
+		}
+		for (int e = 0; e < 6; ++e)
+			assert(abs(gram[e] - expected[e]) < 0.0000001);
+
+		const vec3d v(0.3, -1.2, 0.8);
+		ikJacobianTransposeMul(&jx[0], &jy[0], &jz[0], n, v, &result[0]);
+		for (int i = 0; i < n; ++i)
+			assert(abs(result[i] - (jx[i]*v.x + jy[i]*v.y + jz[i]*v.z)) < 0.0000001);
+
+		// the solve should give back b when its result is multiplied out again
+		const double lambdaSqr = 0.01;
+		const vec3d b(1.0, -0.5, 2.0);
+		vec3d x(0.0, 0.0, 0.0);
+		const bool solved = ikSolveSymmetric3(gram, lambdaSqr, b, x);
+		assert(solved);
+		if (solved)
+		{
+			const vec3d Ax(
+				(gram[0] + lambdaSqr)*x.x + gram[1]*x.y + gram[2]*x.z,
+				gram[1]*x.x + (gram[3] + lambdaSqr)*x.y + gram[4]*x.z,
+				gram[2]*x.x + gram[4]*x.y + (gram[5] + lambdaSqr)*x.z);
+			assert(length(Ax - b) < 0.000001);
+		}
+	}
+
+	// a rank-deficient matrix is rejected without damping
+	const double singular[6] = { 1.0, 2.0, 0.0, 4.0, 0.0, 0.0 };
+	vec3d x;
+	(void)singular;
+	assert(!ikSolveSymmetric3(singular, 0.0, vec3d(1.0, 1.0, 1.0), x));
+	assert(ikSolveSymmetric3(singular, 0.1, vec3d(1.0, 1.0, 1.0), x));
+}
+
+// ===== Explicit Instantiations =============================================
+
+#define INSTANTIATE_IK_JACOBIAN(T) \
+	template void ikJacobianGram(const T *jx, const T *jy, const T *jz, int n, T *gram); \
+	template void ikJacobianTransposeMul(const T *jx, const T *jy, const T *jz, int n, const vmath::vec3<T> &v, T *result); \
+	template bool ikSolveSymmetric3(const T *a, T lambdaSqr, const vmath::vec3<T> &b, vmath::vec3<T> &x); \
+	template void ikStepJacobian( \
+		IkAlgorithm method, const IkChainT<T> &chain, IkChainStateT<T> &cs, IkJacobianStateT<T> &js, \
+		const vmath::vec3<T> &target, T damping, bool applyConstraints);
+
+INSTANTIATE_IK_JACOBIAN(float)
+INSTANTIATE_IK_JACOBIAN(double)
+
+#undef INSTANTIATE_IK_JACOBIAN
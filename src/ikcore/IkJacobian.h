@@ -0,0 +1,71 @@
+#ifndef IK_JACOBIAN_H
+#define IK_JACOBIAN_H
+
+#include "IkKernel.h"
+
+// Jacobian IK: each step linearises the effector position around the current pose, as
+// a 3xN Jacobian over the chain's degrees of freedom, and solves for the change in each
+// one (by the Jacobian transpose, the pseudo-inverse, or damped least squares).
+// The degrees of freedom come from the az/el/twist form of each joint's constraints:
+// a joint whose azimuth and twist are both fixed is a hinge, with a single axis (its elevation axis);
+// one whose azimuth and elevation are both fixed only twists; a fixed joint has none;
+// anything else can swing about the two axes across the bone, and twist unless its twist is fixed.
+// The rotations are constrained afterwards in the same way as in CCD. The linearisation knows nothing
+// about the limits, so a constrained step can make things worse; when it does, it's undone, and a CCD
+// sweep is done instead (in the same way as for FABRIK).
+// Everything is templated on the scalar type, and instantiated for float and double in IkJacobian.cpp.
+
+// scratch space for a Jacobian step, in the order of the degrees of freedom
+// (the arrays only grow, so once they're big enough for a chain, solving doesn't allocate)
+template <typename T>
+struct IkJacobianStateT
+{
+	// the world-space axis of each degree of freedom, and the chain index of its joint
+	std::vector< vmath::vec3<T> > axes;
+	std::vector<int> joints;
+
+	// the Jacobian, one row per array, so each row can be streamed through in SIMD lanes
+	std::vector<T> jx, jy, jz;
+
+	// the change in each degree of freedom
+	std::vector<T> delta;
+
+	// the chain's rotations before the step, in case it has to be undone
+	std::vector< vmath::mat3<T> > savedRot;
+};
+
+typedef IkJacobianStateT<double> IkJacobianState;
+typedef IkJacobianStateT<float> IkJacobianStatef;
+
+// ----- small dense kernels -----
+// (the rows of a 3xN Jacobian are given as three arrays of N values)
+
+// J J^T, as the six distinct elements of the symmetric result: xx, xy, xz, yy, yz, zz
+template <typename T>
+void ikJacobianGram(const T *jx, const T *jy, const T *jz, int n, T *gram);
+
+// J^T v (N results)
+template <typename T>
+void ikJacobianTransposeMul(const T *jx, const T *jy, const T *jz, int n, const vmath::vec3<T> &v, T *result);
+
+// solves (A + lambdaSqr I) x = b for a symmetric 3x3 A, given in the same form as ikJacobianGram
+// returns false (leaving x unchanged) if the matrix is singular, or too close to it
+template <typename T>
+bool ikSolveSymmetric3(const T *a, T lambdaSqr, const vmath::vec3<T> &b, vmath::vec3<T> &x);
+
+// ----- solving -----
+
+// performs one Jacobian step along a chain, with the given method (one of the Jacobian IkAlgorithms)
+// damping is the damped least squares lambda (in the skeleton's length units, although the error
+// that's solved for is never more than one bone's length); the pseudo-inverse also falls back to it
+// where the chain is singular
+// the world transforms in the working set are left stale (see ikUpdateChainTransforms)
+template <typename T>
+void ikStepJacobian(
+	IkAlgorithm method, const IkChainT<T> &chain, IkChainStateT<T> &cs, IkJacobianStateT<T> &js,
+	const vmath::vec3<T> &target, T damping, bool applyConstraints);
+
+// checks the SIMD kernels against straightforward versions
+void testJacobianKernels();
+
+#endif
@@ -0,0 +1,1177 @@
+#include "CoreGlobal.h"
+#include "IkKernel.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+#include "IkStats.h"
+
+// ===== Utility Joint Constraint Application function =======================
+
+// The constraints are applied without any trig: every angle is held as a point
+// on the unit circle, and angles are compared with cross products.
+// A rotation is split into a swing (which sets the bone's direction; its axis
+// gives the azimuth and its angle the elevation) and a twist about the bone's Y axis.
+// These are the same az/el/twist angles as rotationToAzimuthElevationTwist gives,
+// and the clamping matches the angle-based version (see testJointConstraints).
+
+template <typename T>
+struct CircleAngle
+{
+	CircleAngle() {}
+	CircleAngle(T c, T s, int turns = 0): c(c), s(s), turns(turns) {}
+	explicit CircleAngle(const JointConstraints::AngleLimit &lim): c(T(lim.c)), s(T(lim.s)), turns(lim.turns) {}
+
+	// cos & sin, plus whole turns
+	T c, s;
+	int turns;
+};
+
+// true if a < b
+template <typename T>
+static bool angleLess(const CircleAngle<T> &a, const CircleAngle<T> &b)
+{
+	if (a.turns != b.turns)
+		return a.turns < b.turns;
+
+	// (-pi, 0) comes before [0, pi]
+	const bool aLower = (a.s < T(0));
+	const bool bLower = (b.s < T(0));
+	if (aLower != bLower)
+		return aLower;
+
+	// within each half of the circle, the cross product gives the order
+	// (it's zero for 0 and pi)
+	const T cr = a.c*b.s - a.s*b.c;
+	if (cr != T(0))
+		return cr > T(0);
+	return a.c > b.c;
+}
+
+template <typename T>
+static CircleAngle<T> clampAngle(const CircleAngle<T> &a, const JointConstraints::AngleLimit *limits)
+{
+	const CircleAngle<T> minA(limits[0]);
+	const CircleAngle<T> maxA(limits[1]);
+	if (angleLess(a, minA))
+		return minA;
+	if (angleLess(maxA, a))
+		return maxA;
+	return a;
+}
+
+// cos & sin of half an angle in -pi..pi
+// (1 + cos(a), sin(a)) is (cos(a/2), sin(a/2)) * 2cos(a/2)
+template <typename T>
+static void halfAngle(const CircleAngle<T> &a, T &c, T &s)
+{
+	const T x = T(1) + a.c;
+	const T lenSqr = x*x + a.s*a.s;
+	if (lenSqr > T(0))
+	{
+		const T r = vmath::rsqrt(lenSqr);
+		c = x * r;
+		s = a.s * r;
+	}
+	else
+	{
+		// half a turn
+		c = T(0);
+		s = T(1);
+	}
+}
+
+template <typename T>
+vmath::quat<T> constrainRotQuat(const JointConstraints &cnst, const vmath::quat<T> &rot)
+{
+	typedef CircleAngle<T> Angle;
+
+	// q and -q are the same rotation; pick the one with w >= 0, so the swing angle is in 0..pi
+	const vmath::quat<T> q = (rot.w < T(0)) ? vmath::quat<T>(-rot.v, -rot.w) : rot;
+
+	// q = swing * twist, where the twist is the Y part of q, and swing = q * conjugate(twist)
+	// (see quatToAzimuthElevationTwist)
+	T ty = q.v.y;
+	T tw = q.w;
+	vmath::quat<T> swing;
+	const T twistLenSqr = ty*ty + tw*tw;
+	if (twistLenSqr > T(0))
+	{
+		const T r = vmath::rsqrt(twistLenSqr);
+		ty *= r;
+		tw *= r;
+		swing = vmath::quat<T>(q.v.x*tw + q.v.z*ty, T(0), q.v.z*tw - q.v.x*ty, q.w*tw + q.v.y*ty);
+	}
+	else
+	{
+		// the swing is a half turn, so the twist is arbitrary
+		ty = T(0);
+		tw = T(1);
+		swing = q;
+	}
+
+	// the bone's direction (the swing applied to Y)
+	const T sinHalfElSqr = swing.v.x*swing.v.x + swing.v.z*swing.v.z;
+	const vmath::vec3<T> dir(
+		T(-2) * swing.w * swing.v.z,
+		T(1) - T(2) * sinHalfElSqr,
+		T(2) * swing.w * swing.v.x);
+
+	// the swing axis is (cos(az), 0, -sin(az)) sin(el/2)
+	Angle az(T(1), T(0));
+	if (sinHalfElSqr > T(0))
+	{
+		const T r = vmath::rsqrt(sinHalfElSqr);
+		az = Angle(swing.v.x * r, -swing.v.z * r);
+	}
+
+	// the twist is measured relative to the azimuth: it's the total twist about Y, minus the azimuth
+	// so it can be anywhere in -2pi..2pi; keep track of the whole turns
+	const Angle total(tw*tw - ty*ty, T(2)*ty*tw);
+	Angle twist(total.c*az.c + total.s*az.s, total.s*az.c - total.c*az.s);
+	if (!angleLess(total, az))
+		twist.turns = (twist.s < T(0)) ? 1 : 0;
+	else
+		twist.turns = (twist.s < T(0)) ? 0 : -1;
+
+	// clamp the azimuth
+	az = clampAngle(az, cnst.azimuthLimits);
+
+	// if the elevation can be varied at all, then work out the optimal elevation given the selected azimuth, and clamp it into range
+	Angle el;
+	if (cnst.minElevation != cnst.maxElevation)
+	{
+		const Angle minEl(cnst.elevationLimits[0]);
+		const Angle maxEl(cnst.elevationLimits[1]);
+
+		// the direction, within the plane of the azimuth
+		const T K = dir.z*az.c + dir.x*az.s;
+		const T lenSqr = K*K + dir.y*dir.y;
+		if (lenSqr > T(0))
+		{
+			const T r = vmath::rsqrt(lenSqr);
+			el = Angle(dir.y * r, K * r);
+		}
+		else
+			el = Angle(T(1), T(0));
+
+		if (angleLess(el, minEl) || angleLess(maxEl, el))
+		{
+			T dotMin = K*minEl.s + dir.y*minEl.c;
+			T dotMax = K*maxEl.s + dir.y*maxEl.c;
+			if (dotMin < dotMax)
+				el = maxEl;
+			else
+				el = minEl;
+		}
+	}
+	else
+		el = Angle(cnst.elevationLimits[0]);
+
+	// clamp the twist
+	twist = clampAngle(twist, cnst.twistLimits);
+
+	// and rebuild the rotation (see quatFromAzElTwist)
+	const Angle newTotal(twist.c*az.c - twist.s*az.s, twist.s*az.c + twist.c*az.s);
+	T cosHalfEl, sinHalfEl, cosHalfTwist, sinHalfTwist;
+	halfAngle(el, cosHalfEl, sinHalfEl);
+	halfAngle(newTotal, cosHalfTwist, sinHalfTwist);
+
+	const vmath::quat<T> newSwing(az.c * sinHalfEl, T(0), -az.s * sinHalfEl, cosHalfEl);
+	const vmath::quat<T> newTwist(T(0), sinHalfTwist, T(0), cosHalfTwist);
+	return newSwing * newTwist;
+}
+
+template <typename T>
+vmath::mat3<T> constrainRot(const JointConstraints &cnst, const vmath::mat3<T> &rot)
+{
+	return vmath::quat_to_mat3(constrainRotQuat(cnst, normalize(vmath::mat_to_quat(rot))));
+}
+
+template <typename T>
+bool ikConstrainJoint(const JointConstraints &cnst, bool reversed, vmath::mat3<T> &rot, IkStats *stats)
+{
+	const double start = stats ? monotonicSeconds() : 0.0;
+	const vmath::mat3<T> oldRot = rot;
+	if (!reversed)
+		rot = constrainRot(cnst, rot);
+	else
+		rot = transpose(constrainRot(cnst, transpose(rot)));
+
+	// (constrainRot rebuilds the rotation even when it's in range, so allow for rounding)
+	bool changed = false;
+	for (int c = 0; c < 3; ++c)
+	for (int r = 0; r < 3; ++r)
+		changed = changed || (abs(rot.elem[c][r] - oldRot.elem[c][r]) > T(0.0001));
+
+	if (stats)
+	{
+		stats->seconds[IkPhaseConstrain] += monotonicSeconds() - start;
+		++stats->entries[IkPhaseConstrain];
+		stats->clamps += changed;
+	}
+	return changed;
+}
+
+template <typename T>
+bool ikConstrainJointQuat(const JointConstraints &cnst, bool reversed, vmath::quat<T> &rot, IkStats *stats)
+{
+	// see ikConstrainJoint
+	const double start = stats ? monotonicSeconds() : 0.0;
+	const vmath::quat<T> oldRot = rot;
+	if (!reversed)
+		rot = constrainRotQuat(cnst, rot);
+	else
+		rot = conjugate(constrainRotQuat(cnst, conjugate(rot)));
+
+	// (q and -q are the same rotation)
+	const T d = abs(dot(rot.v, oldRot.v) + rot.w*oldRot.w);
+	const bool changed = (d < T(1) - T(0.00000001));
+
+	if (stats)
+	{
+		stats->seconds[IkPhaseConstrain] += monotonicSeconds() - start;
+		++stats->entries[IkPhaseConstrain];
+		stats->clamps += changed;
+	}
+	return changed;
+}
+
+// ===== Pose Management =====================================================
+
+template <typename T>
+static void resetBoneRot(const Skeleton &skel, const Bone *parent, const Bone &b, IkBoneStateT<T> *states)
+{
+	IkBoneStateT<T> &bs = states[b.id];
+	if (parent != 0)
+		bs.rot = convertMat<T>(transpose(parent->defaultOrient) * b.defaultOrient);
+	else
+		bs.rot = convertMat<T>(b.defaultOrient);
+
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone &bn = skel[bj[i].to];
+		if (&bn != parent)
+			resetBoneRot(skel, &b, bn, states);
+	}
+}
+
+template <typename T>
+void ikResetPose(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states)
+{
+	for (int i = 0; i < (int)skel.numBones(); ++i)
+	{
+		const Bone &b = skel[i];
+		states[i].boneToWorld = vmath::translation_matrix(convertVec<T>(b.worldPos)) * vmath::mat4<T>(convertMat<T>(b.defaultOrient));
+	}
+
+	resetBoneRot(skel, 0, root, states);
+}
+
+template <typename T>
+void ikChangeRoot(const Skeleton &skel, const Bone &oldRoot, const Bone &newRoot, IkBoneStateT<T> *states)
+{
+	// form a chain between the old root and the new root
+	std::vector<const Bone*> chain;
+	skel.findPath(newRoot, oldRoot, chain);
+
+	// rebuild the rotation values along the chain
+	// this is required because the rotation values are specified relative to the parent bone,
+	// and the parent bone is dependent on which bone is root
+	std::vector<const Bone*>::const_iterator it = chain.begin();
+	while (it != chain.end())
+	{
+		const Bone &b = **it;
+		IkBoneStateT<T> &bs = states[b.id];
+		
+		++it;
+		if (it != chain.end())
+		{
+			const Bone &nb = **it;
+			IkBoneStateT<T> &nbs = states[nb.id];
+			bs.rot = transpose(nbs.rot);
+		}
+		else
+			bs.rot = minor(bs.boneToWorld);
+	}
+}
+
+// ===== Forward Kinematics ==================================================
+
+// recalculates a single bone's transform; base is the transform of the joint to its parent
+template <typename T>
+static void updateBoneTransform(const Skeleton &skel, const Bone *parent, const Bone &b, const vmath::mat4<T> &base, IkBoneStateT<T> *states)
+{
+	IkBoneStateT<T> &bs = states[b.id];
+
+	if (parent == 0)
+		bs.boneToWorld = base * vmath::mat4<T>(bs.rot);
+	else
+	{
+		const Bone::Connection &c = skel.getJoint(b, *parent);
+		bs.boneToWorld = base * vmath::mat4<T>(bs.rot) * vmath::translation_matrix(convertVec<T>(-c.pos));
+	}
+}
+
+// recalculates the transforms of a bone and everything below it
+// (and clears their stale flags, if there are any)
+template <typename T>
+static void updateBoneTransforms(const Skeleton &skel, const Bone *parent, const Bone &b, const vmath::mat4<T> &base, IkBoneStateT<T> *states, char *stale)
+{
+	updateBoneTransform(skel, parent, b, base, states);
+	if (stale != 0)
+		stale[b.id] = 0;
+
+	const IkBoneStateT<T> &bs = states[b.id];
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone::Connection &c = bj[i];
+		const Bone &bn = skel[c.to];
+		if (&bn != parent)
+			updateBoneTransforms(skel, &b, bn, bs.boneToWorld * vmath::translation_matrix(convertVec<T>(c.pos)), states, stale);
+	}
+}
+
+template <typename T>
+void ikUpdateBoneTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states)
+{
+	updateBoneTransforms(skel, 0, root, vmath::translation_matrix(rootPos), states, (char*)0);
+}
+
+static void markStale(const Skeleton &skel, const Bone *parent, const Bone &b, char *stale)
+{
+	// if b is already stale, then so is everything below it
+	if (stale[b.id])
+		return;
+
+	stale[b.id] = 1;
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone &bn = skel[bj[i].to];
+		if (&bn != parent)
+			markStale(skel, &b, bn, stale);
+	}
+}
+
+template <typename T>
+void ikUpdateBranchTransforms(const Skeleton &skel, const Bone &b, int j, IkBoneStateT<T> *states, char *stale)
+{
+	const Bone::Connection &c = skel.getJoints(b)[j];
+	if (stale != 0)
+		markStale(skel, &b, skel[c.to], stale);
+	else
+		updateBoneTransforms(skel, &b, skel[c.to], states[b.id].boneToWorld * vmath::translation_matrix(convertVec<T>(c.pos)), states, (char*)0);
+}
+
+template <typename T>
+void ikUpdateChainBoneTransforms(const Skeleton &skel, const IkChainT<T> &chain, int last, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale)
+{
+	const int n = chain.length();
+	assert(last < n);
+
+	// walk down the chain from the first changed bone to the effector; the rest of the chain
+	// is unchanged, so each bone's parent (the next bone along) is already up to date
+	// the operations are the same as in updateBoneTransforms, so the results are identical
+	for (int i = last; i >= 0; --i)
+	{
+		const Bone &b = skel[chain.boneIds[i]];
+		const Bone *next = (i + 1 < n) ? &skel[chain.boneIds[i + 1]] : 0;
+		const Bone *prev = (i > 0) ? &skel[chain.boneIds[i - 1]] : 0;
+		IkBoneStateT<T> &bs = states[b.id];
+
+		if (next == 0)
+			bs.boneToWorld = vmath::translation_matrix(rootPos) * vmath::mat4<T>(bs.rot);
+		else
+		{
+			const vmath::mat4<T> base = states[next->id].boneToWorld * vmath::translation_matrix(chain.nextJointPos[i]);
+			bs.boneToWorld = base * vmath::mat4<T>(bs.rot) * vmath::translation_matrix(-chain.jointPos[i]);
+		}
+		if (stale != 0)
+			stale[b.id] = 0;
+
+		// the branches off the chain
+		const Bone::Connection *bj = skel.getJoints(b);
+		for (int j = 0; j < b.numJoints; ++j)
+		{
+			const Bone *to = &skel[bj[j].to];
+			if ((to != next) && (to != prev))
+				ikUpdateBranchTransforms(skel, b, j, states, stale);
+		}
+	}
+}
+
+// b is up to date, but some of the bones below it may not be
+template <typename T>
+static void updateStaleTransforms(const Skeleton &skel, const Bone *parent, const Bone &b, IkBoneStateT<T> *states, char *stale)
+{
+	const IkBoneStateT<T> &bs = states[b.id];
+	const Bone::Connection *bj = skel.getJoints(b);
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone::Connection &c = bj[i];
+		const Bone &bn = skel[c.to];
+		if (&bn == parent)
+			continue;
+
+		if (stale[bn.id])
+			updateBoneTransforms(skel, &b, bn, bs.boneToWorld * vmath::translation_matrix(convertVec<T>(c.pos)), states, stale);
+		else
+			updateStaleTransforms(skel, &b, bn, states, stale);
+	}
+}
+
+template <typename T>
+void ikUpdateStaleTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale)
+{
+	if (stale[root.id])
+		updateBoneTransforms(skel, 0, root, vmath::translation_matrix(rootPos), states, stale);
+	else
+		updateStaleTransforms(skel, 0, root, states, stale);
+}
+
+// ===== Chain Building ======================================================
+
+template <typename T>
+void ikBuildChain(const Skeleton &skel, const Bone &root, const Bone &effector, IkChainT<T> &chain)
+{
+	std::vector<const Bone*> bones;
+	skel.findPath(root, effector, bones);
+
+	const int n = (int)bones.size();
+	chain.boneIds.resize(n);
+	chain.jointPos.resize(n);
+	chain.nextJointPos.resize(n);
+	chain.constraints.resize(n);
+	chain.reversed.resize(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const Bone &b = *bones[i];
+		chain.boneIds[i] = b.id;
+
+		if (i + 1 < n)
+		{
+			const Bone &next = *bones[i + 1];
+			chain.jointPos[i] = convertVec<T>(skel.getJoint(b, next).pos);
+			chain.nextJointPos[i] = convertVec<T>(skel.getJoint(next, b).pos);
+
+			// see applyConstraints()
+			const bool rev = (&next != skel.getParent(b));
+			chain.constraints[i] = rev ? &next.constraints : &b.constraints;
+			chain.reversed[i] = rev;
+		}
+		else
+		{
+			chain.jointPos[i] = vmath::vec3<T>(T(0), T(0), T(0));
+			chain.nextJointPos[i] = vmath::vec3<T>(T(0), T(0), T(0));
+			chain.constraints[i] = 0;
+			chain.reversed[i] = false;
+		}
+	}
+
+	// from the effector to its joint, then from joint to joint along the bones
+	chain.reach = T(0);
+	if (n >= 2)
+		chain.reach = length(chain.jointPos[0]);
+	for (int i = 1; i + 1 < n; ++i)
+		chain.reach += length(chain.jointPos[i] - chain.nextJointPos[i - 1]);
+}
+
+// ===== Constraints =========================================================
+
+template <typename T>
+static void applyConstraints(const Skeleton &skel, const Bone &b, const Bone::Connection &bj, IkBoneStateT<T> *states)
+{
+	// in our tree,
+	// b is the child
+	// bj.to is the parent
+	// but this may not be the same as the canonical skeleton tree
+
+	IkBoneStateT<T> &bs = states[b.id];
+	if (&skel[bj.to] == skel.getParent(b))
+		bs.rot = constrainRot(b.constraints, bs.rot);
+	else
+	{
+		// in our internal tree, the parent/child relationship is reversed...
+		// this is a somewhat painful situation
+
+		const JointConstraints &cnst = skel[bj.to].constraints;
+		bs.rot = transpose(constrainRot(cnst, transpose(bs.rot)));
+	}
+}
+
+template <typename T>
+static void applyAllConstraints(const Skeleton &skel, const Bone *parent, const Bone &b, IkBoneStateT<T> *states)
+{
+	const Bone::Connection *bj = skel.getJoints(b);
+	if ((parent == 0) && (b.primaryJointIdx >= 0))
+		applyConstraints(skel, b, bj[b.primaryJointIdx], states);
+	else if (parent != 0)
+		applyConstraints(skel, b, skel.getJoint(b, *parent), states);
+
+	for (int i = 0; i < b.numJoints; ++i)
+	{
+		const Bone &bn = skel[bj[i].to];
+		if (&bn != parent)
+			applyAllConstraints(skel, &b, bn, states);
+	}
+}
+
+template <typename T>
+void ikApplyAllConstraints(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states)
+{
+	applyAllConstraints(skel, 0, root, states);
+}
+
+// ===== Chain Working Set ===================================================
+
+template <typename T>
+void ikLoadChain(const IkChainT<T> &chain, const IkBoneStateT<T> *states, IkChainStateT<T> &cs)
+{
+	const int n = chain.length();
+	cs.rot.resize(n);
+	cs.worldRot.resize(n);
+	cs.worldPos.resize(n);
+	cs.passesUndone = false;
+
+	for (int i = 0; i < n; ++i)
+	{
+		const IkBoneStateT<T> &bs = states[chain.boneIds[i]];
+		cs.rot[i] = bs.rot;
+		cs.worldRot[i] = vmath::mat3<T>(bs.boneToWorld);
+		cs.worldPos[i] = bs.boneToWorld.translation();
+	}
+}
+
+template <typename T>
+int ikStoreChain(const IkChainT<T> &chain, const IkChainStateT<T> &cs, IkBoneStateT<T> *states)
+{
+	const int n = chain.length();
+	int last = -1;
+	for (int i = 0; i < n; ++i)
+	{
+		vmath::mat3<T> &rot = states[chain.boneIds[i]].rot;
+		if (rot != cs.rot[i])
+		{
+			rot = cs.rot[i];
+			last = i;
+		}
+	}
+	return last;
+}
+
+template <typename T>
+void ikUpdateChainTransforms(const IkChainT<T> &chain, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs)
+{
+	const int n = chain.length();
+	if (n == 0) return;
+
+	// same sequence of operations as the full tree update (see updateBoneTransforms),
+	// but with the 4x4 transforms split into rotation & translation
+	cs.worldRot[n - 1] = cs.rot[n - 1];
+	cs.worldPos[n - 1] = rootPos;
+
+	for (int i = n - 2; i >= 0; --i)
+	{
+		const vmath::vec3<T> base = cs.worldRot[i + 1] * chain.nextJointPos[i] + cs.worldPos[i + 1];
+		cs.worldRot[i] = cs.worldRot[i + 1] * cs.rot[i];
+		cs.worldPos[i] = cs.worldRot[i] * -chain.jointPos[i] + base;
+	}
+}
+
+template <typename T>
+void ikLoadChainQuat(IkChainStateT<T> &cs)
+{
+	const int n = (int)cs.rot.size();
+	cs.qrot.resize(n);
+	for (int i = 0; i < n; ++i)
+		cs.qrot[i] = normalize(vmath::mat_to_quat(cs.rot[i]));
+}
+
+// ===== CCD =================================================================
+
+template <typename T>
+static vmath::vec3<T> updateJointByIk(const JointConstraints *cnst, bool reversed, const vmath::vec3<T> &jointPos, const vmath::vec3<T> &target, const vmath::vec3<T> &tip, vmath::mat3<T> &boneRot, bool constrain, IkStats *stats)
+{
+	const vmath::vec3<T> relTip = tip - jointPos;
+	const vmath::vec3<T> relTarget = target - jointPos;
+
+	// calculate the required rotation
+	vmath::mat3<T> rot = calcDirectRotation(relTip, relTarget);
+	if (rot == vmath::mat3<T>(T(1))) return tip;
+	
+	// apply constraints to the bone's orientation	
+	if (constrain)
+	{
+		vmath::mat3<T> oldRot = boneRot;
+		boneRot = boneRot * rot;
+		ikConstrainJoint(*cnst, reversed, boneRot, stats);
+		rot = transpose(oldRot) * boneRot;
+	}
+	else // alternatively, just apply the rotation directly
+		boneRot = boneRot * rot;
+
+	return jointPos + rot*relTip;
+}
+
+template <typename T>
+vmath::vec3<T> ikStepCCD(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints)
+{
+	const int n = chain.length();
+	assert(n > 0);
+	vmath::vec3<T> tip = cs.worldPos[0];
+
+	// the first bone is the effector bone, so rotating it won't help; just skip it
+	for (int i = 1; i < n - 1; ++i)
+	{
+		const vmath::mat3<T> &worldRot = cs.worldRot[i];
+		const vmath::vec3<T> &worldPos = cs.worldPos[i];
+
+		// into bone space (v * worldRot is transpose(worldRot) * v)
+		const vmath::vec3<T> originB = worldPos * worldRot;
+		const vmath::vec3<T> targetB = target * worldRot - originB;
+		vmath::vec3<T> tipB = tip * worldRot - originB;
+
+		tipB = updateJointByIk(chain.constraints[i], chain.reversed[i] != 0, chain.jointPos[i], targetB, tipB, cs.rot[i], applyConstraints, cs.stats);
+
+		tip = worldRot * tipB + worldPos;
+	}
+
+	return tip;
+}
+
+template <typename T>
+static vmath::vec3<T> updateJointByIkQuat(const JointConstraints *cnst, bool reversed, const vmath::vec3<T> &jointPos, const vmath::vec3<T> &target, const vmath::vec3<T> &tip, vmath::quat<T> &boneQuat, vmath::mat3<T> &boneRot, bool constrain, IkStats *stats)
+{
+	const vmath::vec3<T> relTip = tip - jointPos;
+	const vmath::vec3<T> relTarget = target - jointPos;
+
+	// calculate the required rotation
+	vmath::quat<T> rot = calcDirectRotationQuat(relTip, relTarget);
+	if (rot.w == T(1)) return tip;
+
+	// the accumulated rotation is renormalised every time it's updated, so it can't drift
+	if (constrain)
+	{
+		const vmath::quat<T> oldRot = boneQuat;
+		boneQuat = normalize(boneQuat * rot);
+		ikConstrainJointQuat(*cnst, reversed, boneQuat, stats);
+		rot = conjugate(oldRot) * boneQuat;
+	}
+	else // alternatively, just apply the rotation directly
+		boneQuat = normalize(boneQuat * rot);
+
+	boneRot = vmath::quat_to_mat3(boneQuat);
+
+	return jointPos + quatRotate(rot, relTip);
+}
+
+template <typename T>
+vmath::vec3<T> ikStepCCDQuat(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints)
+{
+	const int n = chain.length();
+	assert(n > 0);
+	assert((int)cs.qrot.size() == n);
+	vmath::vec3<T> tip = cs.worldPos[0];
+
+	// see ikStepCCD
+	for (int i = 1; i < n - 1; ++i)
+	{
+		const vmath::mat3<T> &worldRot = cs.worldRot[i];
+		const vmath::vec3<T> &worldPos = cs.worldPos[i];
+
+		const vmath::vec3<T> originB = worldPos * worldRot;
+		const vmath::vec3<T> targetB = target * worldRot - originB;
+		vmath::vec3<T> tipB = tip * worldRot - originB;
+
+		tipB = updateJointByIkQuat(chain.constraints[i], chain.reversed[i] != 0, chain.jointPos[i], targetB, tipB, cs.qrot[i], cs.rot[i], applyConstraints, cs.stats);
+
+		tip = worldRot * tipB + worldPos;
+	}
+
+	return tip;
+}
+
+// ===== FABRIK ==============================================================
+
+// moves a point to lie at a given distance from another, along the line between them
+// (if the two points coincide, there's no line, so the point is left where it is)
+template <typename T>
+static void placeAtDistance(const vmath::vec3<T> &from, T dist, vmath::vec3<T> &p)
+{
+	const vmath::vec3<T> d = p - from;
+	const T lenSqr = dot(d, d);
+	if (lenSqr > T(0))
+		p = from + d * (dist * vmath::rsqrt(lenSqr));
+}
+
+template <typename T>
+vmath::vec3<T> ikStepFABRIK(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints)
+{
+	const int n = chain.length();
+	assert(n > 0);
+
+	// as in CCD, the effector and root bones are never rotated,
+	// so there's nothing to do unless there's at least one bone between them
+	if (n < 3)
+		return cs.worldPos[0];
+
+	// (see below)
+	if (cs.passesUndone)
+	{
+		const vmath::vec3<T> rootPos = cs.worldPos[n - 1];
+		ikStepCCD(chain, cs, target, applyConstraints);
+		ikUpdateChainTransforms(chain, rootPos, cs);
+		return cs.worldPos[0];
+	}
+
+	// points[0] is the effector position; points[i] is the joint between chain bones i and i+1
+	// bone i (0 < i < n-1) runs from points[i] to points[i-1], and points[n-2] is fixed to the root
+	std::vector< vmath::vec3<T> > &points = cs.points;
+	points.resize(n - 1);
+	const vmath::vec3<T> startTip = cs.worldPos[0];
+	points[0] = startTip;
+	if (applyConstraints)
+		cs.savedRot.assign(cs.rot.begin(), cs.rot.end());
+	for (int i = 1; i < n - 1; ++i)
+		points[i] = cs.worldRot[i] * chain.jointPos[i] + cs.worldPos[i];
+
+	// the effector hangs off bone 1 at a fixed offset (the effector bone is never rotated)
+	// (v * worldRot is transpose(worldRot) * v)
+	const vmath::vec3<T> tipB = (points[0] - cs.worldPos[1]) * cs.worldRot[1];
+
+	// the bones are rigid, so the distances between the points are fixed
+	// (they're measured from the current pose rather than stored in the chain,
+	// because the effector's offset depends on the pose)
+	T reach = T(0);
+	for (int i = 1; i < n - 1; ++i)
+		reach += length(points[i - 1] - points[i]);
+
+	if (length_squared(target - points[n - 2]) >= reach*reach)
+	{
+		// the target is out of reach, so the best that can be done is to point every bone straight at it
+		for (int i = 0; i < n - 2; ++i)
+			points[i] = target;
+	}
+	else
+	{
+		// the backward pass: pin the effector to the target, and drag each joint after it
+		// (each length has to be measured before the point is moved)
+		vmath::vec3<T> prev = points[0];
+		points[0] = target;
+		for (int i = 1; i < n - 2; ++i)
+		{
+			const T len = length(prev - points[i]);
+			prev = points[i];
+			placeAtDistance(points[i - 1], len, points[i]);
+		}
+	}
+
+	// the forward pass, working out from the root: each bone's parent is final when it's reached,
+	// so the bone is turned (with the minimal rotation) from its actual joint to point at the next point,
+	// and is constrained in exactly the same way as in CCD
+	// without constraints, this puts the joints exactly where the usual forward pass would;
+	// with them, the rest of the chain carries on from wherever the constrained joint ends up
+	for (int i = n - 2; i >= 0; --i)
+	{
+		const vmath::vec3<T> joint = cs.worldRot[i + 1] * chain.nextJointPos[i] + cs.worldPos[i + 1];
+
+		if (i > 0)
+		{
+			// into bone space, with the bone's current rotation relative to its (already updated) parent
+			const vmath::mat3<T> frame = cs.worldRot[i + 1] * cs.rot[i];
+			const vmath::vec3<T> tip = (i > 1) ? chain.nextJointPos[i - 1] : tipB;
+			const vmath::vec3<T> targetB = (points[i - 1] - joint) * frame + chain.jointPos[i];
+			updateJointByIk(chain.constraints[i], chain.reversed[i] != 0, chain.jointPos[i], targetB, tip, cs.rot[i], applyConstraints, cs.stats);
+		}
+
+		// see ikUpdateChainTransforms
+		cs.worldRot[i] = cs.worldRot[i + 1] * cs.rot[i];
+		cs.worldPos[i] = cs.worldRot[i] * -chain.jointPos[i] + joint;
+	}
+
+	// the passes don't know about the constraints, so a constrained chain can settle into a pose that the
+	// passes just reproduce, or be thrown further from the target; if that's happened, the passes are undone,
+	// and a CCD sweep from where the chain was takes over (for the rest of the solve, as the passes would
+	// only keep leading the chain back into the same poses)
+	if (applyConstraints && (length_squared(cs.worldPos[0] - target) >= length_squared(startTip - target)))
+	{
+		const vmath::vec3<T> rootPos = cs.worldPos[n - 1];
+		std::copy(cs.savedRot.begin(), cs.savedRot.end(), cs.rot.begin());
+		ikUpdateChainTransforms(chain, rootPos, cs);
+		ikStepCCD(chain, cs, target, applyConstraints);
+		ikUpdateChainTransforms(chain, rootPos, cs);
+		cs.passesUndone = true;
+	}
+
+	return cs.worldPos[0];
+}
+
+// ===== Two-Bone IK =========================================================
+
+template <typename T>
+bool ikHingeAxis(const IkChainT<T> &chain, const IkChainStateT<T> &cs, int i, vmath::vec3<T> &axis)
+{
+	const JointConstraints *cnst = chain.constraints[i];
+	if ((cnst == 0) || (cnst->minAzimuth != cnst->maxAzimuth) || (cnst->minTwist != cnst->maxTwist) || (cnst->minElevation == cnst->maxElevation))
+		return false;
+
+	// the elevation is about (cos(az), 0, -sin(az)) in the space of the skeleton's parent bone;
+	// if the chain runs the other way at this joint, that's this bone rather than the next one along
+	const JointConstraints::AngleLimit &az = cnst->azimuthLimits[0];
+	const vmath::mat3<T> &parentRot = cs.worldRot[chain.reversed[i] ? i : i + 1];
+	axis = parentRot * vmath::vec3<T>(T(az.c), T(0), T(-az.s));
+	return true;
+}
+
+// constrains the rotation of chain joint i, as in CCD
+// returns true if the constraints made any real difference
+template <typename T>
+static bool constrainChainJoint(const IkChainT<T> &chain, int i, vmath::mat3<T> &boneRot, IkStats *stats)
+{
+	return ikConstrainJoint(*chain.constraints[i], chain.reversed[i] != 0, boneRot, stats);
+}
+
+// turns chain bone i by angle about a world-space axis
+template <typename T>
+static void turnChainBone(IkChainStateT<T> &cs, int i, const vmath::vec3<T> &axis, T angle)
+{
+	// W' = R(axis) W means rot' = rot R(W^T axis) (and v * worldRot is transpose(worldRot) * v)
+	if (angle != T(0))
+		cs.rot[i] = cs.rot[i] * vmath::rotation_matrix3(angle, axis * cs.worldRot[i]);
+}
+
+template <typename T>
+bool ikSolveTwoBone(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints)
+{
+	typedef vmath::vec3<T> vec3t;
+
+	assert(ikIsTwoBoneChain(chain));
+	const vec3t rootPos = cs.worldPos[3];
+	const vmath::mat3<T> oldRot1 = cs.rot[1];
+	const vmath::mat3<T> oldRot2 = cs.rot[2];
+	const T oldError = length_squared(cs.worldPos[0] - target);
+	bool bound = false;
+
+	// chain bone 2 turns about joint A (with the root), and bone 1 about joint B (with bone 2); C is the effector
+	const vec3t A = cs.worldRot[2] * chain.jointPos[2] + cs.worldPos[2];
+	const vec3t B = cs.worldRot[1] * chain.jointPos[1] + cs.worldPos[1];
+	const vec3t C = cs.worldPos[0];
+	const vec3t w = B - A;
+	const vec3t u = C - B;
+
+	// first, bend at B (about h) so that the effector is the right distance from A;
+	// that's the law of cosines, but h needn't be perpendicular to the bones (for a hinge it's fixed), so in general:
+	// C' = B + R(phi) u, where R(phi) u = u_par + cos(phi) u_perp + sin(phi) (h x u_perp)
+	// |C' - A|^2 = |w|^2 + |u|^2 + 2 w.R(phi)u, so P cos(phi) + Q sin(phi) = K, for:
+	vec3t h;
+	if (!(applyConstraints && ikHingeAxis(chain, cs, 1, h)))
+	{
+		// bend in the plane of the bones, or if they're in line, the plane that contains the target
+		h = cross(w, u);
+		if (length_squared(h) < T(0.000001) * dot(w, w) * dot(u, u))
+			h = cross(w, target - A);
+		if (length_squared(h) < T(0.000001) * dot(w, w) * length_squared(target - A))
+			h = cross(w, (abs(w.x) < abs(w.y)) ? vec3t(T(1), T(0), T(0)) : vec3t(T(0), T(1), T(0)));
+		h = normalize(h);
+	}
+
+	const vec3t uPar = h * dot(h, u);
+	const vec3t uPerp = u - uPar;
+	const T P = dot(w, uPerp);
+	const T Q = dot(w, cross(h, uPerp));
+	const T K = (length_squared(target - A) - dot(w, w) - dot(u, u)) * T(0.5) - dot(w, uPar);
+	const T R = std::sqrt(P*P + Q*Q);
+	if (R > T(0))
+	{
+		// two solutions, phi0 +/- delta (if the distance can't be reached, the nearest the bend can get is phi0 or phi0 + pi)
+		const T phi0 = std::atan2(Q, P);
+		const T delta = std::acos(clamp(T(-1), T(1), K / R));
+		T phi = phi0 - delta;
+		T alt = phi0 + delta;
+
+		// take whichever one is the smaller change from the current pose
+		if (phi > T(M_PI)) phi -= T(2.0*M_PI);
+		if (phi < T(-M_PI)) phi += T(2.0*M_PI);
+		if (alt > T(M_PI)) alt -= T(2.0*M_PI);
+		if (alt < T(-M_PI)) alt += T(2.0*M_PI);
+		if (abs(alt) < abs(phi))
+			phi = alt;
+
+		turnChainBone(cs, 1, h, phi);
+		if (applyConstraints)
+			bound = constrainChainJoint(chain, 1, cs.rot[1], cs.stats) || bound;
+		ikUpdateChainTransforms(chain, rootPos, cs);
+	}
+
+	// then swing at A to point the effector at the target
+	const vec3t p = cs.worldPos[0] - A;
+	const vec3t q = target - A;
+	if (applyConstraints && ikHingeAxis(chain, cs, 2, h))
+	{
+		// a hinge can only turn about its axis, so line up the parts of p and q across it
+		const vec3t pPerp = p - h * dot(h, p);
+		const vec3t qPerp = q - h * dot(h, q);
+		turnChainBone(cs, 2, h, std::atan2(dot(h, cross(pPerp, qPerp)), dot(pPerp, qPerp)));
+	}
+	else
+	{
+		// into bone space (v * worldRot is transpose(worldRot) * v)
+		cs.rot[2] = cs.rot[2] * calcDirectRotation(p * cs.worldRot[2], q * cs.worldRot[2]);
+	}
+
+	if (applyConstraints)
+		bound = constrainChainJoint(chain, 2, cs.rot[2], cs.stats) || bound;
+	ikUpdateChainTransforms(chain, rootPos, cs);
+
+	// once the constraints have had their way, the result can be further from the target than where it started,
+	// and a worse place to iterate from
+	if (bound && (length_squared(cs.worldPos[0] - target) > oldError))
+	{
+		cs.rot[1] = oldRot1;
+		cs.rot[2] = oldRot2;
+		ikUpdateChainTransforms(chain, rootPos, cs);
+	}
+
+	return !bound;
+}
+
+// ===== Convergence =========================================================
+
+template <typename T>
+T ikReachGap(const IkChainT<T> &chain, const IkChainStateT<T> &cs, const vmath::vec3<T> &target)
+{
+	const int n = chain.length();
+	if (n < 2)
+		return T(0);
+
+	// the joint between the root and the next bone along stays put
+	const vmath::vec3<T> pivot = cs.worldRot[n - 2] * chain.jointPos[n - 2] + cs.worldPos[n - 2];
+	return std::max(T(0), length(target - pivot) - chain.reach);
+}
+
+// ===== Orientation Targets =================================================
+
+template <typename T>
+T ikOrientationError(const vmath::mat3<T> &rot, const vmath::mat3<T> &targetRot)
+{
+	// trace(targetRot^T rot) is 1 + 2 cos(angle)
+	T tr = T(0);
+	for (int c = 0; c < 3; ++c)
+	for (int r = 0; r < 3; ++r)
+		tr += rot.elem[c][r] * targetRot.elem[c][r];
+	return T(3) - tr;
+}
+
+// turns the effector bone about its own joint to line it up with targetRot, given its current world orientation
+// returns false if the constraints made any real difference (if they'd leave it further from targetRot than
+// it started, it's left as it was)
+template <typename T>
+static bool alignEffectorJoint(const IkChainT<T> &chain, vmath::mat3<T> &boneRot, const vmath::mat3<T> &effRot, const vmath::mat3<T> &targetRot, bool applyConstraints, IkStats *stats)
+{
+	// effRot' = targetRot means rot' = rot effRot^T targetRot; this is taken back through a quaternion,
+	// since any drift in effRot would otherwise be compounded from one iteration to the next
+	const vmath::mat3<T> oldRot = boneRot;
+	boneRot = vmath::quat_to_mat3(normalize(vmath::mat_to_quat(boneRot * (transpose(effRot) * targetRot))));
+	if (!(applyConstraints && constrainChainJoint(chain, 0, boneRot, stats)))
+		return true;
+
+	if (ikOrientationError(effRot * (transpose(oldRot) * boneRot), targetRot) > ikOrientationError(effRot, targetRot))
+		boneRot = oldRot;
+	return false;
+}
+
+template <typename T>
+bool ikAlignEffector(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::mat3<T> &targetRot, bool applyConstraints)
+{
+	if (chain.length() < 2)
+		return false;
+
+	// the joint stays where it is
+	const vmath::vec3<T> joint = cs.worldRot[0] * chain.jointPos[0] + cs.worldPos[0];
+	const bool aligned = alignEffectorJoint(chain, cs.rot[0], cs.worldRot[0], targetRot, applyConstraints, cs.stats);
+	cs.worldRot[0] = cs.worldRot[1] * cs.rot[0];
+	cs.worldPos[0] = joint - cs.worldRot[0] * chain.jointPos[0];
+	return aligned;
+}
+
+template <typename T>
+vmath::vec3<T> ikStepCCDOrient(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, const vmath::mat3<T> &targetRot, T weight, bool applyConstraints)
+{
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat3<T> mat3t;
+
+	const int n = chain.length();
+	assert(n > 0);
+	vec3t tip = cs.worldPos[0];
+	mat3t effRot = cs.worldRot[0];
+
+	// the orientation is represented by points along two of the effector's axes, as far out as the
+	// length of the bone before it, which are pulled towards the same points on the target's axes
+	const T L = (n > 1) ? length(chain.jointPos[1] - chain.nextJointPos[0]) : T(0);
+
+	// as ikStepCCD, but each joint is turned for all three points at once
+	for (int i = 1; i < n - 1; ++i)
+	{
+		const mat3t &worldRot = cs.worldRot[i];
+		const vec3t &worldPos = cs.worldPos[i];
+		const vec3t &jointPos = chain.jointPos[i];
+
+		// into bone space (v * worldRot is transpose(worldRot) * v)
+		const vec3t originB = worldPos * worldRot;
+		const vec3t relTip = (tip * worldRot - originB) - jointPos;
+		const vec3t relTarget = (target * worldRot - originB) - jointPos;
+
+		// each point's rotation is weighted by its distance from the joint (as in the multi-effector sweep,
+		// see ikStepCCDTree), and the orientation's points by the weight as well
+		vmath::quat<T> q = calcDirectRotationQuat(relTip, relTarget);
+		q *= std::sqrt(dot(relTip, relTip) * dot(relTarget, relTarget));
+		for (int a = 0; a < 2; ++a)
+		{
+			const vec3t axis(T(a == 0), T(a == 1), T(0));
+			const vec3t relTipA = relTip + ((effRot * axis) * worldRot) * L;
+			const vec3t relTargetA = relTarget + ((targetRot * axis) * worldRot) * L;
+			vmath::quat<T> qa = calcDirectRotationQuat(relTipA, relTargetA);
+			qa *= weight * std::sqrt(dot(relTipA, relTipA) * dot(relTargetA, relTargetA));
+			q += qa;
+		}
+		if (dot(q.v, q.v) + q.w*q.w <= T(0))
+			continue;
+		mat3t rot = vmath::quat_to_mat3(normalize(q));
+
+		// see updateJointByIk
+		mat3t &boneRot = cs.rot[i];
+		if (applyConstraints)
+		{
+			const mat3t oldRot = boneRot;
+			boneRot = boneRot * rot;
+			constrainChainJoint(chain, i, boneRot, cs.stats);
+			rot = transpose(oldRot) * boneRot;
+		}
+		else
+			boneRot = boneRot * rot;
+
+		tip = worldRot * (jointPos + rot*relTip) + worldPos;
+		effRot = worldRot * rot * transpose(worldRot) * effRot;
+	}
+
+	// the effector's own joint takes up the rest of the orientation
+	if (n >= 2)
+	{
+		const vec3t joint = effRot * chain.jointPos[0] + tip;
+		const mat3t oldRot = cs.rot[0];
+		alignEffectorJoint(chain, cs.rot[0], effRot, targetRot, applyConstraints, cs.stats);
+		tip = joint - (effRot * (transpose(oldRot) * cs.rot[0])) * chain.jointPos[0];
+	}
+
+	return tip;
+}
+
+// ===== Constraint Test =====================================================
+
+// the straightforward angle-based form of constrainRot, to check against
+static mat3d constrainRotByAngles(const JointConstraints &cnst, const mat3d &rot)
+{
+	vec3d dir;
+	double az, el, twist;
+
+	rotationToAzimuthElevationTwist(rot, dir, az, el, twist);
+
+	az = clamp(cnst.minAzimuth, cnst.maxAzimuth, az);
+
+	if (cnst.minElevation != cnst.maxElevation)
+	{
+		double K = dir.z*std::cos(az) + dir.x*std::sin(az);
+		el = std::atan2(K, dir.y);
+		if (el < cnst.minElevation || el > cnst.maxElevation)
+		{
+			double dotMin = K*std::sin(cnst.minElevation) + dir.y*std::cos(cnst.minElevation);
+			double dotMax = K*std::sin(cnst.maxElevation) + dir.y*std::cos(cnst.maxElevation);
+			if (dotMin < dotMax)
+				el = cnst.maxElevation;
+			else
+				el = cnst.minElevation;
+		}
+	}
+	else
+		el = cnst.minElevation;
+
+	twist = clamp(cnst.minTwist, cnst.maxTwist, twist);
+
+	return rotationFromAzElTwist(az, el, twist);
+}
+
+void testJointConstraints()
+{
+	const double threshold = 0.000001;
+	(void)threshold;
+
+	std::vector<JointConstraints> constraints;
+	constraints.push_back(JointConstraints());
+	constraints.push_back(JointConstraints(JointConstraints::Ball));
+	constraints.push_back(JointConstraints(JointConstraints::Saddle));
+	constraints.push_back(JointConstraints(JointConstraints::Hinge));
+	constraints.push_back(JointConstraints(JointConstraints::Pivot));
+	constraints.push_back(JointConstraints(JointConstraints::Fixed));
+	constraints.push_back(JointConstraints(JointConstraints::Custom, -0.5, 1.0, 0.2, 1.2, -0.3, 0.6));
+	constraints.push_back(JointConstraints(JointConstraints::Custom, -2.5, -1.0, 0.0, 0.4, -1.0, 4.0));
+	constraints.push_back(JointConstraints(JointConstraints::Custom, 0.3, 0.3, 0.7, 0.7, -5.0, -2.0));
+
+	for (int i = 0; i < 512; ++i)
+	{
+		const double az = -M_PI + (2.0*M_PI * ((i * 37) % 512)) / 512.0;
+		const double el = (M_PI * ((i * 101) % 512)) / 512.0;
+		const double twist = -M_PI + (2.0*M_PI * ((i * 211) % 512)) / 512.0;
+		const mat3d rot = rotationFromAzElTwist(az, el, twist);
+
+		// the azimuth is arbitrary when the elevation is 0 or pi, and when the total twist (az + twist)
+		// is half a turn, it's arbitrary which way round it goes (so the two versions can clamp differently)
+		if ((el < 0.01) || (el > M_PI - 0.01) || (abs(abs(az + twist) - M_PI) < 0.01))
+			continue;
+
+		for (int j = 0; j < (int)constraints.size(); ++j)
+		{
+			const mat3d expected = constrainRotByAngles(constraints[j], rot);
+			const mat3d actual = constrainRot(constraints[j], rot);
+			(void)expected; (void)actual;
+			for (int c = 0; c < 3; ++c)
+			for (int r = 0; r < 3; ++r)
+				assert(abs(expected.elem[c][r] - actual.elem[c][r]) < threshold);
+		}
+	}
+}
+
+// ===== Explicit Instantiations =============================================
+
+#define INSTANTIATE_IK_KERNEL(T) \
+	template vmath::mat3<T> constrainRot(const JointConstraints &cnst, const vmath::mat3<T> &rot); \
+	template vmath::quat<T> constrainRotQuat(const JointConstraints &cnst, const vmath::quat<T> &rot); \
+	template bool ikConstrainJoint(const JointConstraints &cnst, bool reversed, vmath::mat3<T> &rot, IkStats *stats); \
+	template bool ikConstrainJointQuat(const JointConstraints &cnst, bool reversed, vmath::quat<T> &rot, IkStats *stats); \
+	template void ikResetPose(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states); \
+	template void ikChangeRoot(const Skeleton &skel, const Bone &oldRoot, const Bone &newRoot, IkBoneStateT<T> *states); \
+	template void ikUpdateBoneTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states); \
+	template void ikUpdateBranchTransforms(const Skeleton &skel, const Bone &b, int j, IkBoneStateT<T> *states, char *stale); \
+	template void ikUpdateChainBoneTransforms(const Skeleton &skel, const IkChainT<T> &chain, int last, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale); \
+	template void ikUpdateStaleTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale); \
+	template void ikBuildChain(const Skeleton &skel, const Bone &root, const Bone &effector, IkChainT<T> &chain); \
+	template void ikLoadChain(const IkChainT<T> &chain, const IkBoneStateT<T> *states, IkChainStateT<T> &cs); \
+	template int ikStoreChain(const IkChainT<T> &chain, const IkChainStateT<T> &cs, IkBoneStateT<T> *states); \
+	template void ikUpdateChainTransforms(const IkChainT<T> &chain, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs); \
+	template void ikLoadChainQuat(IkChainStateT<T> &cs); \
+	template vmath::vec3<T> ikStepCCD(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints); \
+	template vmath::vec3<T> ikStepCCDQuat(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints); \
+	template vmath::vec3<T> ikStepFABRIK(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints); \
+	template bool ikHingeAxis(const IkChainT<T> &chain, const IkChainStateT<T> &cs, int i, vmath::vec3<T> &axis); \
+	template bool ikSolveTwoBone(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints); \
+	template T ikReachGap(const IkChainT<T> &chain, const IkChainStateT<T> &cs, const vmath::vec3<T> &target); \
+	template T ikOrientationError(const vmath::mat3<T> &rot, const vmath::mat3<T> &targetRot); \
+	template bool ikAlignEffector(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::mat3<T> &targetRot, bool applyConstraints); \
+	template vmath::vec3<T> ikStepCCDOrient(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, const vmath::mat3<T> &targetRot, T weight, bool applyConstraints); \
+	template void ikApplyAllConstraints(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states);
+
+INSTANTIATE_IK_KERNEL(float)
+INSTANTIATE_IK_KERNEL(double)
+
+#undef INSTANTIATE_IK_KERNEL
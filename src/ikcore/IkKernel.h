@@ -0,0 +1,308 @@
+#ifndef IK_KERNEL_H
+#define IK_KERNEL_H
+
+// Low-level IK operations on an explicit array of bone states.
+// These are shared by IkSolver (which owns the state for a single instance)
+// and IkBatch (which owns the state for many instances of the same skeleton,
+// stored contiguously); neither the skeleton nor the bone states know which
+// one they're being used by.
+// Everything is templated on the scalar type of the solver state (float or double);
+// the skeleton itself is always held in double precision, and is converted as it's read.
+// The templates are instantiated for float and double in IkKernel.cpp.
+
+class Skeleton;
+class Bone;
+class JointConstraints;
+struct IkStats;
+
+// the iterative algorithms that a solver can use for each step
+enum IkAlgorithm
+{
+	IkCCD,                // cyclic coordinate descent (see ikStepCCD)
+	IkFABRIK,             // forward and backward reaching (see ikStepFABRIK)
+	IkJacobianTranspose,  // the Jacobian methods (see IkJacobian.h)
+	IkPseudoInverse,
+	IkDampedLeastSquares
+};
+
+// why an iterative solve stopped (see IkConvergenceT)
+enum IkStopReason
+{
+	IkReachedTarget,      // the effector got within the threshold of the target
+	IkReachedClosest,     // the target is out of reach, and the effector got within the threshold of as close as it can get
+	IkStalled,            // the iterations stopped making progress (typically against the constraints)
+	IkRanOut              // the iterations (or the time) ran out first
+};
+
+template <typename T>
+struct IkBoneStateT
+{
+	IkBoneStateT(): rot(T(1)), boneToWorld(T(1)) {}
+
+	// nominal rotation relative to parent
+	vmath::mat3<T> rot;
+
+	// cached world-space position & absolute orientation
+	vmath::mat4<T> boneToWorld;
+};
+
+typedef IkBoneStateT<double> IkBoneState;
+typedef IkBoneStateT<float> IkBoneStatef;
+
+// An IK chain flattened into chain order (effector first, root last)
+// everything in here depends only on the skeleton and the two end bones,
+// so one chain can be shared by any number of solver instances
+template <typename T>
+struct IkChainT
+{
+	IkChainT(): reach(T(0)) {}
+
+	std::vector<int> boneIds;
+
+	// the joint linking each bone to the next one along the chain,
+	// in the bone's own space, and in the next bone's space
+	// (the root has no next bone; its entries are zero)
+	std::vector< vmath::vec3<T> > jointPos;
+	std::vector< vmath::vec3<T> > nextJointPos;
+
+	// the constraints on each joint, and whether the chain runs against
+	// the skeleton's own parent/child direction at that joint
+	// (in which case the constraints are those of the next bone, and apply to the inverse rotation)
+	std::vector<const JointConstraints*> constraints;
+	std::vector<char> reversed;
+
+	// how far the effector can get from the joint between the root and the next bone along
+	// (the joint doesn't move, whatever the chain does): the chain's length, with every joint straight
+	T reach;
+
+	int length() const
+	{ return (int)boneIds.size(); }
+};
+
+typedef IkChainT<double> IkChain;
+typedef IkChainT<float> IkChainf;
+
+// The per-instance working set for a chain, in chain order, as separate arrays
+// so that the CCD sweep and the chain transform update just stream through them
+// (this is scratch space: load it from the bone states before solving, and store it back afterwards)
+template <typename T>
+struct IkChainStateT
+{
+	// rotation relative to the next bone along
+	std::vector< vmath::mat3<T> > rot;
+
+	// world-space orientation & position
+	std::vector< vmath::mat3<T> > worldRot;
+	std::vector< vmath::vec3<T> > worldPos;
+
+	// the rotations as quaternions, for the quaternion form of the CCD sweep (see ikStepCCDQuat)
+	std::vector< vmath::quat<T> > qrot;
+
+	// world-space joint positions, for FABRIK and the Jacobian step (see ikStepFABRIK, ikStepJacobian)
+	std::vector< vmath::vec3<T> > points;
+
+	// the rotations before a FABRIK step, to go back to if the step makes things worse (see ikStepFABRIK)
+	std::vector< vmath::mat3<T> > savedRot;
+
+	// set once a FABRIK step has been undone, after which the rest of the solve is CCD sweeps (see ikStepFABRIK)
+	bool passesUndone;
+
+	// world-space effector positions, for the multi-effector sweep (see ikStepCCDTree)
+	std::vector< vmath::vec3<T> > tips;
+
+	// the statistics the steps add to (see IkStats.h), or null if they aren't being gathered
+	IkStats *stats;
+
+	IkChainStateT()
+	:	passesUndone(false), stats(0)
+	{}
+};
+
+typedef IkChainStateT<double> IkChainState;
+typedef IkChainStateT<float> IkChainStatef;
+
+// clamps a (bone-to-parent) rotation into the range allowed by a set of joint constraints
+template <typename T>
+vmath::mat3<T> constrainRot(const JointConstraints &cnst, const vmath::mat3<T> &rot);
+
+// the same, for a rotation held as a quaternion
+template <typename T>
+vmath::quat<T> constrainRotQuat(const JointConstraints &cnst, const vmath::quat<T> &rot);
+
+// constrains the rotation of a joint along a chain (relative to the next bone along, so it's reversed when
+// that's the bone's skeleton child, see IkChainT), adding it to the statistics if there are any
+// returns true if the constraints made any real difference
+template <typename T>
+bool ikConstrainJoint(const JointConstraints &cnst, bool reversed, vmath::mat3<T> &rot, IkStats *stats);
+
+// the same, for a rotation held as a quaternion
+template <typename T>
+bool ikConstrainJointQuat(const JointConstraints &cnst, bool reversed, vmath::quat<T> &rot, IkStats *stats);
+
+// sets the bone states to the skeleton's default pose, treating root as the root of the tree
+// (the bone-to-world transforms are set to the default pose as well)
+template <typename T>
+void ikResetPose(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states);
+
+// rewrites the relative rotations along the path between the old and new roots,
+// so that the pose is unchanged when the tree is re-rooted at newRoot
+// the bone-to-world transforms must be valid on entry
+template <typename T>
+void ikChangeRoot(const Skeleton &skel, const Bone &oldRoot, const Bone &newRoot, IkBoneStateT<T> *states);
+
+// recalculates the bone-to-world transforms from the relative rotations
+template <typename T>
+void ikUpdateBoneTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states);
+
+// recalculates the bone-to-world transforms after the rotations of chain bones [0, last] have changed
+// the chain bones themselves are updated straight away; if stale is given, the other bones which hang
+// off them are only marked as stale (see ikUpdateStaleTransforms), otherwise they're updated as well
+// the rest of the tree is untouched, so the transforms of bones (last, length) along the chain must be valid
+template <typename T>
+void ikUpdateChainBoneTransforms(const Skeleton &skel, const IkChainT<T> &chain, int last, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale = 0);
+
+// brings the bones which hang off joint j of bone b (an index into Bone::joints) up to date with b's transform,
+// or if stale is given, just marks them as stale
+template <typename T>
+void ikUpdateBranchTransforms(const Skeleton &skel, const Bone &b, int j, IkBoneStateT<T> *states, char *stale = 0);
+
+// recalculates the transforms of every bone that's been marked as stale, and clears the marks
+// (one flag per bone; if a bone is stale, everything below it in the tree must be stale too)
+template <typename T>
+void ikUpdateStaleTransforms(const Skeleton &skel, const Bone &root, const vmath::vec3<T> &rootPos, IkBoneStateT<T> *states, char *stale);
+
+// builds the flattened chain from the root bone to the effector
+// (the path comes from the skeleton's topology tables, so this only costs as much as the chain is long)
+template <typename T>
+void ikBuildChain(const Skeleton &skel, const Bone &root, const Bone &effector, IkChainT<T> &chain);
+
+// copies the chain bones' rotations and transforms into the working set
+template <typename T>
+void ikLoadChain(const IkChainT<T> &chain, const IkBoneStateT<T> *states, IkChainStateT<T> &cs);
+
+// copies the chain bones' rotations back from the working set
+// returns the index of the last bone along the chain whose rotation changed, or -1 if none did
+// (the bone-to-world transforms are left stale; see ikUpdateChainBoneTransforms)
+template <typename T>
+int ikStoreChain(const IkChainT<T> &chain, const IkChainStateT<T> &cs, IkBoneStateT<T> *states);
+
+// recalculates the world transforms along the chain from the rotations
+// (bones which are not on the chain are not touched)
+template <typename T>
+void ikUpdateChainTransforms(const IkChainT<T> &chain, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs);
+
+// performs one CCD sweep along a chain
+// returns the new effector position; the world transforms in the working set are left stale
+template <typename T>
+vmath::vec3<T> ikStepCCD(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints);
+
+// sets up the quaternion rotations in a loaded working set, for ikStepCCDQuat
+template <typename T>
+void ikLoadChainQuat(IkChainStateT<T> &cs);
+
+// performs one CCD sweep along a chain, in the same way as ikStepCCD, but accumulating and
+// constraining the rotations as quaternions (which needs very little trig, and keeps them orthonormal)
+// the matrix rotations are kept in step, so the transform update and ikStoreChain work as usual
+template <typename T>
+vmath::vec3<T> ikStepCCDQuat(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints);
+
+// performs one FABRIK iteration along a chain: the joint positions are moved back from the target
+// and forward from the root, then each joint's rotation is set (root first) to point its bone along
+// the new positions, and constrained as in the CCD sweep (with constraints, a step that doesn't bring the
+// effector any closer is undone, and the rest of the solve is CCD sweeps instead)
+// the world transforms in the working set are kept up to date; returns the new effector position
+template <typename T>
+vmath::vec3<T> ikStepFABRIK(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints);
+
+// if joint i of a chain is a hinge (its constraints fix the azimuth and twist, but not the elevation),
+// gives the world-space axis that it turns about
+template <typename T>
+bool ikHingeAxis(const IkChainT<T> &chain, const IkChainStateT<T> &cs, int i, vmath::vec3<T> &axis);
+
+// a two-bone chain (the root, two bones that can turn, and the effector, eg, upper arm, forearm and hand)
+// can be solved in closed form
+template <typename T>
+inline bool ikIsTwoBoneChain(const IkChainT<T> &chain)
+{ return (chain.length() == 4); }
+
+// solves a two-bone chain in a single pass: the middle joint bends to put the effector at the target's distance
+// (about the joint's hinge axis, if it has one), then the upper joint swings it onto the target
+// each rotation is constrained as in CCD; returns false if the constraints made any difference,
+// in which case the result isn't a solution, and the solver should carry on iterating from it
+// (if the constraints leave it further from the target than it started, the chain is put back as it was)
+// the world transforms in the working set are kept up to date
+template <typename T>
+bool ikSolveTwoBone(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, bool applyConstraints);
+
+// how much further the target is from the chain's fixed joint than the chain can reach (see IkChainT::reach),
+// which is the closest the effector could possibly get to it (0 if it's within reach)
+// the working set's transforms must be up to date
+template <typename T>
+T ikReachGap(const IkChainT<T> &chain, const IkChainStateT<T> &cs, const vmath::vec3<T> &target);
+
+// the test that decides when iterating should stop, shared by the solvers: when the effector is within
+// the threshold of the target (or of the closest it could get, given the reach gap), or when two iterations
+// in a row have each taken off less than stallRate of the distance that was left to go (0 never stalls);
+// so an unreachable target stops as soon as the chain is stretched out towards it, or is stuck against
+// its constraints, rather than using up every iteration
+template <typename T>
+struct IkConvergenceT
+{
+	IkConvergenceT(T threshold = T(0), T gap = T(0), T stallRate = T(0))
+	:	goal(gap + threshold), gap(gap), stallRate(stallRate), lastDist(std::numeric_limits<T>::max()), stalls(0) {}
+
+	// given the distance from the target after an iteration, returns true if it's time to stop, and why
+	bool update(T dist, IkStopReason &reason)
+	{
+		if (dist < goal)
+		{
+			reason = (gap > T(0)) ? IkReachedClosest : IkReachedTarget;
+			return true;
+		}
+
+		// (the progress is measured against how much further there is to go than the closest the chain can get)
+		stalls = (lastDist - dist < stallRate*(lastDist - gap)) ? stalls + 1 : 0;
+		lastDist = dist;
+		if ((stallRate <= T(0)) || (stalls < 2))
+			return false;
+
+		reason = IkStalled;
+		return true;
+	}
+
+	T goal;
+	T gap;
+	T stallRate;
+	T lastDist;
+	int stalls;
+};
+
+// how far an orientation is from a target orientation: 3 - trace(targetRot^T rot), which is 2 - 2 cos(angle),
+// or roughly the square of the angle between them
+template <typename T>
+T ikOrientationError(const vmath::mat3<T> &rot, const vmath::mat3<T> &targetRot);
+
+// turns the effector bone about its own joint (which doesn't move it) to line it up with a world-space orientation
+// returns false if the constraints got in the way
+// the effector's world transform in the working set is kept up to date (the rest of the chain isn't affected)
+template <typename T>
+bool ikAlignEffector(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::mat3<T> &targetRot, bool applyConstraints);
+
+// performs one CCD sweep along a chain towards a target position and a target world-space orientation
+// for the effector bone: the orientation is represented by two points out along the effector's axes,
+// which each joint turns towards the same points on the target's axes along with the effector itself
+// (in the same way as the multi-effector sweep; weight, from 0 to 1, is how much those points count
+// against the position), and then the effector's own joint takes up whatever orientation is left
+// (see ikAlignEffector)
+// returns the new effector position; the world transforms in the working set are left stale
+template <typename T>
+vmath::vec3<T> ikStepCCDOrient(const IkChainT<T> &chain, IkChainStateT<T> &cs, const vmath::vec3<T> &target, const vmath::mat3<T> &targetRot, T weight, bool applyConstraints);
+
+// applies the joint constraints to every bone in the tree
+template <typename T>
+void ikApplyAllConstraints(const Skeleton &skel, const Bone &root, IkBoneStateT<T> *states);
+
+// checks constrainRot against a straightforward angle-based version
+void testJointConstraints();
+
+#endif
@@ -0,0 +1,542 @@
+#include "CoreGlobal.h"
+#include "IkLanes.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+#include "SimdLanes.h"
+#include "IkStats.h"
+
+// ===== Lane Vectors & Matrices =============================================
+
+// a vec3 / mat3 with one value per lane in each element
+// (matrices are column-major, like vmath: m[column][row])
+template <typename T>
+struct LaneVec3
+{
+	typename SimdLanes<T>::reg x, y, z;
+};
+
+template <typename T>
+struct LaneMat3
+{
+	typename SimdLanes<T>::reg m[3][3];
+};
+
+template <typename T>
+static LaneVec3<T> loadVec(const T *p)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::load(p);
+	v.y = L::load(p + L::Width);
+	v.z = L::load(p + 2*L::Width);
+	return v;
+}
+
+template <typename T>
+static void storeVec(T *p, const LaneVec3<T> &v)
+{
+	typedef SimdLanes<T> L;
+	L::store(p, v.x);
+	L::store(p + L::Width, v.y);
+	L::store(p + 2*L::Width, v.z);
+}
+
+template <typename T>
+static LaneMat3<T> loadMat(const T *p)
+{
+	typedef SimdLanes<T> L;
+	LaneMat3<T> m;
+	for (int c = 0; c < 3; ++c)
+	for (int r = 0; r < 3; ++r)
+		m.m[c][r] = L::load(p + (c*3 + r)*L::Width);
+	return m;
+}
+
+template <typename T>
+static void storeMat(T *p, const LaneMat3<T> &m)
+{
+	typedef SimdLanes<T> L;
+	for (int c = 0; c < 3; ++c)
+	for (int r = 0; r < 3; ++r)
+		L::store(p + (c*3 + r)*L::Width, m.m[c][r]);
+}
+
+template <typename T>
+static LaneVec3<T> splatVec(const vmath::vec3<T> &a)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::splat(a.x);
+	v.y = L::splat(a.y);
+	v.z = L::splat(a.z);
+	return v;
+}
+
+template <typename T>
+static LaneVec3<T> addVec(const LaneVec3<T> &a, const LaneVec3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::add(a.x, b.x);
+	v.y = L::add(a.y, b.y);
+	v.z = L::add(a.z, b.z);
+	return v;
+}
+
+template <typename T>
+static LaneVec3<T> subVec(const LaneVec3<T> &a, const LaneVec3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::sub(a.x, b.x);
+	v.y = L::sub(a.y, b.y);
+	v.z = L::sub(a.z, b.z);
+	return v;
+}
+
+template <typename T>
+static LaneVec3<T> scaleVec(const LaneVec3<T> &a, const typename SimdLanes<T>::reg &s)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::mul(a.x, s);
+	v.y = L::mul(a.y, s);
+	v.z = L::mul(a.z, s);
+	return v;
+}
+
+template <typename T>
+static typename SimdLanes<T>::reg dotVec(const LaneVec3<T> &a, const LaneVec3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	return L::add(L::add(L::mul(a.x, b.x), L::mul(a.y, b.y)), L::mul(a.z, b.z));
+}
+
+template <typename T>
+static LaneVec3<T> crossVec(const LaneVec3<T> &a, const LaneVec3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::sub(L::mul(a.y, b.z), L::mul(a.z, b.y));
+	v.y = L::sub(L::mul(a.z, b.x), L::mul(a.x, b.z));
+	v.z = L::sub(L::mul(a.x, b.y), L::mul(a.y, b.x));
+	return v;
+}
+
+template <typename T>
+static LaneVec3<T> selectVec(const typename SimdLanes<T>::mask &m, const LaneVec3<T> &a, const LaneVec3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> v;
+	v.x = L::select(m, a.x, b.x);
+	v.y = L::select(m, a.y, b.y);
+	v.z = L::select(m, a.z, b.z);
+	return v;
+}
+
+template <typename T>
+static LaneMat3<T> selectMat(const typename SimdLanes<T>::mask &m, const LaneMat3<T> &a, const LaneMat3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneMat3<T> r;
+	for (int c = 0; c < 3; ++c)
+	for (int i = 0; i < 3; ++i)
+		r.m[c][i] = L::select(m, a.m[c][i], b.m[c][i]);
+	return r;
+}
+
+// m * v
+template <typename T>
+static LaneVec3<T> mulMatVec(const LaneMat3<T> &m, const LaneVec3<T> &v)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> r;
+	typename L::reg *out[3] = { &r.x, &r.y, &r.z };
+	for (int i = 0; i < 3; ++i)
+		*out[i] = L::add(L::add(L::mul(m.m[0][i], v.x), L::mul(m.m[1][i], v.y)), L::mul(m.m[2][i], v.z));
+	return r;
+}
+
+// transpose(m) * v
+template <typename T>
+static LaneVec3<T> mulMatTransposeVec(const LaneMat3<T> &m, const LaneVec3<T> &v)
+{
+	typedef SimdLanes<T> L;
+	LaneVec3<T> r;
+	typename L::reg *out[3] = { &r.x, &r.y, &r.z };
+	for (int i = 0; i < 3; ++i)
+		*out[i] = L::add(L::add(L::mul(m.m[i][0], v.x), L::mul(m.m[i][1], v.y)), L::mul(m.m[i][2], v.z));
+	return r;
+}
+
+// a * b
+template <typename T>
+static LaneMat3<T> mulMat(const LaneMat3<T> &a, const LaneMat3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneMat3<T> r;
+	for (int c = 0; c < 3; ++c)
+	for (int i = 0; i < 3; ++i)
+		r.m[c][i] = L::add(L::add(L::mul(a.m[0][i], b.m[c][0]), L::mul(a.m[1][i], b.m[c][1])), L::mul(a.m[2][i], b.m[c][2]));
+	return r;
+}
+
+// transpose(a) * b
+template <typename T>
+static LaneMat3<T> mulMatTranspose(const LaneMat3<T> &a, const LaneMat3<T> &b)
+{
+	typedef SimdLanes<T> L;
+	LaneMat3<T> r;
+	for (int c = 0; c < 3; ++c)
+	for (int i = 0; i < 3; ++i)
+		r.m[c][i] = L::add(L::add(L::mul(a.m[i][0], b.m[c][0]), L::mul(a.m[i][1], b.m[c][1])), L::mul(a.m[i][2], b.m[c][2]));
+	return r;
+}
+
+// moving single lanes in and out, for the parts that are still done one lane at a time
+template <typename T>
+static vmath::mat3<T> getLane(const LaneMat3<T> &m, int lane)
+{
+	typedef SimdLanes<T> L;
+	vmath::mat3<T> r;
+	T buf[L::Width];
+	for (int c = 0; c < 3; ++c)
+	for (int i = 0; i < 3; ++i)
+	{
+		L::store(buf, m.m[c][i]);
+		r.elem[c][i] = buf[lane];
+	}
+	return r;
+}
+
+template <typename T>
+static void setLane(LaneMat3<T> &m, int lane, const vmath::mat3<T> &a)
+{
+	typedef SimdLanes<T> L;
+	T buf[L::Width];
+	for (int c = 0; c < 3; ++c)
+	for (int i = 0; i < 3; ++i)
+	{
+		L::store(buf, m.m[c][i]);
+		buf[lane] = a.elem[c][i];
+		m.m[c][i] = L::load(buf);
+	}
+}
+
+template <typename T>
+static vmath::vec3<T> getLane(const LaneVec3<T> &v, int lane)
+{
+	typedef SimdLanes<T> L;
+	T x[L::Width], y[L::Width], z[L::Width];
+	L::store(x, v.x);
+	L::store(y, v.y);
+	L::store(z, v.z);
+	return vmath::vec3<T>(x[lane], y[lane], z[lane]);
+}
+
+// ===== Lockstep CCD ========================================================
+
+template <typename T>
+int ikLaneWidth()
+{
+	return SimdLanes<T>::Width;
+}
+
+// the rotation taking the direction of tip onto the direction of target, for every lane
+// (see calcDirectRotation; this gives the same rotation, but without any trig:
+// R = c*I + [k]x + k*k'/(1 + c), where k = a x b and c = a . b for the unit vectors a, b)
+// lanes where no rotation is needed get the identity, and are flagged in 'identity'
+template <typename T>
+static LaneMat3<T> laneDirectRotation(const LaneVec3<T> &tip, const LaneVec3<T> &target, typename SimdLanes<T>::mask &identity)
+{
+	typedef SimdLanes<T> L;
+	typedef typename L::reg reg;
+	typedef typename L::mask mask;
+
+	const reg one = L::splat(T(1));
+	const reg zero = L::splat(T(0));
+
+	const reg lenSqrTip = dotVec(tip, tip);
+	const reg lenSqrTarget = dotVec(target, target);
+	const mask tooShort = L::either(L::lt(lenSqrTip, L::splat(T(0.001))), L::lt(lenSqrTarget, L::splat(T(0.001))));
+
+	const LaneVec3<T> a = scaleVec(tip, L::div(one, L::sqrt(lenSqrTip)));
+	const LaneVec3<T> b = scaleVec(target, L::div(one, L::sqrt(lenSqrTarget)));
+
+	const reg c = dotVec(a, b);
+	const LaneVec3<T> k = crossVec(a, b);
+
+	// same cut-off as calcDirectRotation: angles under 0.001 radians don't count
+	identity = L::either(tooShort, L::gt(c, L::splat(T(0.9999995))));
+
+	// 1/(1 + c) amplifies the rounding error in c as the angle grows (badly, in single precision),
+	// and the axis is arbitrary at 180 degrees; so lanes turning through more than 90 degrees
+	// (which is uncommon after the first sweep) are done the scalar way
+	const mask opposite = L::butNot(L::lt(c, L::splat(T(0))), identity);
+
+	const reg h = L::div(one, L::add(one, c));
+	const reg kx = k.x, ky = k.y, kz = k.z;
+
+	LaneMat3<T> R;
+	R.m[0][0] = L::add(c, L::mul(h, L::mul(kx, kx)));
+	R.m[0][1] = L::add(kz, L::mul(h, L::mul(ky, kx)));
+	R.m[0][2] = L::sub(L::mul(h, L::mul(kz, kx)), ky);
+	R.m[1][0] = L::sub(L::mul(h, L::mul(kx, ky)), kz);
+	R.m[1][1] = L::add(c, L::mul(h, L::mul(ky, ky)));
+	R.m[1][2] = L::add(kx, L::mul(h, L::mul(kz, ky)));
+	R.m[2][0] = L::add(ky, L::mul(h, L::mul(kx, kz)));
+	R.m[2][1] = L::sub(L::mul(h, L::mul(ky, kz)), kx);
+	R.m[2][2] = L::add(c, L::mul(h, L::mul(kz, kz)));
+
+	const int oppositeBits = L::bits(opposite);
+	if (oppositeBits)
+	{
+		for (int l = 0; l < L::Width; ++l)
+			if (oppositeBits & (1 << l))
+				setLane(R, l, calcDirectRotation(getLane(tip, l), getLane(target, l)));
+	}
+
+	LaneMat3<T> I;
+	for (int col = 0; col < 3; ++col)
+	for (int row = 0; row < 3; ++row)
+		I.m[col][row] = (row == col) ? one : zero;
+
+	return selectMat(identity, I, R);
+}
+
+template <typename T>
+static void laneStepCCD(const IkChainT<T> &chain, IkLaneStateT<T> &ls, const LaneVec3<T> &target, const typename SimdLanes<T>::mask &active, bool applyConstraints)
+{
+	typedef SimdLanes<T> L;
+	typedef typename L::mask mask;
+	const int W = L::Width;
+	const int n = chain.length();
+
+	LaneVec3<T> tip = loadVec(&ls.worldPos[0]);
+
+	// the first bone is the effector bone, so rotating it won't help; just skip it
+	for (int i = 1; i < n - 1; ++i)
+	{
+		const LaneMat3<T> worldRot = loadMat(&ls.worldRot[i*9*W]);
+		const LaneVec3<T> worldPos = loadVec(&ls.worldPos[i*3*W]);
+
+		// into bone space
+		const LaneVec3<T> originB = mulMatTransposeVec(worldRot, worldPos);
+		const LaneVec3<T> targetB = subVec(mulMatTransposeVec(worldRot, target), originB);
+		LaneVec3<T> tipB = subVec(mulMatTransposeVec(worldRot, tip), originB);
+
+		// see updateJointByIk
+		const LaneVec3<T> jointPos = splatVec(chain.jointPos[i]);
+		const LaneVec3<T> relTip = subVec(tipB, jointPos);
+		const LaneVec3<T> relTarget = subVec(targetB, jointPos);
+
+		mask identity;
+		LaneMat3<T> rot = laneDirectRotation(relTip, relTarget, identity);
+
+		// lanes which have converged, or don't need to move, are left alone
+		const mask moving = L::butNot(active, identity);
+		const int movingBits = L::bits(moving);
+		if (movingBits)
+		{
+			const LaneMat3<T> oldRot = loadMat(&ls.rot[i*9*W]);
+			LaneMat3<T> boneRot = mulMat(oldRot, rot);
+
+			if (applyConstraints)
+			{
+				const JointConstraints &cnst = *chain.constraints[i];
+				const bool reversed = (chain.reversed[i] != 0);
+				for (int l = 0; l < W; ++l)
+				{
+					if (!(movingBits & (1 << l)))
+						continue;
+
+					vmath::mat3<T> r = getLane(boneRot, l);
+					ikConstrainJoint(cnst, reversed, r, ls.stats);
+					setLane(boneRot, l, r);
+				}
+				rot = mulMatTranspose(oldRot, boneRot);
+			}
+
+			storeMat(&ls.rot[i*9*W], selectMat(moving, boneRot, oldRot));
+			tipB = selectVec(moving, addVec(jointPos, mulMatVec(rot, relTip)), tipB);
+		}
+
+		tip = addVec(mulMatVec(worldRot, tipB), worldPos);
+	}
+}
+
+// see ikUpdateChainTransforms
+template <typename T>
+static void laneUpdateChainTransforms(const IkChainT<T> &chain, IkLaneStateT<T> &ls, const LaneVec3<T> &rootPos)
+{
+	const int W = SimdLanes<T>::Width;
+	const int n = chain.length();
+
+	LaneMat3<T> worldRot = loadMat(&ls.rot[(n - 1)*9*W]);
+	LaneVec3<T> worldPos = rootPos;
+	storeMat(&ls.worldRot[(n - 1)*9*W], worldRot);
+	storeVec(&ls.worldPos[(n - 1)*3*W], worldPos);
+
+	for (int i = n - 2; i >= 0; --i)
+	{
+		const LaneVec3<T> base = addVec(mulMatVec(worldRot, splatVec(chain.nextJointPos[i])), worldPos);
+		worldRot = mulMat(worldRot, loadMat(&ls.rot[i*9*W]));
+		worldPos = addVec(mulMatVec(worldRot, splatVec(-chain.jointPos[i])), base);
+		storeMat(&ls.worldRot[i*9*W], worldRot);
+		storeVec(&ls.worldPos[i*3*W], worldPos);
+	}
+}
+
+template <typename T>
+void ikSolveLanes(
+	const IkChainT<T> &chain, int count,
+	IkBoneStateT<T> * const *states, const vmath::vec3<T> *targets, const vmath::vec3<T> *rootPositions,
+	int maxIterations, T threshold, T stallRate, bool applyConstraints,
+	IkLaneStateT<T> &ls)
+{
+	typedef SimdLanes<T> L;
+	typedef typename L::mask mask;
+	const int W = L::Width;
+	const int n = chain.length();
+
+	assert(count > 0 && count <= W);
+	if (n == 0) return;
+	IkPhaseTimer timer(ls.stats);
+
+	// gather the chain into the lanes
+	// (unused lanes are filled with copies of the first lane, to keep them finite; they're masked off anyway)
+	ls.rot.resize(n*9*W);
+	ls.worldRot.resize(n*9*W);
+	ls.worldPos.resize(n*3*W);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const int id = chain.boneIds[i];
+		for (int l = 0; l < W; ++l)
+		{
+			const IkBoneStateT<T> &bs = states[(l < count) ? l : 0][id];
+			for (int c = 0; c < 3; ++c)
+			for (int r = 0; r < 3; ++r)
+			{
+				ls.rot[(i*9 + c*3 + r)*W + l] = bs.rot.elem[c][r];
+				ls.worldRot[(i*9 + c*3 + r)*W + l] = bs.boneToWorld.elem[c][r];
+			}
+			for (int r = 0; r < 3; ++r)
+				ls.worldPos[(i*3 + r)*W + l] = bs.boneToWorld.elem[3][r];
+		}
+	}
+
+	T buf[3*W];
+	T laneIndex[W];
+	for (int l = 0; l < W; ++l)
+	{
+		const int src = (l < count) ? l : 0;
+		for (int r = 0; r < 3; ++r)
+			buf[r*W + l] = targets[src][r];
+		laneIndex[l] = T(l);
+	}
+	const LaneVec3<T> target = loadVec(buf);
+
+	for (int l = 0; l < W; ++l)
+	{
+		const int src = (l < count) ? l : 0;
+		for (int r = 0; r < 3; ++r)
+			buf[r*W + l] = rootPositions[src][r];
+	}
+	const LaneVec3<T> rootPos = loadVec(buf);
+
+	mask active = L::lt(L::load(laneIndex), L::splat(T(count)));
+
+	// each lane stops in the same way as a single instance (see IkConvergenceT), which is checked
+	// one lane at a time; lane l carries on while running[l] is 1
+	IkConvergenceT<T> convergence[W];
+	T running[W];
+	int iterations[W];
+	IkStopReason stops[W];
+	for (int l = 0; l < W; ++l)
+	{
+		T gap = T(0);
+		if (n >= 2)
+		{
+			// see ikReachGap
+			const int i = n - 2;
+			vmath::vec3<T> pivot;
+			for (int r = 0; r < 3; ++r)
+			{
+				pivot[r] = ls.worldPos[(i*3 + r)*W + l];
+				for (int c = 0; c < 3; ++c)
+					pivot[r] += ls.worldRot[(i*9 + c*3 + r)*W + l] * chain.jointPos[i][c];
+			}
+			const int src = (l < count) ? l : 0;
+			gap = std::max(T(0), length(targets[src] - pivot) - chain.reach);
+		}
+		convergence[l] = IkConvergenceT<T>(threshold, gap, stallRate);
+		running[l] = T(1);
+		iterations[l] = 0;
+		stops[l] = IkRanOut;
+	}
+	timer.mark(IkPhaseBuild);
+
+	for (int it = 0; (it < maxIterations) && L::bits(active); ++it)
+	{
+		laneStepCCD(chain, ls, target, active, applyConstraints);
+		timer.mark(IkPhaseStep);
+
+		laneUpdateChainTransforms(chain, ls, rootPos);
+		timer.mark(IkPhaseTransforms);
+
+		const LaneVec3<T> delta = subVec(loadVec(&ls.worldPos[0]), target);
+		L::store(buf, dotVec(delta, delta));
+		const int bits = L::bits(active);
+		for (int l = 0; l < count; ++l)
+		{
+			if (!(bits & (1 << l)))
+				continue;
+
+			++iterations[l];
+			if (convergence[l].update(std::sqrt(buf[l]), stops[l]))
+				running[l] = T(0);
+		}
+		active = L::butNot(active, L::lt(L::load(running), L::splat(T(1))));
+	}
+
+	// scatter the rotations back
+	for (int i = 0; i < n; ++i)
+	{
+		const int id = chain.boneIds[i];
+		for (int l = 0; l < count; ++l)
+		{
+			IkBoneStateT<T> &bs = states[l][id];
+			for (int c = 0; c < 3; ++c)
+			for (int r = 0; r < 3; ++r)
+				bs.rot.elem[c][r] = ls.rot[(i*9 + c*3 + r)*W + l];
+		}
+	}
+
+	if (ls.stats)
+	{
+		timer.mark(IkPhaseBuild);
+		for (int l = 0; l < count; ++l)
+		{
+			vmath::vec3<T> tip;
+			for (int r = 0; r < 3; ++r)
+				tip[r] = ls.worldPos[r*W + l];
+			ls.stats->addSolve(iterations[l], stops[l], length(tip - targets[l]));
+		}
+	}
+}
+
+// ===== Explicit Instantiations =============================================
+
+#define INSTANTIATE_IK_LANES(T) \
+	template int ikLaneWidth<T>(); \
+	template void ikSolveLanes( \
+		const IkChainT<T> &chain, int count, \
+		IkBoneStateT<T> * const *states, const vmath::vec3<T> *targets, const vmath::vec3<T> *rootPositions, \
+		int maxIterations, T threshold, T stallRate, bool applyConstraints, \
+		IkLaneStateT<T> &ls);
+
+INSTANTIATE_IK_LANES(float)
+INSTANTIATE_IK_LANES(double)
+
+#undef INSTANTIATE_IK_LANES
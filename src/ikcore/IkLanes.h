@@ -0,0 +1,50 @@
+#ifndef IK_LANES_H
+#define IK_LANES_H
+
+#include "IkKernel.h"
+
+// Lockstep CCD: several instances which share one chain are solved together,
+// one instance per SIMD lane (see SimdLanes.h for the lane widths).
+// Each lane runs the same sweep as ikStepCCD, but the direct rotation is built
+// without any trig (from the cross & dot products of the two unit vectors), so
+// the results match the scalar solver closely rather than exactly. Lanes which
+// have converged are masked off and stop changing, exactly as if each instance
+// had been solved on its own. Joint constraints are still applied one lane at a time.
+
+// the working set for one group of lanes: chain-ordered, as in IkChainState,
+// with the lanes interleaved (element e of chain entry i, lane l, is at [(i*K + e)*width + l]
+// where K is the number of elements per entry: 9 for a rotation, 3 for a position)
+template <typename T>
+struct IkLaneStateT
+{
+	std::vector<T> rot;
+	std::vector<T> worldRot;
+	std::vector<T> worldPos;
+
+	// the statistics the lanes add to, one solve per lane (see IkStats.h), or null if they aren't being gathered
+	IkStats *stats;
+
+	IkLaneStateT()
+	:	stats(0)
+	{}
+};
+
+typedef IkLaneStateT<double> IkLaneState;
+typedef IkLaneStateT<float> IkLaneStatef;
+
+// the number of instances that are solved together
+template <typename T>
+int ikLaneWidth();
+
+// solves instances [0, count) in lockstep (count <= ikLaneWidth<T>())
+// each lane stops as a single instance would (see IkConvergenceT)
+// instance l's bone states are at states[l]; only the rotations of the bones along
+// the chain are written, and the bone-to-world transforms are left stale
+template <typename T>
+void ikSolveLanes(
+	const IkChainT<T> &chain, int count,
+	IkBoneStateT<T> * const *states, const vmath::vec3<T> *targets, const vmath::vec3<T> *rootPositions,
+	int maxIterations, T threshold, T stallRate, bool applyConstraints,
+	IkLaneStateT<T> &ls);
+
+#endif
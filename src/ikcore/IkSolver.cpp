@@ -0,0 +1,1370 @@
+#include "CoreGlobal.h"
+#include "IkSolver.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+
+// ===== IkSolver ============================================================
+
+template <typename T>
+IkSolverT<T>::IkSolverT(const Skeleton &skel)
+:	skeleton(skel),
+	rootBone(0),
+	effectorBone(0),
+	mAnyStale(false),
+	mApplyConstraints(true),
+	mQuaternions(false),
+	mTwoBone(true),
+	mAlgorithm(IkCCD),
+	mDamping(T(0.1)),
+	targetPos(T(0), T(0), T(0)),
+	rootPos(T(0), T(0), T(0)),
+	targetRot(vmath::identityq<T>()),
+	mHasTargetRot(false),
+	mOrientationWeight(T(0.5)),
+	mStallRate(T(0)),
+	mLastStop(IkRanOut),
+	mWarmStart(false),
+	mWarmSolves(0),
+	mAvgIterations(T(0)),
+	mLastIterations(0)
+{
+	boneStates.resize(skeleton.numBones());
+	staleBones.resize(skeleton.numBones(), 0);
+	warmRot.resize(skeleton.numBones());
+	warmVel.resize(skeleton.numBones());
+	resetAll();
+}
+
+template <typename T>
+void IkSolverT<T>::resetAll()
+{
+	rootBone = &skeleton[0];
+	rootPos = convertVec<T>(rootBone->worldPos);
+	effectorBone = 0;
+	for (int i = 0; i < (int)skeleton.numBones(); ++i)
+	{
+		const Bone &b = skeleton[i];
+		if (skeleton.isEffector(b))
+		{
+			effectorBone = &b;
+			targetPos = convertVec<T>(b.worldPos);
+			break;
+		}
+	}
+	ikChain = IkChainT<T>();
+	removeExtraEffectors();
+	clearTargetRot();
+	
+	resetPose();
+}
+
+template <typename T>
+void IkSolverT<T>::resetPose()
+{
+	rootPos = convertVec<T>(rootBone->worldPos);
+	ikResetPose(skeleton, *rootBone, &boneStates[0]);
+
+	std::fill(staleBones.begin(), staleBones.end(), 0);
+	mAnyStale = false;
+
+	resetWarmStart();
+}
+
+template <typename T>
+void IkSolverT<T>::getPose(PoseT<T> &pose) const
+{
+	updateStaleTransforms();
+
+	// the solver's rotations are relative to its own tree, which only differs from the skeleton's tree
+	// along the path from its root to bone 0; the rotations along there are worked out again from the
+	// bone-to-world transforms, and the rest are copied as they are
+	std::vector<const Bone*> path;
+	skeleton.findPath(*rootBone, skeleton[0], path);
+	const bool reRooted = (path.size() > 1);
+
+	if (pose.numBones() != (int)skeleton.numBones())
+		pose.reset(skeleton);
+	for (int i = 0; i < (int)skeleton.numBones(); ++i)
+		pose.setRotation(i, vmath::mat_to_quat(boneStates[i].rot));
+
+	if (reRooted)
+	{
+		for (size_t k = 0; k < path.size(); ++k)
+		{
+			const int id = path[k]->id;
+			const int parent = skeleton.getTreeParent(id);
+			const mat3t rot = minor(boneStates[id].boneToWorld);
+			if (parent >= 0)
+				pose.setRotation(id, vmath::mat_to_quat(transpose(minor(boneStates[parent].boneToWorld)) * rot));
+			else
+				pose.setRotation(id, vmath::mat_to_quat(rot));
+		}
+	}
+
+	pose.setRootPos(boneStates[0].boneToWorld.translation());
+}
+
+template <typename T>
+void IkSolverT<T>::setPose(const PoseT<T> &pose)
+{
+	assert(pose.numBones() == (int)skeleton.numBones());
+
+	// the pose is rooted at bone 0; if the solver isn't, it's re-rooted as setRootBone would
+	pose.getBoneStates(skeleton, &boneStates[0]);
+	if (rootBone != &skeleton[0])
+	{
+		ikChangeRoot(skeleton, skeleton[0], *rootBone, &boneStates[0]);
+		rootPos = boneStates[rootBone->id].boneToWorld.translation();
+		updateBoneTransforms();
+	}
+	else
+	{
+		rootPos = pose.getRootPos();
+		std::fill(staleBones.begin(), staleBones.end(), 0);
+		mAnyStale = false;
+	}
+
+	resetWarmStart();
+}
+
+template <typename T>
+const typename IkSolverT<T>::vec3t &IkSolverT<T>::getTargetPos() const
+{
+	return targetPos;
+}
+
+template <typename T>
+const Bone &IkSolverT<T>::getRootBone() const
+{
+	assert(rootBone != 0);
+	return *rootBone;
+}
+
+template <typename T>
+const Bone &IkSolverT<T>::getEffector() const
+{
+	assert(effectorBone != 0);
+	return *effectorBone;
+}
+
+template <typename T>
+typename IkSolverT<T>::vec3t IkSolverT<T>::getEffectorPos() const
+{
+	assert(effectorBone != 0);
+	return getBoneState(*effectorBone).boneToWorld.translation();
+}
+
+template <typename T>
+int IkSolverT<T>::numEffectors() const
+{
+	return 1 + (int)extraEffectors.size();
+}
+
+template <typename T>
+int IkSolverT<T>::addEffector(const Bone &bone, const vec3t &target)
+{
+	extraEffectors.push_back(&bone);
+	extraTargets.push_back(target);
+	ikTree = IkTreeT<T>();
+	resetWarmStart();
+	return (int)extraEffectors.size();
+}
+
+template <typename T>
+void IkSolverT<T>::removeExtraEffectors()
+{
+	extraEffectors.clear();
+	extraTargets.clear();
+	ikTree = IkTreeT<T>();
+	resetWarmStart();
+}
+
+template <typename T>
+const Bone &IkSolverT<T>::getEffector(int idx) const
+{
+	assert(idx >= 0 && idx < numEffectors());
+	return (idx == 0) ? getEffector() : *extraEffectors[idx - 1];
+}
+
+template <typename T>
+typename IkSolverT<T>::vec3t IkSolverT<T>::getEffectorPos(int idx) const
+{
+	return getBoneState(getEffector(idx)).boneToWorld.translation();
+}
+
+template <typename T>
+const typename IkSolverT<T>::vec3t &IkSolverT<T>::getTargetPos(int idx) const
+{
+	assert(idx >= 0 && idx < numEffectors());
+	return (idx == 0) ? targetPos : extraTargets[idx - 1];
+}
+
+template <typename T>
+void IkSolverT<T>::setTargetPos(int idx, const vec3t &target)
+{
+	assert(idx >= 0 && idx < numEffectors());
+	if (idx == 0)
+		targetPos = target;
+	else
+		extraTargets[idx - 1] = target;
+}
+
+template <typename T>
+const typename IkSolverT<T>::vec3t &IkSolverT<T>::getRootPos() const
+{
+	return rootPos;
+}
+
+template <typename T>
+const Skeleton &IkSolverT<T>::getSkeleton() const
+{
+	return skeleton;
+}
+
+template <typename T>
+const typename IkSolverT<T>::mat4t &IkSolverT<T>::getBoneToWorld(const Bone &b) const
+{
+	return getBoneState(b).boneToWorld;
+}
+
+template <typename T>
+const typename IkSolverT<T>::mat3t &IkSolverT<T>::getBoneRotation(const Bone &b) const
+{
+	return boneStates[b.id].rot;
+}
+
+template <typename T>
+void IkSolverT<T>::setTargetPos(const vec3t &target)
+{
+	targetPos = target;
+}
+
+template <typename T>
+bool IkSolverT<T>::hasTargetRot() const
+{
+	return mHasTargetRot;
+}
+
+template <typename T>
+const typename IkSolverT<T>::quatt &IkSolverT<T>::getTargetRot() const
+{
+	return targetRot;
+}
+
+template <typename T>
+void IkSolverT<T>::setTargetRot(const quatt &rot)
+{
+	targetRot = rot;
+	mHasTargetRot = true;
+}
+
+template <typename T>
+void IkSolverT<T>::clearTargetRot()
+{
+	targetRot = vmath::identityq<T>();
+	mHasTargetRot = false;
+}
+
+template <typename T>
+T IkSolverT<T>::getOrientationWeight() const
+{
+	return mOrientationWeight;
+}
+
+template <typename T>
+void IkSolverT<T>::setOrientationWeight(T weight)
+{
+	mOrientationWeight = clamp(T(0), T(1), weight);
+}
+
+template <typename T>
+void IkSolverT<T>::setRootBone(const Bone &bone)
+{
+	// early out if we're not changing anything
+	if (rootBone == &bone) return;
+
+	// clear the existing IK chain
+	ikChain = IkChainT<T>();
+	ikTree = IkTreeT<T>();
+
+	// re-rooting works from the current transforms
+	updateStaleTransforms();
+
+	// the relative rotations along the path to the new root need to be reversed
+	ikChangeRoot(skeleton, *rootBone, bone, &boneStates[0]);
+
+	// set the new root, and its correct position
+	rootBone = &bone;
+	rootPos = boneStates[bone.id].boneToWorld.translation();
+	
+	updateBoneTransforms();
+	resetWarmStart();
+}
+
+template <typename T>
+void IkSolverT<T>::setEffector(const Bone &bone)
+{
+	effectorBone = &bone;
+	ikChain = IkChainT<T>();
+	ikTree = IkTreeT<T>();
+	resetWarmStart();
+}
+
+template <typename T>
+bool IkSolverT<T>::areConstraintsEnabled() const
+{
+	return mApplyConstraints;
+}
+
+template <typename T>
+void IkSolverT<T>::enableConstraints(bool enabled)
+{
+	mApplyConstraints = enabled;
+}
+
+template <typename T>
+bool IkSolverT<T>::areQuaternionsEnabled() const
+{
+	return mQuaternions;
+}
+
+template <typename T>
+void IkSolverT<T>::enableQuaternions(bool enabled)
+{
+	mQuaternions = enabled;
+}
+
+template <typename T>
+bool IkSolverT<T>::isTwoBoneEnabled() const
+{
+	return mTwoBone;
+}
+
+template <typename T>
+void IkSolverT<T>::enableTwoBone(bool enabled)
+{
+	mTwoBone = enabled;
+}
+
+template <typename T>
+IkAlgorithm IkSolverT<T>::getAlgorithm() const
+{
+	return mAlgorithm;
+}
+
+template <typename T>
+void IkSolverT<T>::setAlgorithm(IkAlgorithm algorithm)
+{
+	mAlgorithm = algorithm;
+}
+
+template <typename T>
+T IkSolverT<T>::getDamping() const
+{
+	return mDamping;
+}
+
+template <typename T>
+void IkSolverT<T>::setDamping(T damping)
+{
+	mDamping = damping;
+}
+
+template <typename T>
+T IkSolverT<T>::getStallRate() const
+{
+	return mStallRate;
+}
+
+template <typename T>
+void IkSolverT<T>::setStallRate(T rate)
+{
+	mStallRate = clamp(T(0), T(1), rate);
+}
+
+template <typename T>
+IkStopReason IkSolverT<T>::getLastStopReason() const
+{
+	return mLastStop;
+}
+
+template <typename T>
+bool IkSolverT<T>::isWarmStartEnabled() const
+{
+	return mWarmStart;
+}
+
+template <typename T>
+void IkSolverT<T>::enableWarmStart(bool enabled)
+{
+	if (mWarmStart != enabled)
+		resetWarmStart();
+	mWarmStart = enabled;
+}
+
+template <typename T>
+int IkSolverT<T>::getLastIterations() const
+{
+	return mLastIterations;
+}
+
+template <typename T>
+T IkSolverT<T>::getAverageIterations() const
+{
+	return mAvgIterations;
+}
+
+template <typename T>
+bool IkSolverT<T>::areStatsEnabled() const
+{
+	return chainState.stats != 0;
+}
+
+template <typename T>
+void IkSolverT<T>::enableStats(bool enabled)
+{
+	chainState.stats = enabled ? &mStats : 0;
+}
+
+template <typename T>
+const IkStats &IkSolverT<T>::getStats() const
+{
+	return mStats;
+}
+
+template <typename T>
+void IkSolverT<T>::resetStats()
+{
+	mStats.reset();
+}
+
+template <typename T>
+void IkSolverT<T>::solveIk(int maxIterations, T threshold)
+{
+	solve(maxIterations, threshold, mWarmStart);
+}
+
+template <typename T>
+void IkSolverT<T>::solve(int maxIterations, T threshold, bool warm)
+{
+	if (warm)
+		maxIterations = warmBudget(maxIterations);
+
+	if (!extraEffectors.empty())
+		solveTree(maxIterations, threshold, warm);
+	else
+		solveChain(maxIterations, threshold, warm);
+}
+
+template <typename T>
+void IkSolverT<T>::solveChain(int maxIterations, T threshold, bool warm)
+{
+	IkPhaseTimer timer(chainState.stats);
+	buildChain();
+
+	// the chain's own transforms are needed to start from
+	// (after a previous solve along the same chain, they'll already be up to date)
+	for (int i = 0; mAnyStale && (i < ikChain.length()); ++i)
+	{
+		if (staleBones[ikChain.boneIds[i]])
+			updateStaleTransforms();
+	}
+
+	// the chain is solved in its own (chain-ordered) working set,
+	// and only the chain's transforms are kept up to date between iterations
+	// (the orientation target is solved for with matrices, so it rules out quaternion CCD)
+	const bool orient = mHasTargetRot;
+	mat3t targetRotM = orient ? vmath::quat_to_mat3(normalize(targetRot)) : mat3t(T(1));
+	vec3t chainTarget = targetPos;
+	if (ikChain.boneIds[0] != effectorBone->id)
+	{
+		// the chain ends at the bone that a tip is fixed to (see chainEffector), so the bone's target is the
+		// orientation and position that put the tip on its target
+		const mat4t &boneToWorld = boneStates[ikChain.boneIds[0]].boneToWorld;
+		const mat4t &tipToWorld = getBoneState(*effectorBone).boneToWorld;
+		const mat3t boneRot(boneToWorld);
+		const mat3t fixedRot = transpose(boneRot) * mat3t(tipToWorld);
+		const vec3t offset = (tipToWorld.translation() - boneToWorld.translation()) * boneRot;
+		targetRotM = targetRotM * transpose(fixedRot);
+		chainTarget = targetPos - targetRotM * offset;
+	}
+	const bool quaternions = mQuaternions && (mAlgorithm == IkCCD) && !orient;
+	ikLoadChain(ikChain, &boneStates[0], chainState);
+
+	// a two-bone chain can be solved outright; if the constraints get in the way, iterating carries on from there
+	// (the effector's own joint isn't part of the two-bone solution, so it can take up the orientation afterwards)
+	const bool twoBone = mTwoBone && (maxIterations > 0) && ikIsTwoBoneChain(ikChain);
+
+	// otherwise, a warm start carries on from where the last frame was heading, unless that's further off
+	if (warm && !twoBone && warmExtrapolate(ikChain.boneIds, ikChain.constraints, ikChain.reversed))
+	{
+		const vec3t before = chainState.worldPos[0] - chainTarget;
+		ikUpdateChainTransforms(ikChain, rootPos, chainState);
+		const vec3t after = chainState.worldPos[0] - chainTarget;
+		if (dot(after, after) > dot(before, before))
+		{
+			warmRestore(ikChain.length());
+			ikUpdateChainTransforms(ikChain, rootPos, chainState);
+		}
+	}
+
+	// an unreachable target is as good as reached once the chain gets as close to it as it can (the root
+	// doesn't move, so that's known up front), and the iterations stop early if they stall (see IkConvergenceT)
+	IkConvergenceT<T> convergence(threshold, ikReachGap(ikChain, chainState, chainTarget), mStallRate);
+	mLastStop = IkRanOut;
+	timer.mark(IkPhaseBuild);
+
+	bool solved = false;
+	if (twoBone)
+	{
+		solved = ikSolveTwoBone(ikChain, chainState, chainTarget, mApplyConstraints);
+		if (orient)
+			solved = ikAlignEffector(ikChain, chainState, targetRotM, mApplyConstraints) && solved;
+		if (solved)
+			mLastStop = (convergence.gap > T(0)) ? IkReachedClosest : IkReachedTarget;
+		timer.mark(IkPhaseStep);
+	}
+
+	if (quaternions)
+		ikLoadChainQuat(chainState);
+
+	int iterations = 0;
+	while (!solved && (iterations < maxIterations))
+	{
+		++iterations;
+		if (mAlgorithm == IkFABRIK)
+		{
+			// FABRIK keeps the chain's transforms up to date itself
+			ikStepFABRIK(ikChain, chainState, chainTarget, mApplyConstraints);
+			timer.mark(IkPhaseStep);
+		}
+		else
+		{
+			if (mAlgorithm != IkCCD)
+				ikStepJacobian(mAlgorithm, ikChain, chainState, jacobianState, chainTarget, mDamping, mApplyConstraints);
+			else if (orient)
+				ikStepCCDOrient(ikChain, chainState, chainTarget, targetRotM, mOrientationWeight, mApplyConstraints);
+			else if (quaternions) // perform basic CCD
+				ikStepCCDQuat(ikChain, chainState, chainTarget, mApplyConstraints);
+			else
+				ikStepCCD(ikChain, chainState, chainTarget, mApplyConstraints);
+			timer.mark(IkPhaseStep);
+
+			ikUpdateChainTransforms(ikChain, rootPos, chainState);
+			timer.mark(IkPhaseTransforms);
+		}
+
+		// the other algorithms only solve for the position, but the effector's own joint can still line it up
+		if (orient && (mAlgorithm != IkCCD))
+		{
+			ikAlignEffector(ikChain, chainState, targetRotM, mApplyConstraints);
+			timer.mark(IkPhaseStep);
+		}
+
+		// (the orientation error is roughly the square of the angle, so the threshold is in radians)
+		IkStopReason reason;
+		if (convergence.update(length(chainState.worldPos[0] - chainTarget), reason) &&
+			(!orient || (reason == IkStalled) || (ikOrientationError(chainState.worldRot[0], targetRotM) < threshold*threshold)))
+		{
+			mLastStop = reason;
+			solved = true;
+		}
+	}
+
+	mLastIterations = iterations;
+	if (warm)
+		warmRecord(ikChain.boneIds, iterations);
+	if (chainState.stats)
+		mStats.addSolve(iterations, mLastStop, length(chainState.worldPos[0] - chainTarget));
+
+	// the transforms along the chain are brought up to date straight away (so the effector position
+	// is available, and the next solve can start from them); everything else below the bones that moved
+	// is left stale until it's read
+	const int last = ikStoreChain(ikChain, chainState, &boneStates[0]);
+	timer.mark(IkPhaseBuild);
+	if (last >= 0)
+	{
+		ikUpdateChainBoneTransforms(skeleton, ikChain, last, rootPos, &boneStates[0], &staleBones[0]);
+		mAnyStale = true;
+		timer.mark(IkPhaseTransforms);
+	}
+}
+
+template <typename T>
+void IkSolverT<T>::solveTree(int maxIterations, T threshold, bool warm)
+{
+	IkPhaseTimer timer(chainState.stats);
+	if (ikTree.length() == 0)
+	{
+		treeEffectors.assign(1, effectorBone);
+		treeEffectors.insert(treeEffectors.end(), extraEffectors.begin(), extraEffectors.end());
+		ikBuildTree(skeleton, *rootBone, &treeEffectors[0], (int)treeEffectors.size(), ikTree);
+		treeChanged.resize(ikTree.length());
+	}
+
+	// see solveIk
+	for (int i = 0; mAnyStale && (i < ikTree.length()); ++i)
+	{
+		if (staleBones[ikTree.boneIds[i]])
+			updateStaleTransforms();
+	}
+
+	treeTargets.assign(1, targetPos);
+	treeTargets.insert(treeTargets.end(), extraTargets.begin(), extraTargets.end());
+	ikLoadTree(ikTree, &boneStates[0], chainState);
+
+	const int effectors = (int)ikTree.effectorNodes.size();
+	if (warm && warmExtrapolate(ikTree.boneIds, ikTree.constraints, ikTree.reversed))
+	{
+		// see solveChain, with the total squared distance of the effectors from their targets
+		T before = T(0), after = T(0);
+		for (int e = 0; e < effectors; ++e)
+		{
+			vec3t delta = chainState.worldPos[ikTree.effectorNodes[e]] - treeTargets[ikTree.effectorIndices[e]];
+			before += dot(delta,delta);
+		}
+		ikUpdateTreeTransforms(ikTree, rootPos, chainState);
+		for (int e = 0; e < effectors; ++e)
+		{
+			vec3t delta = chainState.worldPos[ikTree.effectorNodes[e]] - treeTargets[ikTree.effectorIndices[e]];
+			after += dot(delta,delta);
+		}
+		if (after > before)
+		{
+			warmRestore(ikTree.length());
+			ikUpdateTreeTransforms(ikTree, rootPos, chainState);
+		}
+	}
+
+	// the effectors share joints, so the reach of each one on its own doesn't say much;
+	// only the total distance is watched for stalling (see IkConvergenceT)
+	IkConvergenceT<T> convergence(T(0), T(0), mStallRate);
+	mLastStop = IkRanOut;
+	timer.mark(IkPhaseBuild);
+
+	bool solved = false;
+	int iterations = 0;
+	while (!solved && (iterations < maxIterations))
+	{
+		++iterations;
+		ikStepCCDTree(ikTree, chainState, &treeTargets[0], mApplyConstraints);
+		timer.mark(IkPhaseStep);
+		ikUpdateTreeTransforms(ikTree, rootPos, chainState);
+		timer.mark(IkPhaseTransforms);
+
+		bool reached = true;
+		T total = T(0);
+		for (int e = 0; e < effectors; ++e)
+		{
+			const T dist = length(chainState.worldPos[ikTree.effectorNodes[e]] - treeTargets[ikTree.effectorIndices[e]]);
+			reached = reached && (dist < threshold);
+			total += dist;
+		}
+
+		IkStopReason reason = IkReachedTarget;
+		if (reached || convergence.update(total, reason))
+		{
+			mLastStop = reason;
+			solved = true;
+		}
+	}
+
+	mLastIterations = iterations;
+	if (warm)
+		warmRecord(ikTree.boneIds, iterations);
+	if (chainState.stats)
+	{
+		T total = T(0);
+		for (int e = 0; e < effectors; ++e)
+			total += length(chainState.worldPos[ikTree.effectorNodes[e]] - treeTargets[ikTree.effectorIndices[e]]);
+		mStats.addSolve(iterations, mLastStop, total);
+	}
+
+	const bool changed = (ikStoreTree(ikTree, chainState, &boneStates[0], &treeChanged[0]) > 0);
+	timer.mark(IkPhaseBuild);
+	if (changed)
+	{
+		ikUpdateTreeBoneTransforms(skeleton, ikTree, rootPos, &treeChanged[0], &boneStates[0], &staleBones[0]);
+		mAnyStale = true;
+		timer.mark(IkPhaseTransforms);
+	}
+}
+
+template <typename T>
+void IkSolverT<T>::iterateIk()
+{
+	solve(1, T(0), false);
+}
+
+template <typename T>
+int IkSolverT<T>::warmBudget(int maxIterations) const
+{
+	// twice what the recent solves have needed, and a few to spare; a solve that runs out has needed
+	// more than the average, so the budget soon grows again when the target starts moving faster
+	// (and a solve that's cut short carries on from where it got to next time)
+	if (mWarmSolves == 0)
+		return maxIterations;
+	return std::min(maxIterations, std::max(4, (int)(T(2)*mAvgIterations) + 1));
+}
+
+template <typename T>
+bool IkSolverT<T>::warmExtrapolate(const std::vector<int> &boneIds, const std::vector<const JointConstraints*> &constraints, const std::vector<char> &reversed)
+{
+	// the working set (in chain or tree order) has just been loaded; the root doesn't turn
+	const int n = (int)boneIds.size();
+	startRot.assign(chainState.rot.begin(), chainState.rot.begin() + n);
+
+	bool moved = false;
+	for (int i = 0; i < n - 1; ++i)
+	{
+		// only a bone that's been left where the last solve put it carries on
+		const int id = boneIds[i];
+		if ((chainState.rot[i] != warmRot[id]) || (warmVel[id] == vmath::identityq<T>()))
+			continue;
+
+		mat3t &boneRot = chainState.rot[i];
+		boneRot = boneRot * vmath::quat_to_mat3(warmVel[id]);
+		if (mApplyConstraints)
+			ikConstrainJoint(*constraints[i], reversed[i] != 0, boneRot, chainState.stats);
+		moved = true;
+	}
+	return moved;
+}
+
+template <typename T>
+void IkSolverT<T>::warmRestore(int n)
+{
+	std::copy(startRot.begin(), startRot.begin() + n, chainState.rot.begin());
+}
+
+template <typename T>
+void IkSolverT<T>::warmRecord(const std::vector<int> &boneIds, int iterations)
+{
+	// (if warmExtrapolate didn't get as far as saving the starting rotations, nothing turned)
+	const int n = (int)boneIds.size();
+	if ((int)startRot.size() < n)
+		startRot.assign(chainState.rot.begin(), chainState.rot.begin() + n);
+
+	for (int i = 0; i < n - 1; ++i)
+	{
+		const int id = boneIds[i];
+		warmVel[id] = normalize(vmath::mat_to_quat(transpose(startRot[i]) * chainState.rot[i]));
+		warmRot[id] = chainState.rot[i];
+	}
+	startRot.clear();
+
+	mAvgIterations = (mWarmSolves == 0) ? T(iterations) : mAvgIterations + (T(iterations) - mAvgIterations) * T(0.25);
+	++mWarmSolves;
+}
+
+template <typename T>
+void IkSolverT<T>::resetWarmStart()
+{
+	std::fill(warmRot.begin(), warmRot.end(), mat3t(T(1)));
+	std::fill(warmVel.begin(), warmVel.end(), vmath::identityq<T>());
+	mWarmSolves = 0;
+	mAvgIterations = T(0);
+}
+
+template <typename T>
+const Bone &IkSolverT<T>::chainEffector() const
+{
+	// the tip bones that the skeleton adds to mark the end of a bone (see Skeleton::loadFromFile) have no length,
+	// and are fixed to that bone; turning one about its own joint wouldn't show, so an orientation target for it
+	// is solved for on the bone it's fixed to instead, which carries the tip with it
+	const Bone *parent = skeleton.getParent(*effectorBone);
+	if (mHasTargetRot && parent && (effectorBone != rootBone) && (effectorBone->constraints.type == JointConstraints::Fixed) &&
+		(effectorBone->displayVec == vec3d(0.0, 0.0, 0.0)))
+		return *parent;
+	return *effectorBone;
+}
+
+template <typename T>
+void IkSolverT<T>::buildChain()
+{
+	const Bone &end = chainEffector();
+	if ((ikChain.length() == 0) || (ikChain.boneIds[0] != end.id))
+		ikBuildChain(skeleton, *rootBone, end, ikChain);
+}
+
+template <typename T>
+void IkSolverT<T>::applyAllConstraints()
+{
+	ikApplyAllConstraints(skeleton, *rootBone, &boneStates[0]);
+	updateBoneTransforms();
+}
+
+template <typename T>
+void IkSolverT<T>::updateBoneTransforms()
+{
+	assert(rootBone != 0);
+	ikUpdateBoneTransforms(skeleton, *rootBone, rootPos, &boneStates[0]);
+
+	std::fill(staleBones.begin(), staleBones.end(), 0);
+	mAnyStale = false;
+}
+
+template <typename T>
+void IkSolverT<T>::updateStaleTransforms() const
+{
+	if (!mAnyStale)
+		return;
+
+	assert(rootBone != 0);
+	ikUpdateStaleTransforms(skeleton, *rootBone, rootPos, &boneStates[0], &staleBones[0]);
+	mAnyStale = false;
+}
+
+template <typename T>
+const typename IkSolverT<T>::BoneState &IkSolverT<T>::getBoneState(const Bone &b) const
+{
+	if (staleBones[b.id])
+		updateStaleTransforms();
+	return boneStates[b.id];
+}
+
+template <typename T>
+bool IkSolverT<T>::isAngleInRange(T minA, T maxA, T a) const
+{
+	assert(minA >= -M_PI && minA < M_PI);
+	assert(maxA >= -M_PI && maxA < M_PI);
+	assert(minA <= maxA);
+
+	while (a < T(-M_PI)) a += T(2.0*M_PI);
+	while (a >= T(M_PI)) a -= T(2.0*M_PI);
+	return (minA <= a) && (a < maxA);
+}
+
+// ===== Test Helpers ========================================================
+
+void testEffectors(const Skeleton &skel, std::vector<const Bone*> &effectors)
+{
+	effectors.clear();
+	for (int i = 0; i < (int)skel.numBones(); ++i)
+	{
+		if (skel.isEffector(skel[i]))
+			effectors.push_back(&skel[i]);
+	}
+}
+
+vec3d testTarget(const Bone &b, int j, double scale)
+{
+	const double r = scale * (j + 1);
+	return b.worldPos + vec3d(r*std::cos(j*0.7), r*std::sin(j*1.3), r*std::cos(j*2.1));
+}
+
+// ===== Precision Test ======================================================
+
+void testSinglePrecisionSolver(const Skeleton &skel)
+{
+	IkSolver solver(skel);
+	IkSolverf solverf(skel);
+
+	// a single CCD sweep should agree closely (the az/el/twist decomposition
+	// goes through acos, so float loses a few more digits than you'd expect)
+	const double stepThreshold = 0.001;
+	(void)stepThreshold;
+
+	// CCD with constraints isn't a contraction, so over a full solve the rounding
+	// differences can send the two down slightly different paths; they should
+	// still end up within a small fraction of a bone length of each other
+	const double solveThreshold = 0.05;
+	(void)solveThreshold;
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (size_t e = 0; e < effectors.size(); ++e)
+	{
+		const Bone &eff = *effectors[e];
+		for (int j = 0; j < 8; ++j)
+		{
+			solver.resetAll();
+			solverf.resetAll();
+			solver.setEffector(eff);
+			solverf.setEffector(eff);
+
+			// targets around the effector's rest position, some of them out of reach
+			const vec3d target = testTarget(eff, j, 0.25);
+			solver.setTargetPos(target);
+			solverf.setTargetPos(convertVec<float>(target));
+
+			solver.iterateIk();
+			solverf.iterateIk();
+
+			vec3d delta = solver.getEffectorPos() - convertVec<double>(solverf.getEffectorPos());
+			assert(length(delta) < stepThreshold);
+
+			solver.solveIk(30);
+			solverf.solveIk(30);
+
+			delta = solver.getEffectorPos() - convertVec<double>(solverf.getEffectorPos());
+			assert(length(delta) < solveThreshold);
+		}
+	}
+}
+
+// ===== Multi-Effector Test ================================================
+
+void testMultiEffectorSolver(const Skeleton &skel)
+{
+	std::vector<IkBoneState> states(skel.numBones());
+	IkChain chain;
+	IkTree tree;
+	IkChainState chainState, treeState;
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (size_t e = 0; e < effectors.size(); ++e)
+	{
+		const Bone *eff = effectors[e];
+
+		// with a single effector, the tree sweep is the same as the chain sweep
+		ikResetPose(skel, skel[0], &states[0]);
+		ikBuildChain(skel, skel[0], *eff, chain);
+		ikBuildTree(skel, skel[0], &eff, 1, tree);
+		ikLoadChain(chain, &states[0], chainState);
+		ikLoadTree(tree, &states[0], treeState);
+
+		const vec3d target = eff->worldPos + vec3d(0.5, -0.5, 0.25);
+		for (int j = 0; j < 4; ++j)
+		{
+			ikStepCCD(chain, chainState, target, true);
+			ikUpdateChainTransforms(chain, vec3d(skel[0].worldPos), chainState);
+			ikStepCCDTree(tree, treeState, &target, true);
+			ikUpdateTreeTransforms(tree, vec3d(skel[0].worldPos), treeState);
+			assert(length(chainState.worldPos[0] - treeState.worldPos[tree.effectorNodes[0]]) < 1e-9);
+		}
+	}
+
+	IkSolver solver(skel);
+	solver.enableConstraints(false);
+	for (size_t p = 0; p < effectors.size(); ++p)
+	{
+		const Bone &pinned = *effectors[p];
+		for (size_t m = 0; m < effectors.size(); ++m)
+		{
+			const Bone &moved = *effectors[m];
+			if (m == p)
+				continue;
+
+			solver.resetAll();
+			solver.setEffector(moved);
+			solver.addEffector(pinned, pinned.worldPos);
+
+			const vec3d offset(0.2, 0.3, -0.1);
+			solver.setTargetPos(moved.worldPos + offset);
+			solver.solveIk(100);
+
+			const double pinnedError = length(solver.getEffectorPos(1) - pinned.worldPos);
+			const double movedError = length(solver.getEffectorPos(0) - solver.getTargetPos(0));
+			(void)pinnedError; (void)movedError;
+
+			// effectors whose chains only meet at the root don't affect each other at all;
+			// otherwise they share the error, but shouldn't make it any worse
+			if (skel.findCommonAncestor(pinned.id, moved.id) == 0)
+				assert(pinnedError < 1e-9);
+			assert(pinnedError*pinnedError + movedError*movedError <= dot(offset, offset) + 1e-9);
+		}
+	}
+}
+
+// ===== Orientation Test ==================================================
+
+void testOrientationTargets(const Skeleton &skel)
+{
+	IkSolver posed(skel);
+	IkSolver solver(skel);
+
+	// with the orientation held, the position can creep in slowly enough to count as stalling
+	solver.setStallRate(0);
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (int con = 0; con < 2; ++con)
+	{
+		posed.enableConstraints(con != 0);
+		solver.enableConstraints(con != 0);
+
+		double startError = 0.0, endError = 0.0, startDistance = 0.0, endDistance = 0.0;
+		for (size_t e = 0; e < effectors.size(); ++e)
+		{
+			// the effectors are tips, which only mark the end of the bone they're fixed to, so it's that bone
+			// that has to line up
+			const Bone &eff = *effectors[e];
+			const Bone &bone = *skel.getParent(eff);
+			for (int j = 0; j < 8; ++j)
+			{
+				// pose the skeleton for a reachable target, and take the effector's transform from it
+				// (with the constraints, both solves start from the rest pose brought within them)
+				posed.resetAll();
+				if (con != 0)
+					posed.applyAllConstraints();
+				posed.setEffector(eff);
+				posed.setTargetPos(testTarget(eff, j, 0.25));
+				posed.solveIk(100);
+
+				const vec3d target = posed.getEffectorPos();
+				const mat3d targetRot(posed.getBoneToWorld(eff));
+				const mat3d boneRot(posed.getBoneToWorld(bone));
+				solver.resetAll();
+				if (con != 0)
+					solver.applyAllConstraints();
+				solver.setEffector(eff);
+				solver.setTargetPos(target);
+				solver.setTargetRot(vmath::mat_to_quat(targetRot));
+				startError += ikOrientationError(mat3d(solver.getBoneToWorld(bone)), boneRot);
+				startDistance += length(solver.getEffectorPos() - target);
+				solver.solveIk(100);
+				const double error = ikOrientationError(mat3d(solver.getBoneToWorld(bone)), boneRot);
+				const double distance = length(solver.getEffectorPos() - target);
+				endError += error;
+				endDistance += distance;
+
+				// unconstrained, the bone lines up exactly, carrying the tip with it, and the position is found
+				// as well (to within the joints' smallest turn, scaled by the effector's distance from the root)
+				if (con == 0)
+				{
+					assert(ikOrientationError(mat3d(solver.getBoneToWorld(eff)), targetRot) < 1e-6);
+					assert(error < 1e-6);
+					assert(distance < 0.01 * length(eff.worldPos - skel[0].worldPos));
+				}
+			}
+		}
+
+		// with them, a solve can get caught where the joints' limits stop it lining the bone up without giving
+		// up some of the position, but most aren't, so the effectors still get most of the way
+		if (con != 0)
+		{
+			assert(endError < 0.3 * startError);
+			assert(endDistance < 0.15 * startDistance);
+		}
+	}
+}
+
+// ===== Two-Bone Test ======================================================
+
+void testTwoBoneSolver(const Skeleton &skel)
+{
+	IkSolver iterative(skel);
+	IkSolver analytic(skel);
+	iterative.enableConstraints(false);
+	analytic.enableConstraints(false);
+	iterative.enableTwoBone(false);
+
+	for (int i = 0; i < (int)skel.numBones(); ++i)
+	{
+		// every bone with three ancestors can be the effector of a two-bone chain
+		const Bone &eff = skel[i];
+		const Bone *root = &eff;
+		for (int k = 0; (k < 3) && root; ++k)
+			root = skel.getParent(*root);
+		if (!root)
+			continue;
+
+		for (int j = 0; j < 8; ++j)
+		{
+			iterative.resetAll();
+			analytic.resetAll();
+			iterative.setRootBone(*root);
+			analytic.setRootBone(*root);
+			iterative.setEffector(eff);
+			analytic.setEffector(eff);
+
+			// some of the targets are out of reach; in that case the analytic solution is still
+			// the closest the chain can get, so it should be no worse than iterating
+			const vec3d target = testTarget(eff, j, 0.5);
+			iterative.setTargetPos(target);
+			iterative.solveIk(200, 1e-9);
+
+			analytic.setTargetPos(target);
+			analytic.solveIk(1);
+			assert(length(analytic.getEffectorPos() - target) < length(iterative.getEffectorPos() - target) + 1e-6);
+
+			// and the iterative solution is reachable, so one analytic pass should reach it
+			const vec3d reachable = iterative.getEffectorPos();
+			analytic.resetPose();
+			analytic.setTargetPos(reachable);
+			analytic.solveIk(1);
+			assert(length(analytic.getEffectorPos() - reachable) < 1e-6);
+		}
+	}
+}
+
+// ===== Jacobian Test =======================================================
+
+void testJacobianSolver(const Skeleton &skel)
+{
+	IkSolver posed(skel);
+	IkSolver solver(skel);
+	posed.enableConstraints(false);
+	solver.enableConstraints(false);
+	solver.enableTwoBone(false);
+	solver.enableStats();
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	const IkAlgorithm algorithms[] = { IkPseudoInverse, IkDampedLeastSquares };
+	for (int a = 0; a < 2; ++a)
+	{
+		solver.setAlgorithm(algorithms[a]);
+		solver.resetStats();
+		for (size_t e = 0; e < effectors.size(); ++e)
+		{
+			const Bone &eff = *effectors[e];
+			for (int j = 0; j < 8; ++j)
+			{
+				// the targets can be reached, because a solve has reached them
+				posed.resetAll();
+				posed.setEffector(eff);
+				posed.setTargetPos(testTarget(eff, j, 0.25));
+				posed.solveIk(100);
+
+				solver.resetAll();
+				solver.setEffector(eff);
+				solver.setTargetPos(posed.getEffectorPos());
+				solver.solveIk(16);
+			}
+		}
+
+		// the steps are Newton-like, so every target is reached well within the 16 iterations allowed, and
+		// most in a handful (the damping slows least squares down a little as it closes in, but only a little)
+		const IkStats &stats = solver.getStats();
+		(void)stats;
+		assert(stats.stops[IkReachedTarget] == stats.solves);
+		assert(stats.meanIterations() < 8.0);
+	}
+}
+
+// ===== FABRIK Test =========================================================
+
+void testFABRIKSolver(const Skeleton &skel)
+{
+	IkSolver posed(skel);
+	IkSolver fabrik(skel);
+	fabrik.setAlgorithm(IkFABRIK);
+	fabrik.enableTwoBone(false);
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (int con = 0; con < 2; ++con)
+	{
+		posed.enableConstraints(con != 0);
+		fabrik.enableConstraints(con != 0);
+
+		double startDistance = 0.0, endDistance = 0.0;
+		for (size_t e = 0; e < effectors.size(); ++e)
+		{
+			const Bone &eff = *effectors[e];
+			for (int j = 0; j < 8; ++j)
+			{
+				// the targets can be reached (with the constraints as they are), because a solve has reached them
+				posed.resetAll();
+				posed.setEffector(eff);
+				posed.setTargetPos(testTarget(eff, j, 0.25));
+				posed.solveIk(100);
+				const vec3d target = posed.getEffectorPos();
+
+				fabrik.resetAll();
+				fabrik.setEffector(eff);
+				fabrik.setTargetPos(target);
+				const double start = length(fabrik.getEffectorPos() - target);
+				startDistance += start;
+				fabrik.solveIk(100);
+				const double distance = length(fabrik.getEffectorPos() - target);
+				endDistance += distance;
+
+				// no solve ends up further away than it started (with constraints, once a step has had to be
+				// undone, CCD sweeps take over)
+				assert(distance <= start);
+
+				// without constraints, every one of them is reached (to within the joints' smallest turn,
+				// which adds up along the chain, so it's scaled by the effector's distance from the root)
+				if (con == 0)
+					assert(distance < 0.01 * length(eff.worldPos - skel[0].worldPos));
+			}
+		}
+
+		// with them, the passes can settle into a pose that they just reproduce, or throw the chain further away,
+		// and then CCD sweeps from where it was take over; so the effectors still get most of the way to their targets
+		assert(endDistance < 0.25 * startDistance);
+	}
+}
+
+// ===== Warm-Start Test =====================================================
+
+void testWarmStart(const Skeleton &skel)
+{
+	IkSolver cold(skel);
+	IkSolver warm(skel);
+	cold.enableConstraints(false);
+	warm.enableConstraints(false);
+	warm.enableWarmStart();
+
+	int coldIterations = 0, warmIterations = 0;
+	double coldError = 0.0, warmError = 0.0;
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (size_t e = 0; e < effectors.size(); ++e)
+	{
+		const Bone &eff = *effectors[e];
+
+		cold.resetAll();
+		warm.resetAll();
+		cold.setEffector(eff);
+		warm.setEffector(eff);
+
+		// follow a target that moves smoothly, one solve per frame
+		for (int frame = 0; frame < 300; ++frame)
+		{
+			const double t = frame * 0.02;
+			const vec3d target = eff.worldPos + vec3d(0.25*std::sin(t), 0.2*std::sin(1.3*t), 0.2*(std::cos(0.7*t) - 1.0));
+			cold.setTargetPos(target);
+			warm.setTargetPos(target);
+			cold.solveIk(30);
+			warm.solveIk(30);
+
+			coldIterations += cold.getLastIterations();
+			warmIterations += warm.getLastIterations();
+			coldError += length(cold.getEffectorPos() - target);
+			warmError += length(warm.getEffectorPos() - target);
+		}
+	}
+
+	// carrying on from the last frame, the warm-started solver shouldn't need more iterations to
+	// follow the target, and shouldn't lag any further behind it
+	assert(warmIterations <= coldIterations);
+	assert(warmError <= coldError * 1.1 + 1e-6);
+}
+
+// ===== Convergence Test ====================================================
+
+void testConvergence(const Skeleton &skel)
+{
+	IkSolver full(skel);
+	IkSolver early(skel);
+	early.setStallRate(0.01);
+
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (int con = 0; con < 2; ++con)
+	{
+		full.enableConstraints(con != 0);
+		early.enableConstraints(con != 0);
+
+		for (size_t e = 0; e < effectors.size(); ++e)
+		{
+			const Bone &eff = *effectors[e];
+			for (int j = 0; j < 4; ++j)
+			{
+				full.resetAll();
+				early.resetAll();
+				full.setEffector(eff);
+				early.setEffector(eff);
+
+				// well out of reach of any of the chains
+				const vec3d target = testTarget(eff, j, 25.0);
+				full.setTargetPos(target);
+				early.setTargetPos(target);
+				full.solveIk(100);
+				early.solveIk(100);
+
+				// stopping early shouldn't leave the effector more than a small fraction of a bone length further away
+				// than using every iteration
+				assert(early.getLastStopReason() != IkReachedTarget);
+				assert(early.getLastIterations() <= full.getLastIterations());
+				assert(length(early.getEffectorPos() - target) < length(full.getEffectorPos() - target) + 0.05);
+
+				// and without constraints, the chain can always stretch straight out towards the target
+				if (con == 0)
+					assert(early.getLastStopReason() == IkReachedClosest);
+			}
+		}
+	}
+
+	// targets which can be reached (because a solve with every iteration has reached them), with the constraints
+	// on: by default, nothing stops early, so the solve gets just as close as with the stall rate set to 0
+	IkSolver posed(skel);
+	IkSolver plain(skel);
+	full.setStallRate(0);
+	posed.setStallRate(0);
+	full.enableConstraints(true);
+	for (size_t e = 0; e < effectors.size(); ++e)
+	{
+		const Bone &eff = *effectors[e];
+		for (int j = 0; j < 8; ++j)
+		{
+			posed.resetAll();
+			posed.setEffector(eff);
+			posed.setTargetPos(testTarget(eff, j, 0.25));
+			posed.solveIk(100);
+			const vec3d target = posed.getEffectorPos();
+
+			full.resetAll();
+			plain.resetAll();
+			full.setEffector(eff);
+			plain.setEffector(eff);
+			full.setTargetPos(target);
+			plain.setTargetPos(target);
+			full.solveIk(100);
+			plain.solveIk(100);
+			assert(length(plain.getEffectorPos() - target) <= length(full.getEffectorPos() - target));
+		}
+	}
+}
+
+void testSolverStats(const Skeleton &skel)
+{
+	IkSolver plain(skel);
+	IkSolver counted(skel);
+	counted.enableStats();
+
+	int solves = 0, iterations = 0;
+	std::vector<const Bone*> effectors;
+	testEffectors(skel, effectors);
+	for (size_t e = 0; e < effectors.size(); ++e)
+	{
+		const Bone &eff = *effectors[e];
+
+		plain.resetAll();
+		counted.resetAll();
+		plain.setEffector(eff);
+		counted.setEffector(eff);
+
+		for (int j = 0; j < 4; ++j)
+		{
+			const vec3d target = testTarget(eff, j, 0.5);
+			plain.setTargetPos(target);
+			counted.setTargetPos(target);
+			plain.solveIk(30);
+			counted.solveIk(30);
+
+			// gathering the statistics mustn't change the solve
+			assert(counted.getEffectorPos() == plain.getEffectorPos());
+			assert(counted.getLastIterations() == plain.getLastIterations());
+			++solves;
+			iterations += counted.getLastIterations();
+		}
+	}
+
+	const IkStats &stats = counted.getStats();
+	assert(stats.solves == solves);
+	assert(stats.iterations == iterations);
+	assert(stats.stops[IkReachedTarget] + stats.stops[IkReachedClosest] + stats.stops[IkStalled] + stats.stops[IkRanOut] == solves);
+	assert(stats.clamps <= stats.entries[IkPhaseConstrain]);
+	assert(stats.maxError <= stats.error);
+	for (int p = 0; p < IkNumPhases; ++p)
+		assert(stats.seconds[p] >= 0.0);
+	assert(plain.getStats().solves == 0);
+
+	IkStats total;
+	total.add(stats);
+	total.add(stats);
+	assert(total.solves == 2*solves);
+	counted.resetStats();
+	assert(counted.getStats().solves == 0);
+}
+
+// ===== Explicit Instantiations =============================================
+
+template class IkSolverT<float>;
+template class IkSolverT<double>;
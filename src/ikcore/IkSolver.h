@@ -0,0 +1,273 @@
+#ifndef IK_SOLVER_H
+#define IK_SOLVER_H
+
+#include "Skeleton.h"
+#include "IkKernel.h"
+#include "IkJacobian.h"
+#include "IkTree.h"
+#include "IkStats.h"
+#include "Pose.h"
+
+class Skeleton;
+class Bone;
+
+// The solver is templated on the scalar type used for the pose and the solve
+// (the skeleton is always double precision); use IkSolver or IkSolverf
+// It's instantiated for float and double in IkSolver.cpp.
+template <typename T>
+class IkSolverT : public RefCounted
+{
+public:
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat3<T> mat3t;
+	typedef vmath::mat4<T> mat4t;
+	typedef vmath::quat<T> quatt;
+
+	IkSolverT(const Skeleton &skel);
+
+	const vec3t &getTargetPos() const;
+	const Bone &getRootBone() const;
+	const Bone &getEffector() const;
+	vec3t getEffectorPos() const;
+	const vec3t &getRootPos() const;
+
+	const Skeleton &getSkeleton() const;
+
+	// current world-space transform of a bone (bone-space -> world-space)
+	// (solving only updates the transforms along the chain; the rest are brought up to date when they're read)
+	const mat4t &getBoneToWorld(const Bone &b) const;
+	// current rotation of a bone relative to its parent in the solver's tree
+	const mat3t &getBoneRotation(const Bone &b) const;
+
+	void setTargetPos(const vec3t &target);
+
+	// the effector can also be given a target orientation (for its bone-to-world rotation), which is solved for
+	// in the same iterations as the position (with CCD, see ikStepCCDOrient; the other algorithms
+	// only turn the effector's own joint, see ikAlignEffector); it only applies to the main effector
+	// (for a tip bone, it's the bone that the tip is fixed to that's turned, carrying the tip with it)
+	bool hasTargetRot() const;
+	const quatt &getTargetRot() const;
+	void setTargetRot(const quatt &rot);
+	void clearTargetRot();
+
+	// how much the orientation counts against the position for the joints above the effector's own one,
+	// from 0 to 1 (0.5 by default); this mostly matters when the effector's own joint can't take up the
+	// orientation by itself, because of its constraints
+	T getOrientationWeight() const;
+	void setOrientationWeight(T weight);
+
+	void setRootBone(const Bone &bone);
+	void setEffector(const Bone &bone);
+
+	// further effectors can be pinned at the same time as the main one; they're numbered from 1
+	// (the main effector, see setEffector, is effector 0), and they all share the root
+	// while there are any, each iteration solves for all of them at once, with a multi-effector
+	// CCD sweep over the union of their chains (see ikStepCCDTree), whatever the algorithm
+	int numEffectors() const;
+	int addEffector(const Bone &bone, const vec3t &target);
+	void removeExtraEffectors();
+	const Bone &getEffector(int idx) const;
+	vec3t getEffectorPos(int idx) const;
+	const vec3t &getTargetPos(int idx) const;
+	void setTargetPos(int idx, const vec3t &target);
+
+	bool areConstraintsEnabled() const;
+	void enableConstraints(bool enabled = true);
+
+	// the CCD sweep can accumulate and constrain the joint rotations as matrices (the default),
+	// or as quaternions, which is faster and keeps them from drifting (see ikStepCCDQuat)
+	bool areQuaternionsEnabled() const;
+	void enableQuaternions(bool enabled = true);
+
+	// a chain with exactly two bones that can turn (eg, from the shoulder to the hand) is solved
+	// analytically (see ikSolveTwoBone), and only iterated if the constraints get in the way
+	// enabled by default
+	bool isTwoBoneEnabled() const;
+	void enableTwoBone(bool enabled = true);
+
+	// the algorithm used for each iteration (CCD by default)
+	// the quaternion option only applies to CCD
+	IkAlgorithm getAlgorithm() const;
+	void setAlgorithm(IkAlgorithm algorithm);
+
+	// the damping used by damped least squares (and by the pseudo-inverse, near singularities)
+	// larger values are more stable near singular poses, but converge more slowly
+	T getDamping() const;
+	void setDamping(T damping);
+
+	// a solve stops early when the target is out of reach and the effector is as close as the chain can get,
+	// or when two iterations in a row have each taken off less than the stall rate of the distance left,
+	// see IkConvergenceT; the stall rate is 0 by default, which never stops early like that, because constrained
+	// CCD often stalls for a few iterations and then gets going again (0.01 gives up on those, for a target
+	// that would have been reached, but saves most of the iterations spent against the constraints)
+	T getStallRate() const;
+	void setStallRate(T rate);
+
+	// why the last solve stopped
+	IkStopReason getLastStopReason() const;
+
+	// warm-starting, for solving once a frame towards targets that move smoothly: each solve first carries
+	// every joint on by its rotation over the previous solve (if that brings the effectors closer), and is
+	// allowed a few more iterations than the recent solves have needed (see getAverageIterations)
+	// stepping with iterateIk doesn't warm-start; resetting the pose, the root or the effectors starts afresh
+	// disabled by default
+	bool isWarmStartEnabled() const;
+	void enableWarmStart(bool enabled = true);
+
+	// the number of iterations taken by the last solve, and the running average over the recent warm-started ones
+	int getLastIterations() const;
+	T getAverageIterations() const;
+
+	// statistics (see IkStats.h): while they're enabled, every solve adds to the totals, until they're reset
+	// disabled by default, when they cost next to nothing
+	bool areStatsEnabled() const;
+	void enableStats(bool enabled = true);
+	const IkStats &getStats() const;
+	void resetStats();
+
+	// resets the root bone, effector and target position
+	void resetAll();
+
+	// resets the pose to be the neutral (skeleton-default) pose
+	void resetPose();
+
+	// copies the current pose out (see Pose.h), or puts the solver into a pose taken from any solver
+	// for the same skeleton, whatever its root; setting the pose starts afresh, like resetting it
+	void getPose(PoseT<T> &pose) const;
+	void setPose(const PoseT<T> &pose);
+
+	// try to completely solve for the current target
+	void solveIk(int maxIterations, T threshold = T(0.001));
+
+	// perform one iteration of whatever IK algorithm is being implemented
+	void iterateIk();
+
+	// apply all joint constraints
+	void applyAllConstraints();
+	
+private:
+	typedef IkBoneStateT<T> BoneState;
+
+	// an IkSolver is linked at construction with a skeleton
+	// and cannot be switched to a different skeleton
+	const Skeleton &skeleton;
+
+	const Bone *rootBone;
+	const Bone *effectorBone;
+	IkChainT<T> ikChain;
+	IkChainStateT<T> chainState;
+	IkJacobianStateT<T> jacobianState;
+
+	// the extra effectors and their targets, and the tree that they're solved over
+	// (with the main effector first; built when it's first needed, like the chain)
+	std::vector<const Bone*> extraEffectors;
+	std::vector<vec3t> extraTargets;
+	IkTreeT<T> ikTree;
+	std::vector<const Bone*> treeEffectors;
+	std::vector<vec3t> treeTargets;
+	std::vector<char> treeChanged;
+
+	// the bone-to-world transforms are recalculated lazily, so reading them
+	// (which is logically const) may have to bring them up to date first
+	mutable std::vector<BoneState> boneStates;
+
+	// one flag per bone, set when the bone's transform is out of date
+	mutable std::vector<char> staleBones;
+	mutable bool mAnyStale;
+
+	bool mApplyConstraints;
+	bool mQuaternions;
+	bool mTwoBone;
+	IkAlgorithm mAlgorithm;
+	T mDamping;
+
+	vec3t targetPos;
+	vec3t rootPos;
+
+	quatt targetRot;
+	bool mHasTargetRot;
+	T mOrientationWeight;
+
+	T mStallRate;
+	IkStopReason mLastStop;
+
+	// the warm-start history: each bone's rotation at the end of the last warm-started solve,
+	// and its change over that solve (both by bone id), and the iterations the solves have taken
+	bool mWarmStart;
+	std::vector<mat3t> warmRot;
+	std::vector<quatt> warmVel;
+	int mWarmSolves;
+	T mAvgIterations;
+	int mLastIterations;
+
+	// the statistics; the working set points at them while they're enabled
+	IkStats mStats;
+
+	// the working set's rotations at the start of the current solve
+	std::vector<mat3t> startRot;
+
+	const Bone &chainEffector() const;
+	void buildChain();
+	void solve(int maxIterations, T threshold, bool warm);
+	void solveChain(int maxIterations, T threshold, bool warm);
+	void solveTree(int maxIterations, T threshold, bool warm);
+	int warmBudget(int maxIterations) const;
+	bool warmExtrapolate(const std::vector<int> &boneIds, const std::vector<const JointConstraints*> &constraints, const std::vector<char> &reversed);
+	void warmRestore(int n);
+	void warmRecord(const std::vector<int> &boneIds, int iterations);
+	void resetWarmStart();
+	void updateBoneTransforms();
+	void updateStaleTransforms() const;
+	const BoneState &getBoneState(const Bone &b) const;
+
+	bool isAngleInRange(T minA, T maxA, T a) const;
+};
+
+typedef IkSolverT<double> IkSolver;
+typedef IkSolverT<float> IkSolverf;
+
+// the tests' common ground: the effectors of the skeleton (in bone order), and the j'th of a spread of
+// targets around a bone's rest position, scale*(j + 1) away from it in a different direction each time
+void testEffectors(const Skeleton &skel, std::vector<const Bone*> &effectors);
+vec3d testTarget(const Bone &b, int j, double scale);
+
+// solves a spread of targets for every effector of the skeleton with both
+// the float and double solvers, and checks that the results agree
+void testSinglePrecisionSolver(const Skeleton &skel);
+
+// pins each effector of the skeleton in turn while another one moves,
+// and checks that the pinned one stays put
+void testMultiEffectorSolver(const Skeleton &skel);
+
+// solves for the positions and orientations of poses that the effectors are known to be able to reach,
+// and checks that the bones the effectors' tips are fixed to line up and the positions are reached
+// without constraints, and that with them the effectors still get most of the way
+void testOrientationTargets(const Skeleton &skel);
+
+// solves a spread of targets with and without gathering statistics (see IkStats.h),
+// and checks that the results are the same and the statistics add up
+void testSolverStats(const Skeleton &skel);
+
+// solves targets well out of reach, with and without giving up early (see IkConvergenceT),
+// and checks that giving up early makes no real difference to where the effector ends up; and solves
+// reachable targets with the constraints on, and checks that the default gets as close as every iteration does
+void testConvergence(const Skeleton &skel);
+
+// follows a smoothly moving target with each effector of the skeleton, with and without warm-starting,
+// and checks that warm-starting takes no more iterations and ends up no further from the target
+void testWarmStart(const Skeleton &skel);
+
+// solves unconstrained two-bone chains (every bone to its great-grandparent) analytically,
+// and checks that a single pass gets at least as close as iterating does
+void testTwoBoneSolver(const Skeleton &skel);
+
+// solves targets that the effectors are known to be able to reach with the pseudo-inverse and damped
+// least squares, without constraints, and checks that every one is reached in a few iterations
+void testJacobianSolver(const Skeleton &skel);
+
+// solves targets that the effectors are known to be able to reach with FABRIK, with the constraints off and on,
+// and checks that they're reached without constraints, and that the CCD sweep it falls back on when the
+// constraints stall it still gets the effectors most of the way with them
+void testFABRIKSolver(const Skeleton &skel);
+
+#endif
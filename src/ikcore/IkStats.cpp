@@ -0,0 +1,56 @@
+#include "CoreGlobal.h"
+#include "IkStats.h"
+
+// ===== IkStats =============================================================
+
+void IkStats::reset()
+{
+	solves = 0;
+	iterations = 0;
+	maxIterations = 0;
+	for (int r = 0; r <= IkRanOut; ++r)
+		stops[r] = 0;
+	error = 0.0;
+	maxError = 0.0;
+	for (int p = 0; p < IkNumPhases; ++p)
+	{
+		seconds[p] = 0.0;
+		entries[p] = 0;
+	}
+	clamps = 0;
+}
+
+void IkStats::add(const IkStats &other)
+{
+	solves += other.solves;
+	iterations += other.iterations;
+	maxIterations = std::max(maxIterations, other.maxIterations);
+	for (int r = 0; r <= IkRanOut; ++r)
+		stops[r] += other.stops[r];
+	error += other.error;
+	maxError = std::max(maxError, other.maxError);
+	for (int p = 0; p < IkNumPhases; ++p)
+	{
+		seconds[p] += other.seconds[p];
+		entries[p] += other.entries[p];
+	}
+	clamps += other.clamps;
+}
+
+void IkStats::addSolve(int iterations, IkStopReason stop, double error)
+{
+	++solves;
+	this->iterations += iterations;
+	maxIterations = std::max(maxIterations, iterations);
+	++stops[stop];
+	this->error += error;
+	maxError = std::max(maxError, error);
+}
+
+double IkStats::totalSeconds() const
+{
+	double total = 0.0;
+	for (int p = 0; p < IkNumPhases; ++p)
+		total += seconds[p];
+	return total;
+}
@@ -0,0 +1,94 @@
+#ifndef IK_STATS_H
+#define IK_STATS_H
+
+#include "IkKernel.h"
+#include "Thread.h"
+
+// Solver statistics: how many iterations the solves took, how close they got, why they stopped,
+// and where the time went. They're only gathered when a solver (or batch) is asked to; otherwise
+// the kernels are given a null IkStats pointer, and the cost is a test and a branch here and there.
+// The totals can be added together, across solvers, batches and frames.
+
+// the phases of a solve that are timed separately
+enum IkPhase
+{
+	IkPhaseBuild,         // building the chain (or tree), loading it and storing it back, and the warm start
+	IkPhaseStep,          // the algorithm's steps, apart from the constraints
+	IkPhaseConstrain,     // applying the joint constraints (see ikConstrainJoint)
+	IkPhaseTransforms,    // updating the world transforms, during and after the solve
+	IkNumPhases
+};
+
+struct IkStats
+{
+	// the number of solves, and the iterations they took between them (and the most any one took)
+	int solves;
+	int iterations;
+	int maxIterations;
+
+	// how many solves stopped for each reason (by IkStopReason)
+	int stops[IkRanOut + 1];
+
+	// the effectors' final distances from their targets, added up over the solves (and the worst of them)
+	// (for a solve with several effectors, it's the total over the effectors)
+	double error;
+	double maxError;
+
+	// the time spent in each phase (in seconds), and the number of times it was entered; for the
+	// constraints, that's once per joint they were applied to, and clamps counts the ones they changed
+	double seconds[IkNumPhases];
+	int entries[IkNumPhases];
+	int clamps;
+
+	IkStats()
+	{ reset(); }
+
+	void reset();
+
+	// adds another set of totals to these ones
+	void add(const IkStats &other);
+
+	// records the end of a solve
+	void addSolve(int iterations, IkStopReason stop, double error);
+
+	double meanIterations() const
+	{ return (solves > 0) ? double(iterations) / solves : 0.0; }
+	double meanError() const
+	{ return (solves > 0) ? error / solves : 0.0; }
+	double totalSeconds() const;
+};
+
+// charges the time between marks to the phases of a set of statistics, leaving out the time the
+// constraints have charged for themselves in between; with no statistics, it does nothing
+class IkPhaseTimer
+{
+public:
+	explicit IkPhaseTimer(IkStats *stats)
+	:	stats(stats), last(0.0), constrained(0.0)
+	{
+		if (stats)
+		{
+			last = monotonicSeconds();
+			constrained = stats->seconds[IkPhaseConstrain];
+		}
+	}
+
+	// charges the time since the last mark to a phase
+	void mark(IkPhase phase)
+	{
+		if (!stats) return;
+
+		const double now = monotonicSeconds();
+		stats->seconds[phase] += (now - last) - (stats->seconds[IkPhaseConstrain] - constrained);
+		++stats->entries[phase];
+		last = now;
+		constrained = stats->seconds[IkPhaseConstrain];
+	}
+
+private:
+	IkStats *stats;
+	double last;
+	double constrained;
+};
+
+#endif
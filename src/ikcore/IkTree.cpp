@@ -0,0 +1,281 @@
+#include "CoreGlobal.h"
+#include "IkTree.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+
+// ===== Tree Building =======================================================
+
+// appends b and the tree bones below it, deepest first
+// nextBone holds the id of the next bone towards the root for every tree bone (and -2 for the rest)
+template <typename T>
+static void addTreeBones(const Skeleton &skel, const Bone &b, const std::vector<int> &nextBone,
+	const Bone *const *effectors, int numEffectors, std::vector<int> &nodeOf, IkTreeT<T> &tree)
+{
+	const Bone::Connection *bj = skel.getJoints(b);
+	const int first = (int)tree.effectorIndices.size();
+	for (int j = 0; j < b.numJoints; ++j)
+	{
+		const Bone &c = skel[bj[j].to];
+		if (nextBone[c.id] == b.id)
+			addTreeBones(skel, c, nextBone, effectors, numEffectors, nodeOf, tree);
+	}
+
+	const int node = tree.length();
+	nodeOf[b.id] = node;
+	tree.boneIds.push_back(b.id);
+	for (int k = 0; k < numEffectors; ++k)
+	{
+		if (effectors[k] == &b)
+		{
+			tree.effectorNodes.push_back(node);
+			tree.effectorIndices.push_back(k);
+		}
+	}
+	tree.firstEffector.push_back(first);
+	tree.numEffectors.push_back((int)tree.effectorIndices.size() - first);
+
+	for (int j = 0; j < b.numJoints; ++j)
+	{
+		const Bone &c = skel[bj[j].to];
+		if ((c.id != nextBone[b.id]) && (nextBone[c.id] != b.id))
+			tree.branchJoints.push_back(j);
+	}
+	tree.firstBranch.push_back((int)tree.branchJoints.size());
+}
+
+template <typename T>
+void ikBuildTree(const Skeleton &skel, const Bone &root, const Bone *const *effectors, int numEffectors, IkTreeT<T> &tree)
+{
+	tree = IkTreeT<T>();
+
+	// mark out the union of the paths (each path runs from the effector to the root)
+	std::vector<int> nextBone(skel.numBones(), -2);
+	nextBone[root.id] = -1;
+
+	std::vector<const Bone*> path;
+	for (int k = 0; k < numEffectors; ++k)
+	{
+		skel.findPath(root, *effectors[k], path);
+		for (int i = 0; i + 1 < (int)path.size(); ++i)
+			nextBone[path[i]->id] = path[i + 1]->id;
+	}
+
+	std::vector<int> nodeOf(skel.numBones(), -1);
+	tree.firstBranch.push_back(0);
+	addTreeBones(skel, root, nextBone, effectors, numEffectors, nodeOf, tree);
+
+	const int n = tree.length();
+	tree.next.resize(n);
+	tree.jointPos.resize(n);
+	tree.nextJointPos.resize(n);
+	tree.constraints.resize(n);
+	tree.reversed.resize(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const Bone &b = skel[tree.boneIds[i]];
+		if (nextBone[b.id] >= 0)
+		{
+			// see ikBuildChain
+			const Bone &next = skel[nextBone[b.id]];
+			tree.next[i] = nodeOf[next.id];
+			tree.jointPos[i] = convertVec<T>(skel.getJoint(b, next).pos);
+			tree.nextJointPos[i] = convertVec<T>(skel.getJoint(next, b).pos);
+
+			const bool rev = (&next != skel.getParent(b));
+			tree.constraints[i] = rev ? &next.constraints : &b.constraints;
+			tree.reversed[i] = rev;
+		}
+		else
+		{
+			tree.next[i] = -1;
+			tree.jointPos[i] = vmath::vec3<T>(T(0), T(0), T(0));
+			tree.nextJointPos[i] = vmath::vec3<T>(T(0), T(0), T(0));
+			tree.constraints[i] = 0;
+			tree.reversed[i] = false;
+		}
+	}
+}
+
+// ===== Tree Working Set ====================================================
+
+template <typename T>
+void ikLoadTree(const IkTreeT<T> &tree, const IkBoneStateT<T> *states, IkChainStateT<T> &cs)
+{
+	const int n = tree.length();
+	cs.rot.resize(n);
+	cs.worldRot.resize(n);
+	cs.worldPos.resize(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const IkBoneStateT<T> &bs = states[tree.boneIds[i]];
+		cs.rot[i] = bs.rot;
+		cs.worldRot[i] = vmath::mat3<T>(bs.boneToWorld);
+		cs.worldPos[i] = bs.boneToWorld.translation();
+	}
+}
+
+template <typename T>
+int ikStoreTree(const IkTreeT<T> &tree, const IkChainStateT<T> &cs, IkBoneStateT<T> *states, char *changed)
+{
+	const int n = tree.length();
+	int count = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		vmath::mat3<T> &rot = states[tree.boneIds[i]].rot;
+		changed[i] = (rot != cs.rot[i]);
+		if (changed[i])
+		{
+			rot = cs.rot[i];
+			++count;
+		}
+	}
+	return count;
+}
+
+template <typename T>
+void ikUpdateTreeBoneTransforms(const Skeleton &skel, const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, char *changed, IkBoneStateT<T> *states, char *stale)
+{
+	// root first, so each bone's next bone is already up to date (see ikUpdateChainBoneTransforms)
+	for (int i = tree.length() - 1; i >= 0; --i)
+	{
+		const int next = tree.next[i];
+		if (next >= 0)
+			changed[i] = changed[i] || changed[next];
+		if (!changed[i])
+			continue;
+
+		const Bone &b = skel[tree.boneIds[i]];
+		IkBoneStateT<T> &bs = states[b.id];
+		if (next < 0)
+			bs.boneToWorld = vmath::translation_matrix(rootPos) * vmath::mat4<T>(bs.rot);
+		else
+		{
+			const vmath::mat4<T> base = states[tree.boneIds[next]].boneToWorld * vmath::translation_matrix(tree.nextJointPos[i]);
+			bs.boneToWorld = base * vmath::mat4<T>(bs.rot) * vmath::translation_matrix(-tree.jointPos[i]);
+		}
+		if (stale != 0)
+			stale[b.id] = 0;
+
+		// the branches off the tree
+		for (int j = tree.firstBranch[i]; j < tree.firstBranch[i + 1]; ++j)
+			ikUpdateBranchTransforms(skel, b, tree.branchJoints[j], states, stale);
+	}
+}
+
+template <typename T>
+void ikUpdateTreeTransforms(const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs)
+{
+	const int n = tree.length();
+	if (n == 0) return;
+
+	// see ikUpdateChainTransforms
+	cs.worldRot[n - 1] = cs.rot[n - 1];
+	cs.worldPos[n - 1] = rootPos;
+
+	for (int i = n - 2; i >= 0; --i)
+	{
+		const int next = tree.next[i];
+		const vmath::vec3<T> base = cs.worldRot[next] * tree.nextJointPos[i] + cs.worldPos[next];
+		cs.worldRot[i] = cs.worldRot[next] * cs.rot[i];
+		cs.worldPos[i] = cs.worldRot[i] * -tree.jointPos[i] + base;
+	}
+}
+
+// ===== Multi-Effector CCD ==================================================
+
+template <typename T>
+void ikStepCCDTree(const IkTreeT<T> &tree, IkChainStateT<T> &cs, const vmath::vec3<T> *targets, bool applyConstraints)
+{
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat3<T> mat3t;
+
+	const int n = tree.length();
+	const int numEffectors = (int)tree.effectorNodes.size();
+	cs.tips.resize(numEffectors);
+	for (int e = 0; e < numEffectors; ++e)
+		cs.tips[e] = cs.worldPos[tree.effectorNodes[e]];
+
+	// every bone comes after the ones below it, so (as in the single chain sweep) the bones that
+	// are still to be visited are never moved by the ones that have been; skip the root
+	for (int i = 0; i < n - 1; ++i)
+	{
+		const int first = tree.firstEffector[i];
+		const int count = tree.numEffectors[i];
+
+		// an effector on its own doesn't gain anything by turning
+		if ((count == 0) || ((count == 1) && (tree.effectorNodes[first] == i)))
+			continue;
+
+		const mat3t &worldRot = cs.worldRot[i];
+		const vec3t &worldPos = cs.worldPos[i];
+		const vec3t &jointPos = tree.jointPos[i];
+
+		// into bone space (v * worldRot is transpose(worldRot) * v), relative to the joint
+		const vec3t originB = worldPos * worldRot;
+
+		mat3t rot;
+		if (count == 1)
+		{
+			const vec3t relTip = (cs.tips[first] * worldRot - originB) - jointPos;
+			const vec3t relTarget = (targets[tree.effectorIndices[first]] * worldRot - originB) - jointPos;
+			rot = calcDirectRotation(relTip, relTarget);
+		}
+		else
+		{
+			vmath::quat<T> sum(T(0), T(0), T(0), T(0));
+			for (int e = first; e < first + count; ++e)
+			{
+				const vec3t relTip = (cs.tips[e] * worldRot - originB) - jointPos;
+				const vec3t relTarget = (targets[tree.effectorIndices[e]] * worldRot - originB) - jointPos;
+				vmath::quat<T> q = calcDirectRotationQuat(relTip, relTarget);
+
+				// (the effectors' rotations are all within 180 degrees, so they're in the same hemisphere)
+				q *= std::sqrt(dot(relTip, relTip) * dot(relTarget, relTarget));
+				sum += q;
+			}
+
+			const T lenSqr = dot(sum.v, sum.v) + sum.w*sum.w;
+			if (lenSqr <= T(0))
+				continue;
+			rot = vmath::quat_to_mat3(normalize(sum));
+		}
+		if (rot == mat3t(T(1)))
+			continue;
+
+		// see updateJointByIk
+		mat3t &boneRot = cs.rot[i];
+		if (applyConstraints)
+		{
+			const mat3t oldRot = boneRot;
+			boneRot = boneRot * rot;
+			ikConstrainJoint(*tree.constraints[i], tree.reversed[i] != 0, boneRot, cs.stats);
+			rot = transpose(oldRot) * boneRot;
+		}
+		else
+			boneRot = boneRot * rot;
+
+		// move the effectors below this joint along with it
+		for (int e = first; e < first + count; ++e)
+		{
+			const vec3t relTip = (cs.tips[e] * worldRot - originB) - jointPos;
+			cs.tips[e] = worldRot * (jointPos + rot*relTip) + worldPos;
+		}
+	}
+}
+
+// ===== Explicit Instantiations =============================================
+
+#define INSTANTIATE_IK_TREE(T) \
+	template void ikBuildTree(const Skeleton &skel, const Bone &root, const Bone *const *effectors, int numEffectors, IkTreeT<T> &tree); \
+	template void ikLoadTree(const IkTreeT<T> &tree, const IkBoneStateT<T> *states, IkChainStateT<T> &cs); \
+	template int ikStoreTree(const IkTreeT<T> &tree, const IkChainStateT<T> &cs, IkBoneStateT<T> *states, char *changed); \
+	template void ikUpdateTreeBoneTransforms(const Skeleton &skel, const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, char *changed, IkBoneStateT<T> *states, char *stale); \
+	template void ikUpdateTreeTransforms(const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs); \
+	template void ikStepCCDTree(const IkTreeT<T> &tree, IkChainStateT<T> &cs, const vmath::vec3<T> *targets, bool applyConstraints);
+
+INSTANTIATE_IK_TREE(float)
+INSTANTIATE_IK_TREE(double)
+
+#undef INSTANTIATE_IK_TREE
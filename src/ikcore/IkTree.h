@@ -0,0 +1,82 @@
+#ifndef IK_TREE_H
+#define IK_TREE_H
+
+#include "IkKernel.h"
+
+// Multi-effector IK: several effectors are solved together from one root, over the union of
+// their chains (a tree), so that joints the chains have in common are solved once per sweep,
+// for all of the effectors below them, rather than being fought over by separate solves.
+// The tree is flattened in the same way as a chain, except that the next bone towards the root
+// is given explicitly rather than being the next one along; the same working set is used
+// (see IkChainStateT), so the per-bone arrays line up with the tree's.
+// Everything is templated on the scalar type, and instantiated for float and double in IkTree.cpp.
+
+template <typename T>
+struct IkTreeT
+{
+	// the bones are ordered so that each one comes after all of the bones below it
+	// (so the root is last), and the bones below each one are contiguous
+	std::vector<int> boneIds;
+
+	// the index of the next bone towards the root (-1 for the root)
+	std::vector<int> next;
+
+	// the joint linking each bone to the next one towards the root, as in IkChainT
+	std::vector< vmath::vec3<T> > jointPos;
+	std::vector< vmath::vec3<T> > nextJointPos;
+	std::vector<const JointConstraints*> constraints;
+	std::vector<char> reversed;
+
+	// the joints of each bone (indices into Bone::joints) that lead off the tree
+	// are [branchJoints[firstBranch[i]], branchJoints[firstBranch[i + 1]])
+	std::vector<int> firstBranch;
+	std::vector<int> branchJoints;
+
+	// the effectors, in the same order as the bones: the tree index of each one,
+	// and its position in the list the tree was built from (which is how its target is found)
+	std::vector<int> effectorNodes;
+	std::vector<int> effectorIndices;
+
+	// the effectors at or below each bone are [firstEffector[i], firstEffector[i] + numEffectors[i])
+	std::vector<int> firstEffector;
+	std::vector<int> numEffectors;
+
+	int length() const
+	{ return (int)boneIds.size(); }
+};
+
+typedef IkTreeT<double> IkTree;
+typedef IkTreeT<float> IkTreef;
+
+// builds the tree from the root bone to each of the effectors
+// (an effector can appear more than once, with different targets)
+template <typename T>
+void ikBuildTree(const Skeleton &skel, const Bone &root, const Bone *const *effectors, int numEffectors, IkTreeT<T> &tree);
+
+// copies the tree bones' rotations and transforms into the working set
+template <typename T>
+void ikLoadTree(const IkTreeT<T> &tree, const IkBoneStateT<T> *states, IkChainStateT<T> &cs);
+
+// copies the tree bones' rotations back from the working set, and flags the ones that changed
+// returns the number of bones whose rotation changed
+template <typename T>
+int ikStoreTree(const IkTreeT<T> &tree, const IkChainStateT<T> &cs, IkBoneStateT<T> *states, char *changed);
+
+// recalculates the bone-to-world transforms after ikStoreTree, in the same way as ikUpdateChainBoneTransforms;
+// on return, changed flags every tree bone whose transform changed
+template <typename T>
+void ikUpdateTreeBoneTransforms(const Skeleton &skel, const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, char *changed, IkBoneStateT<T> *states, char *stale = 0);
+
+// recalculates the world transforms of the tree's bones from the rotations
+template <typename T>
+void ikUpdateTreeTransforms(const IkTreeT<T> &tree, const vmath::vec3<T> &rootPos, IkChainStateT<T> &cs);
+
+// performs one multi-effector CCD sweep over the tree, leaves first
+// each joint is turned by the average of the rotations that would take each effector below it
+// onto its target (weighted by their distances from the joint, so it's close to the least-squares
+// rotation), and constrained as in ikStepCCD; with a single effector, it's the same as ikStepCCD
+// the targets are in the order the tree was built from; the world transforms in the working set are left stale
+template <typename T>
+void ikStepCCDTree(const IkTreeT<T> &tree, IkChainStateT<T> &cs, const vmath::vec3<T> *targets, bool applyConstraints);
+
+#endif
@@ -0,0 +1,378 @@
+#include "CoreGlobal.h"
+#include "MathUtil.h"
+
+// ===== Utilities ===========================================================
+
+template <typename T>
+vmath::mat3<T> calcDirectRotation(const vmath::vec3<T> &tip, const vmath::vec3<T> &target)
+{
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat3<T> mat3t;
+
+	T lenSqrTip = dot(tip, tip);
+	if (lenSqrTip < T(0.001)) return mat3t(T(1));
+	T lenSqrTarget = dot(target, target);
+	if (lenSqrTarget < T(0.001)) return mat3t(T(1));
+
+	vec3t a = tip * vmath::rsqrt(lenSqrTip);
+	vec3t b = target * vmath::rsqrt(lenSqrTarget);
+
+	// sanity check
+	assert(abs(dot(a,a) - T(1)) < T(0.0001));
+	assert(abs(dot(b,b) - T(1)) < T(0.0001));
+
+	vec3t axis;
+
+	T dotAB = dot(a, b);
+	T angle;
+	if (dotAB <= T(-1))
+	{
+		// angle is 180 degrees; any axis will do...
+		angle = T(M_PI);
+		if (abs(a.x) < T(0.8))
+			axis = normalize(cross(a, vec3t(T(1), T(0), T(0))));
+		else
+			axis = normalize(cross(a, vec3t(T(0), T(0), T(1))));
+	}
+	else if (dotAB >= T(1))
+	{
+		// angle is zero; no rotation
+		return mat3t(T(1));
+	}
+	else
+	{
+		angle = std::acos(dotAB);
+		axis = cross(a, b);
+	}
+
+	// sanity check
+	assert(angle >= T(-M_PI) && angle <= T(M_PI));
+
+	// early-out if the angle is small
+	if (angle < T(0.001))
+		return mat3t(T(1));
+
+	return vmath::rotation_matrix3(angle, axis);
+}
+
+template <typename T>
+vmath::mat3<T> rotationFromAzElTwist(T az, T el, T twist)
+{
+	vmath::vec3<T> axis(std::cos(az), T(0), -std::sin(az));
+	return vmath::rotation_matrix3(el, axis) * vmath::rotation_matrix3(twist + az, vmath::vec3<T>(T(0), T(1), T(0)));
+}
+
+/*
+mat3d rotationFromAzElTwist(double az, double el, double twist)
+{
+	const double caz = cos(az);
+	const double saz = sin(az);
+	const double cel = cos(el);
+	const double sel = sin(el);
+
+	// elevation * azimuth
+
+	mat3d azM(
+		caz, 0.0, saz,
+		0.0, 1.0, 0.0,
+		-saz, 0.0, caz
+	);
+	mat3d elM(
+		1.0, 0.0, 0.0,
+		0.0, cel, -sel,
+		0.0, sel, cel
+	);
+
+	mat3d M = azM*elM;
+
+#if 0
+	mat3d M(
+		   caz  ,  0.0,    saz  ,
+		-saz*sel,  cel,  sel*caz,
+		-saz*cel, -sel,  cel*caz
+	);
+#endif
+
+	return M * vmath::rotation_matrix3(twist, vec3d(0.0, 1.0, 0.0));
+}
+*/
+
+void testAzElRotation()
+{
+	mat3d M;
+
+	vec3d x, y, z;
+
+	const double threshold = 0.000001;
+	(void)threshold;
+
+	M = rotationFromAzElTwist(0.0, 0.0, 0.0);
+	x = M*unitX; y = M*unitY; z = M*unitZ;
+	assert(length_squared(unitX - x) < threshold);
+	assert(length_squared(unitY - y) < threshold);
+	assert(length_squared(unitZ - z) < threshold);
+
+	M = rotationFromAzElTwist(0.0, M_PI/2.0, 0.0);
+	x = M*unitX; y = M*unitY; z = M*unitZ;
+	assert(length_squared(unitX - x) < threshold);
+	assert(length_squared(unitZ - y) < threshold);
+	assert(length_squared(-unitY - z) < threshold);
+
+	M = rotationFromAzElTwist(M_PI, M_PI/2.0, 0.0);
+	x = M*unitX; y = M*unitY; z = M*unitZ;
+	assert(length_squared(-unitX - x) < threshold);
+	assert(length_squared(-unitZ - y) < threshold);
+	assert(length_squared(-unitY - z) < threshold);
+
+	M = rotationFromAzElTwist(M_PI, M_PI, 0.0);
+	x = M*unitX; y = M*unitY; z = M*unitZ;
+	assert(length_squared(-unitX - x) < threshold);
+	assert(length_squared(-unitY - y) < threshold);
+	assert(length_squared(unitZ - z) < threshold);
+}
+
+template <typename T>
+void directionToAzimuthElevation(const vmath::vec3<T> &dir, T &az, T &el)
+{
+	const vmath::vec3<T> v = normalize(dir);
+
+	T d = clamp(T(-1), T(1), v.y);
+	el = std::acos(d);
+
+	if (abs(d) == T(1))
+		az = T(0);
+	else
+	{
+		vmath::vec3<T> vOnPlane(v.x, T(0), v.z);
+		vOnPlane = normalize(vOnPlane);
+
+		d = clamp(T(-1), T(1), vOnPlane.z);
+		az = std::acos(d);
+		if (vOnPlane.x < T(0))
+			az = -az;
+	}
+}
+
+template <typename T>
+void rotationToAzimuthElevationTwist(const vmath::mat3<T> &rot, vmath::vec3<T> &dir, T &az, T &el, T &twist)
+{	
+	dir = rot*vmath::vec3<T>(T(0), T(1), T(0));
+	vmath::mat3<T> simpleM = calcDirectRotation(vmath::vec3<T>(T(0), T(1), T(0)), dir);
+	vmath::mat3<T> twistM = transpose(simpleM) * rot;
+
+	assert(simpleM.isrotation());
+	assert(twistM.isrotation());
+	
+	directionToAzimuthElevation(dir, az, el);
+
+	// calculate twist
+	// vec3d tZ = twistM*unitZ;
+	vmath::vec3<T> tZ = vmath::vec3<T>(twistM.elem[2][0], twistM.elem[2][1], twistM.elem[2][2]);
+
+	// calculate the twist...
+	twist = std::acos(clamp(T(-1), T(1), tZ.z));
+	if (tZ.x < T(0))
+		twist = -twist;
+
+	twist -= az;
+}
+
+// ===== Quaternion Utilities ================================================
+
+template <typename T>
+vmath::quat<T> calcDirectRotationQuat(const vmath::vec3<T> &tip, const vmath::vec3<T> &target)
+{
+	typedef vmath::vec3<T> vec3t;
+
+	// the same cut-offs as calcDirectRotation
+	T lenSqrTip = dot(tip, tip);
+	if (lenSqrTip < T(0.001)) return vmath::identityq<T>();
+	T lenSqrTarget = dot(target, target);
+	if (lenSqrTarget < T(0.001)) return vmath::identityq<T>();
+
+	// |tip||target| cos(angle)
+	const T lenProduct = std::sqrt(lenSqrTip * lenSqrTarget);
+	const T d = dot(tip, target);
+
+	// early-out if the angle is small (less than 0.001 radians, whose cosine is 0.9999995)
+	if (d > lenProduct * T(0.9999995))
+		return vmath::identityq<T>();
+
+	if (d <= -lenProduct)
+	{
+		// angle is 180 degrees; any axis will do...
+		const vec3t a = tip * vmath::rsqrt(lenSqrTip);
+		vec3t axis;
+		if (abs(a.x) < T(0.8))
+			axis = normalize(cross(a, vec3t(T(1), T(0), T(0))));
+		else
+			axis = normalize(cross(a, vec3t(T(0), T(0), T(1))));
+		return vmath::quat<T>(axis, T(0));
+	}
+
+	// the half-angle quaternion, without any trig:
+	// (tip x target, |tip||target| + tip.target) is (axis sin(angle), 1 + cos(angle)) scaled,
+	// which normalises to (axis sin(angle/2), cos(angle/2))
+	return normalize(vmath::quat<T>(cross(tip, target), lenProduct + d));
+}
+
+template <typename T>
+vmath::quat<T> quatFromAzElTwist(T az, T el, T twist)
+{
+	// see rotationFromAzElTwist: an elevation about (cos(az), 0, -sin(az)), after a twist of (twist + az) about Y
+	const T sinHalfEl = std::sin(el * T(0.5));
+	const T halfTwist = (twist + az) * T(0.5);
+	const vmath::quat<T> swing(std::cos(az) * sinHalfEl, T(0), -std::sin(az) * sinHalfEl, std::cos(el * T(0.5)));
+	const vmath::quat<T> twistQ(T(0), std::sin(halfTwist), T(0), std::cos(halfTwist));
+	return swing * twistQ;
+}
+
+template <typename T>
+void quatToAzimuthElevationTwist(const vmath::quat<T> &qq, vmath::vec3<T> &dir, T &az, T &el, T &twist)
+{
+	// q and -q are the same rotation; pick the one with w >= 0 so the angles come out in range
+	const vmath::quat<T> q = (qq.w < T(0)) ? vmath::quat<T>(-qq.v, -qq.w) : qq;
+
+	// q = swing * twist, where the twist is about Y, and the swing has no Y component
+	// the twist is the Y part of q on its own, and swing = q * conjugate(twist)
+	const T twistLenSqr = q.v.y*q.v.y + q.w*q.w;
+	vmath::quat<T> swing;
+	T twistAngle;
+	if (twistLenSqr > T(0))
+	{
+		const T s = vmath::rsqrt(twistLenSqr);
+		const T ty = q.v.y * s;
+		const T tw = q.w * s;
+		swing = vmath::quat<T>(q.v.x*tw + q.v.z*ty, T(0), q.v.z*tw - q.v.x*ty, q.w*tw + q.v.y*ty);
+		twistAngle = T(2) * std::atan2(ty, tw);
+	}
+	else
+	{
+		// the swing is a half turn, so the twist is arbitrary
+		swing = q;
+		twistAngle = T(0);
+	}
+
+	// the swing axis is (cos(az), 0, -sin(az)) sin(el/2)
+	const T sinHalfEl = std::sqrt(swing.v.x*swing.v.x + swing.v.z*swing.v.z);
+	el = T(2) * std::atan2(sinHalfEl, swing.w);
+	az = (sinHalfEl > T(0)) ? std::atan2(-swing.v.z, swing.v.x) : T(0);
+
+	// the swing applied to Y
+	dir = vmath::vec3<T>(
+		T(-2) * swing.w * swing.v.z,
+		T(1) - T(2) * sinHalfEl * sinHalfEl,
+		T(2) * swing.w * swing.v.x);
+
+	twist = twistAngle - az;
+}
+
+void testQuaternionRotation()
+{
+	const double threshold = 0.000001;
+	(void)threshold;
+
+	for (int i = 0; i < 64; ++i)
+	{
+		const double az = -M_PI + (2.0*M_PI * i) / 64.0;
+		const double el = (M_PI * ((i * 7) % 64)) / 64.0;
+		const double twist = -M_PI + (2.0*M_PI * ((i * 13) % 64)) / 64.0;
+
+		const mat3d M = rotationFromAzElTwist(az, el, twist);
+		const quatd q = quatFromAzElTwist(az, el, twist);
+		const mat3d Q = vmath::quat_to_mat3(q);
+		(void)Q;
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(M.elem[c][r] - Q.elem[c][r]) < threshold);
+
+		const vec3d tip(std::cos(az), 0.5, std::sin(el));
+		const vec3d target(std::sin(twist), std::cos(el), 0.25);
+		const mat3d R = calcDirectRotation(tip, target);
+		const mat3d RQ = vmath::quat_to_mat3(calcDirectRotationQuat(tip, target));
+		(void)R; (void)RQ;
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(R.elem[c][r] - RQ.elem[c][r]) < threshold);
+
+		assert(length(quatRotate(q, tip) - M * tip) < threshold);
+
+		// both decompositions should rebuild the same rotation
+		// (away from el = 0 and el = pi, where the azimuth is arbitrary, they give the same angles too)
+		vec3d dirM, dirQ;
+		double azM, elM, twM, azQ, elQ, twQ;
+		rotationToAzimuthElevationTwist(M, dirM, azM, elM, twM);
+		quatToAzimuthElevationTwist(q, dirQ, azQ, elQ, twQ);
+		assert(length(dirM - dirQ) < threshold);
+		const mat3d AQ = rotationFromAzElTwist(azQ, elQ, twQ);
+		(void)AQ;
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(M.elem[c][r] - AQ.elem[c][r]) < threshold);
+		if ((el > 0.01) && (el < M_PI - 0.01))
+		{
+			assert(abs(azM - azQ) < threshold);
+			assert(abs(elM - elQ) < threshold);
+			assert(abs(twM - twQ) < threshold);
+		}
+	}
+}
+
+void testSinglePrecisionRotation()
+{
+	// float only has ~7 significant digits, and the az/el/twist
+	// decomposition goes through acos, which loses precision near +/-1
+	const double threshold = 0.0001;
+	(void)threshold;
+
+	for (int i = 0; i < 64; ++i)
+	{
+		const double az = -M_PI + (2.0*M_PI * i) / 64.0;
+		const double el = (M_PI * ((i * 7) % 64)) / 64.0;
+		const double twist = -M_PI + (2.0*M_PI * ((i * 13) % 64)) / 64.0;
+
+		const mat3d Md = rotationFromAzElTwist(az, el, twist);
+		const mat3f Mf = rotationFromAzElTwist(float(az), float(el), float(twist));
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(Md.elem[c][r] - double(Mf.elem[c][r])) < threshold);
+
+		const vec3d tip(std::cos(az), 0.5, std::sin(el));
+		const vec3d target(std::sin(twist), std::cos(el), 0.25);
+		const mat3d Rd = calcDirectRotation(tip, target);
+		const mat3f Rf = calcDirectRotation(convertVec<float>(tip), convertVec<float>(target));
+		(void)Rd; (void)Rf;
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(Rd.elem[c][r] - double(Rf.elem[c][r])) < threshold);
+
+		// compare the rotations that the decompositions rebuild, rather than the angles themselves
+		// (the angles aren't unique: eg, the azimuth is arbitrary when the elevation is zero)
+		vec3d dird; double azd, eld, twd;
+		vec3f dirf; float azf, elf, twf;
+		rotationToAzimuthElevationTwist(Md, dird, azd, eld, twd);
+		rotationToAzimuthElevationTwist(Mf, dirf, azf, elf, twf);
+		const mat3d Ad = rotationFromAzElTwist(azd, eld, twd);
+		const mat3d Af = convertMat<double>(rotationFromAzElTwist(azf, elf, twf));
+		(void)Ad; (void)Af;
+		for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(abs(Ad.elem[c][r] - Af.elem[c][r]) < 0.001);
+	}
+}
+
+// ===== Explicit Instantiations =============================================
+
+#define INSTANTIATE_MATH_UTIL(T) \
+	template vmath::mat3<T> calcDirectRotation(const vmath::vec3<T> &tip, const vmath::vec3<T> &target); \
+	template vmath::mat3<T> rotationFromAzElTwist(T az, T el, T twist); \
+	template void directionToAzimuthElevation(const vmath::vec3<T> &dir, T &az, T &el); \
+	template void rotationToAzimuthElevationTwist(const vmath::mat3<T> &rot, vmath::vec3<T> &dir, T &az, T &el, T &twist); \
+	template vmath::quat<T> calcDirectRotationQuat(const vmath::vec3<T> &tip, const vmath::vec3<T> &target); \
+	template vmath::quat<T> quatFromAzElTwist(T az, T el, T twist); \
+	template void quatToAzimuthElevationTwist(const vmath::quat<T> &q, vmath::vec3<T> &dir, T &az, T &el, T &twist);
+
+INSTANTIATE_MATH_UTIL(float)
+INSTANTIATE_MATH_UTIL(double)
+
+#undef INSTANTIATE_MATH_UTIL
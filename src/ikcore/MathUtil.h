@@ -0,0 +1,66 @@
+#ifndef MATH_UTIL_H
+#define MATH_UTIL_H
+
+// the rotation utilities are instantiated for float and double (in MathUtil.cpp)
+
+template <typename T>
+vmath::mat3<T> calcDirectRotation(const vmath::vec3<T> &tip, const vmath::vec3<T> &target);
+template <typename T>
+vmath::mat3<T> rotationFromAzElTwist(T az, T el, T twist);
+template <typename T>
+void directionToAzimuthElevation(const vmath::vec3<T> &dir, T &az, T &el);
+template <typename T>
+void rotationToAzimuthElevationTwist(const vmath::mat3<T> &rot, vmath::vec3<T> &dir, T &az, T &el, T &twist);
+
+// quaternion forms of the same operations
+// the az/el/twist decomposition is a swing-twist decomposition about the bone's Y axis,
+// and gives the same angles as rotationToAzimuthElevationTwist
+template <typename T>
+vmath::quat<T> calcDirectRotationQuat(const vmath::vec3<T> &tip, const vmath::vec3<T> &target);
+template <typename T>
+vmath::quat<T> quatFromAzElTwist(T az, T el, T twist);
+template <typename T>
+void quatToAzimuthElevationTwist(const vmath::quat<T> &q, vmath::vec3<T> &dir, T &az, T &el, T &twist);
+
+// rotates a vector by a unit quaternion
+// (vmath's q * v is for any quaternion, and goes through a full inverse)
+template <typename T>
+inline vmath::vec3<T> quatRotate(const vmath::quat<T> &q, const vmath::vec3<T> &v)
+{
+	const vmath::vec3<T> t = T(2) * cross(q.v, v);
+	return v + q.w * t + cross(q.v, t);
+}
+
+// conversions between scalar types
+// (the skeleton is always double precision, but the solver may not be)
+template <typename T, typename U>
+inline vmath::vec3<T> convertVec(const vmath::vec3<U> &v)
+{
+	return vmath::vec3<T>(T(v.x), T(v.y), T(v.z));
+}
+
+template <typename T, typename U>
+inline vmath::mat3<T> convertMat(const vmath::mat3<U> &m)
+{
+	vmath::mat3<T> result;
+	for (int c = 0; c < 3; ++c)
+	for (int r = 0; r < 3; ++r)
+		result.elem[c][r] = T(m.elem[c][r]);
+	return result;
+}
+
+template <typename T, typename U>
+inline vmath::quat<T> convertQuat(const vmath::quat<U> &q)
+{
+	return vmath::quat<T>(T(q.v.x), T(q.v.y), T(q.v.z), T(q.w));
+}
+
+void testAzElRotation();
+
+// checks the single precision utilities against the double precision ones
+void testSinglePrecisionRotation();
+
+// checks the quaternion utilities against the matrix ones
+void testQuaternionRotation();
+
+#endif
@@ -0,0 +1,159 @@
+#include "CoreGlobal.h"
+#include "Pose.h"
+#include "Skeleton.h"
+#include "IkSolver.h"
+#include "MathUtil.h"
+
+// ===== Pose ================================================================
+
+template <typename T>
+PoseT<T>::PoseT()
+:	rootPos(T(0), T(0), T(0))
+{
+}
+
+template <typename T>
+PoseT<T>::PoseT(const Skeleton &skel)
+{
+	reset(skel);
+}
+
+template <typename T>
+void PoseT<T>::reset(const Skeleton &skel)
+{
+	const int n = skel.numBones();
+	rots.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		const Bone &b = skel[i];
+		const int parent = skel.getTreeParent(i);
+
+		// (the same rotations as ikResetPose gives, rooted at bone 0)
+		if (parent >= 0)
+			rots[i] = vmath::mat_to_quat(convertMat<T>(transpose(skel[parent].defaultOrient) * b.defaultOrient));
+		else
+			rots[i] = vmath::mat_to_quat(convertMat<T>(b.defaultOrient));
+	}
+
+	rootPos = (n > 0) ? convertVec<T>(skel[0].worldPos) : vec3t(T(0), T(0), T(0));
+}
+
+template <typename T>
+void PoseT<T>::getBoneStates(const Skeleton &skel, IkBoneStateT<T> *states) const
+{
+	assert(numBones() == skel.numBones());
+	if (rots.empty())
+		return;
+
+	for (int i = 0; i < numBones(); ++i)
+		states[i].rot = vmath::quat_to_mat3(rots[i]);
+
+	ikUpdateBoneTransforms(skel, skel[0], rootPos, states);
+}
+
+template <typename T>
+void PoseT<T>::getBoneToWorld(const Skeleton &skel, std::vector<mat4t> &boneToWorld) const
+{
+	std::vector<IkBoneStateT<T> > states(numBones());
+	if (!states.empty())
+		getBoneStates(skel, &states[0]);
+
+	boneToWorld.resize(numBones());
+	for (int i = 0; i < numBones(); ++i)
+		boneToWorld[i] = states[i].boneToWorld;
+}
+
+// ===== Pose Test ===========================================================
+
+template <typename T>
+static double maxBoneDistance(const Skeleton &skel, const IkSolverT<T> &a, const IkSolverT<T> &b)
+{
+	double worst = 0.0;
+	for (int i = 0; i < skel.numBones(); ++i)
+	{
+		const Bone &bone = skel[i];
+		const vmath::mat4<T> &ma = a.getBoneToWorld(bone);
+		const vmath::mat4<T> &mb = b.getBoneToWorld(bone);
+		for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 3; ++r)
+			worst = std::max(worst, (double)std::abs(ma.elem[c][r] - mb.elem[c][r]));
+	}
+	return worst;
+}
+
+void testPose(const Skeleton &skel)
+{
+	// (the poses go through quaternions, so they come back to within rounding)
+	const double threshold = 1e-9;
+	const double thresholdf = 1e-3;
+	(void)threshold; (void)thresholdf;
+
+	// the default pose is the skeleton's
+	IkSolver reset(skel);
+	IkSolver restored(skel);
+	Pose pose(skel);
+	restored.setPose(pose);
+	assert(maxBoneDistance(skel, reset, restored) < threshold);
+
+	for (int i = 0; i < skel.numBones(); ++i)
+	{
+		const Bone &eff = skel[i];
+		if (!skel.isEffector(eff))
+			continue;
+
+		// pose the skeleton by solving for a target away from the effector
+		IkSolver solver(skel);
+		solver.setEffector(eff);
+		solver.setTargetPos(solver.getEffectorPos() + vec3d(0.3, -0.2, 0.4));
+		solver.solveIk(50);
+
+		solver.getPose(pose);
+		assert(pose.numBones() == skel.numBones());
+
+		// the transforms the pose gives are the solver's
+		std::vector<mat4d> boneToWorld;
+		pose.getBoneToWorld(skel, boneToWorld);
+		for (int j = 0; j < skel.numBones(); ++j)
+		for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 3; ++r)
+			assert(std::abs(boneToWorld[j].elem[c][r] - solver.getBoneToWorld(skel[j]).elem[c][r]) < threshold);
+
+		// a solver rooted at bone 0 takes it back, and so does one rooted elsewhere
+		restored.resetAll();
+		restored.setPose(pose);
+		assert(maxBoneDistance(skel, solver, restored) < threshold);
+
+		restored.setRootBone(eff);
+		restored.resetPose();
+		restored.setPose(pose);
+		assert(maxBoneDistance(skel, solver, restored) < threshold);
+		assert(restored.getRootBone().id == eff.id);
+
+		// and the pose taken from that one is the same
+		Pose again;
+		restored.getPose(again);
+		for (int j = 0; j < skel.numBones(); ++j)
+		{
+			const quatd &a = pose.getRotation(j);
+			const quatd &b = again.getRotation(j);
+			// (q and -q are the same rotation)
+			const double d = std::min(length(a.v - b.v) + std::abs(a.w - b.w), length(a.v + b.v) + std::abs(a.w + b.w));
+			assert(d < threshold);
+			(void)d;
+		}
+
+		// and the pose carries over to single precision
+		IkSolverf solverf(skel);
+		solverf.setPose(Posef(pose));
+		Posef posef;
+		solverf.getPose(posef);
+		const Pose back(posef);
+		restored.setPose(back);
+		assert(maxBoneDistance(skel, solver, restored) < thresholdf);
+	}
+}
+
+// ===== Explicit Instantiations =============================================
+
+template class PoseT<float>;
+template class PoseT<double>;
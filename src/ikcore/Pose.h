@@ -0,0 +1,86 @@
+#ifndef POSE_H
+#define POSE_H
+
+#include "IkKernel.h"
+#include "MathUtil.h"
+
+class Skeleton;
+
+// Poses: a skeleton's pose as plain data, apart from any solver, so that it can be kept
+// (eg, in an animation cache), handed to another thread or written out and read back.
+// A pose is one rotation per bone (by bone id), relative to the bone's parent in the skeleton's
+// tree (see Skeleton::getTreeParent; bone 0's rotation is its absolute orientation), and the
+// world position of bone 0, which is all that's needed to place every bone.
+// The rotations are relative to the skeleton's tree, not to any particular solver's root, so a
+// pose can be taken from one solver and given to another, whatever their root bones are.
+// A pose doesn't refer to its skeleton; it's up to the user to keep it with the right one.
+// It's templated on the scalar type, like the solver; use Pose or Posef.
+template <typename T>
+class PoseT
+{
+public:
+	typedef vmath::vec3<T> vec3t;
+	typedef vmath::mat4<T> mat4t;
+	typedef vmath::quat<T> quatt;
+
+	// an empty pose, for no bones
+	PoseT();
+
+	// the skeleton's default pose
+	explicit PoseT(const Skeleton &skel);
+
+	// converts a pose from another scalar type
+	template <typename U>
+	explicit PoseT(const PoseT<U> &pose)
+	:	rootPos(convertVec<T>(pose.getRootPos()))
+	{
+		rots.resize(pose.numBones());
+		for (int i = 0; i < pose.numBones(); ++i)
+			rots[i] = convertQuat<T>(pose.getRotation(i));
+	}
+
+	// resets the pose to the skeleton's default pose
+	void reset(const Skeleton &skel);
+
+	int numBones() const
+	{ return (int)rots.size(); }
+
+	// the rotation of a bone relative to its parent in the skeleton's tree
+	const quatt &getRotation(int id) const
+	{ return rots[id]; }
+	void setRotation(int id, const quatt &rot)
+	{ rots[id] = rot; }
+
+	// the world position of bone 0
+	const vec3t &getRootPos() const
+	{ return rootPos; }
+	void setRootPos(const vec3t &pos)
+	{ rootPos = pos; }
+
+	// the rotations, packed together by bone id (numBones of them), to be copied or streamed in one go
+	const quatt *rotations() const
+	{ return rots.empty() ? 0 : &rots[0]; }
+	quatt *rotations()
+	{ return rots.empty() ? 0 : &rots[0]; }
+
+	// fills in the kernel's bone states (numBones of them) for the pose, in the tree rooted at bone 0:
+	// the rotations relative to the skeleton's tree, and the bone-to-world transforms
+	void getBoneStates(const Skeleton &skel, IkBoneStateT<T> *states) const;
+
+	// the bone-to-world transforms of every bone in the pose (by bone id)
+	void getBoneToWorld(const Skeleton &skel, std::vector<mat4t> &boneToWorld) const;
+
+private:
+	std::vector<quatt> rots;
+	vec3t rootPos;
+};
+
+typedef PoseT<double> Pose;
+typedef PoseT<float> Posef;
+
+// takes poses from a solver, solving for each effector of the skeleton in turn (with the solver
+// rooted at bone 0 and elsewhere), gives them back to solvers in the default pose, and checks
+// that the bones end up where they were; and checks that the poses survive conversion to float
+void testPose(const Skeleton &skel);
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef SIMD_LANES_H
+#define SIMD_LANES_H
+
+// Lane-wise SIMD operations, for running the same scalar code on several
+// independent values at once (one per lane). SimdLanes<T> uses the widest
+// register available for T:
+//
+//   float:  8 lanes with AVX, 4 with SSE2
+//   double: 4 lanes with AVX, 2 with SSE2
+//
+// Without SSE2 (or with VMATH_NO_SIMD) there's a single lane, and everything
+// is plain scalar code.
+//
+// Memory is always accessed unaligned: lane data lives in std::vectors of T.
+// Arguments are passed by reference (32-bit MSVC can't pass aligned types by value).
+// The selection macros come from vmath_simd.h.
+
+template <typename T> struct SimdLanes;
+
+#if defined(VMATH_AVX)
+
+#include <immintrin.h>
+
+template <>
+struct SimdLanes<float>
+{
+	enum { Width = 8 };
+	typedef __m256 reg;
+	typedef __m256 mask;
+
+	static reg load(const float *p) { return _mm256_loadu_ps(p); }
+	static void store(float *p, const reg &a) { _mm256_storeu_ps(p, a); }
+	static reg splat(float x) { return _mm256_set1_ps(x); }
+
+	static reg add(const reg &a, const reg &b) { return _mm256_add_ps(a, b); }
+	static reg sub(const reg &a, const reg &b) { return _mm256_sub_ps(a, b); }
+	static reg mul(const reg &a, const reg &b) { return _mm256_mul_ps(a, b); }
+	static reg div(const reg &a, const reg &b) { return _mm256_div_ps(a, b); }
+	static reg sqrt(const reg &a) { return _mm256_sqrt_ps(a); }
+
+	static mask lt(const reg &a, const reg &b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static mask gt(const reg &a, const reg &b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static mask both(const mask &a, const mask &b) { return _mm256_and_ps(a, b); }
+	static mask either(const mask &a, const mask &b) { return _mm256_or_ps(a, b); }
+	static mask butNot(const mask &a, const mask &b) { return _mm256_andnot_ps(b, a); }
+	static reg select(const mask &m, const reg &a, const reg &b) { return _mm256_blendv_ps(b, a, m); }
+	static int bits(const mask &m) { return _mm256_movemask_ps(m); }
+};
+
+template <>
+struct SimdLanes<double>
+{
+	enum { Width = 4 };
+	typedef __m256d reg;
+	typedef __m256d mask;
+
+	static reg load(const double *p) { return _mm256_loadu_pd(p); }
+	static void store(double *p, const reg &a) { _mm256_storeu_pd(p, a); }
+	static reg splat(double x) { return _mm256_set1_pd(x); }
+
+	static reg add(const reg &a, const reg &b) { return _mm256_add_pd(a, b); }
+	static reg sub(const reg &a, const reg &b) { return _mm256_sub_pd(a, b); }
+	static reg mul(const reg &a, const reg &b) { return _mm256_mul_pd(a, b); }
+	static reg div(const reg &a, const reg &b) { return _mm256_div_pd(a, b); }
+	static reg sqrt(const reg &a) { return _mm256_sqrt_pd(a); }
+
+	static mask lt(const reg &a, const reg &b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	static mask gt(const reg &a, const reg &b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+	static mask both(const mask &a, const mask &b) { return _mm256_and_pd(a, b); }
+	static mask either(const mask &a, const mask &b) { return _mm256_or_pd(a, b); }
+	static mask butNot(const mask &a, const mask &b) { return _mm256_andnot_pd(b, a); }
+	static reg select(const mask &m, const reg &a, const reg &b) { return _mm256_blendv_pd(b, a, m); }
+	static int bits(const mask &m) { return _mm256_movemask_pd(m); }
+};
+
+#elif defined(VMATH_SSE2)
+
+#include <emmintrin.h>
+
+template <>
+struct SimdLanes<float>
+{
+	enum { Width = 4 };
+	typedef __m128 reg;
+	typedef __m128 mask;
+
+	static reg load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, const reg &a) { _mm_storeu_ps(p, a); }
+	static reg splat(float x) { return _mm_set1_ps(x); }
+
+	static reg add(const reg &a, const reg &b) { return _mm_add_ps(a, b); }
+	static reg sub(const reg &a, const reg &b) { return _mm_sub_ps(a, b); }
+	static reg mul(const reg &a, const reg &b) { return _mm_mul_ps(a, b); }
+	static reg div(const reg &a, const reg &b) { return _mm_div_ps(a, b); }
+	static reg sqrt(const reg &a) { return _mm_sqrt_ps(a); }
+
+	static mask lt(const reg &a, const reg &b) { return _mm_cmplt_ps(a, b); }
+	static mask gt(const reg &a, const reg &b) { return _mm_cmpgt_ps(a, b); }
+	static mask both(const mask &a, const mask &b) { return _mm_and_ps(a, b); }
+	static mask either(const mask &a, const mask &b) { return _mm_or_ps(a, b); }
+	static mask butNot(const mask &a, const mask &b) { return _mm_andnot_ps(b, a); }
+	static reg select(const mask &m, const reg &a, const reg &b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	static int bits(const mask &m) { return _mm_movemask_ps(m); }
+};
+
+template <>
+struct SimdLanes<double>
+{
+	enum { Width = 2 };
+	typedef __m128d reg;
+	typedef __m128d mask;
+
+	static reg load(const double *p) { return _mm_loadu_pd(p); }
+	static void store(double *p, const reg &a) { _mm_storeu_pd(p, a); }
+	static reg splat(double x) { return _mm_set1_pd(x); }
+
+	static reg add(const reg &a, const reg &b) { return _mm_add_pd(a, b); }
+	static reg sub(const reg &a, const reg &b) { return _mm_sub_pd(a, b); }
+	static reg mul(const reg &a, const reg &b) { return _mm_mul_pd(a, b); }
+	static reg div(const reg &a, const reg &b) { return _mm_div_pd(a, b); }
+	static reg sqrt(const reg &a) { return _mm_sqrt_pd(a); }
+
+	static mask lt(const reg &a, const reg &b) { return _mm_cmplt_pd(a, b); }
+	static mask gt(const reg &a, const reg &b) { return _mm_cmpgt_pd(a, b); }
+	static mask both(const mask &a, const mask &b) { return _mm_and_pd(a, b); }
+	static mask either(const mask &a, const mask &b) { return _mm_or_pd(a, b); }
+	static mask butNot(const mask &a, const mask &b) { return _mm_andnot_pd(b, a); }
+	static reg select(const mask &m, const reg &a, const reg &b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+	static int bits(const mask &m) { return _mm_movemask_pd(m); }
+};
+
+#else
+
+// no SIMD: a single lane of plain scalars
+template <typename T>
+struct SimdLanes
+{
+	enum { Width = 1 };
+	typedef T reg;
+	typedef bool mask;
+
+	static reg load(const T *p) { return *p; }
+	static void store(T *p, const reg &a) { *p = a; }
+	static reg splat(T x) { return x; }
+
+	static reg add(const reg &a, const reg &b) { return a + b; }
+	static reg sub(const reg &a, const reg &b) { return a - b; }
+	static reg mul(const reg &a, const reg &b) { return a * b; }
+	static reg div(const reg &a, const reg &b) { return a / b; }
+	static reg sqrt(const reg &a) { return std::sqrt(a); }
+
+	static mask lt(const reg &a, const reg &b) { return a < b; }
+	static mask gt(const reg &a, const reg &b) { return a > b; }
+	static mask both(const mask &a, const mask &b) { return a && b; }
+	static mask either(const mask &a, const mask &b) { return a || b; }
+	static mask butNot(const mask &a, const mask &b) { return a && !b; }
+	static reg select(const mask &m, const reg &a, const reg &b) { return m ? a : b; }
+	static int bits(const mask &m) { return m ? 1 : 0; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,877 @@
+#include "CoreGlobal.h"
+#include "Skeleton.h"
+#include "MathUtil.h"
+#include "SkeletonImage.h"
+
+#include <cstring>
+
+// ===== JointConstraints ====================================================
+
+static JointConstraints::AngleLimit makeAngleLimit(double a)
+{
+	JointConstraints::AngleLimit lim;
+	lim.turns = 0;
+	while (a > M_PI)
+	{
+		a -= 2.0*M_PI;
+		++lim.turns;
+	}
+	while (a < -M_PI)
+	{
+		a += 2.0*M_PI;
+		--lim.turns;
+	}
+	lim.c = std::cos(a);
+	lim.s = std::sin(a);
+	return lim;
+}
+
+void JointConstraints::prepareLimits()
+{
+	azimuthLimits[0] = makeAngleLimit(minAzimuth);
+	azimuthLimits[1] = makeAngleLimit(maxAzimuth);
+	elevationLimits[0] = makeAngleLimit(minElevation);
+	elevationLimits[1] = makeAngleLimit(maxElevation);
+	twistLimits[0] = makeAngleLimit(minTwist);
+	twistLimits[1] = makeAngleLimit(maxTwist);
+}
+
+// ===== Skeleton ============================================================
+
+// reads a skeleton file's text in place, a token at a time (with no copying), keeping track
+// of where it is so that errors can say where they are
+// (the skeleton files are written on Windows, but must load anywhere, so a '\r' is just a space)
+class SkeletonTextReader
+{
+public:
+	SkeletonTextReader(const char *text, size_t size, const std::string &source)
+	:	pos(text), end(text + size), lineStart(text), line(1), source(source)
+	{}
+
+	// moves to the next line that has a command on it (skipping blank lines and comments,
+	// which start with %), and returns false if there isn't one
+	bool nextCommand()
+	{
+		while (atEndOfLine())
+		{
+			if (pos == end)
+				return false;
+			skipLine();
+		}
+		return true;
+	}
+
+	// reads a token; what describes it for the error, if there isn't one
+	void readToken(const char *&b, const char *&e, const char *what)
+	{
+		if (atEndOfLine())
+			fail(pos, std::string("expected ") + what + ".");
+		b = pos;
+		while ((pos != end) && !isSpace(*pos) && (*pos != '\n'))
+			++pos;
+		e = pos;
+	}
+
+	double readDouble(const char *what)
+	{
+		const char *b, *e;
+		readToken(b, e, what);
+		double x;
+		if (!parseDouble(b, e, x))
+			fail(b, std::string("expected ") + what + ", not '" + std::string(b, e) + "'.");
+		return x;
+	}
+
+	int readInt(const char *what)
+	{
+		const char *b, *e;
+		readToken(b, e, what);
+		int n;
+		if (!parseInt(b, e, n))
+			fail(b, std::string("expected ") + what + ", not '" + std::string(b, e) + "'.");
+		return n;
+	}
+
+	// checks that there's nothing else on the line, and moves past it
+	void endCommand()
+	{
+		if (!atEndOfLine())
+		{
+			const char *b = pos, *e;
+			readToken(b, e, "");
+			fail(b, "unexpected '" + std::string(b, e) + "' at the end of the line.");
+		}
+		skipLine();
+	}
+
+	// throws an error for the text at p
+	void fail(const char *p, const std::string &msg) const
+	{
+		std::ostringstream ss;
+		ss << "Invalid skeleton file: " << source << ", line " << line << ", column " << (p - lineStart + 1) << ": " << msg;
+		throw std::runtime_error(ss.str());
+	}
+
+	static bool parseDouble(const char *b, const char *e, double &x);
+	static bool parseInt(const char *b, const char *e, int &n);
+
+private:
+	const char *pos;
+	const char *end;
+	const char *lineStart;
+	int line;
+	const std::string &source;
+
+	static bool isSpace(char c)
+	{ return (c == ' ') || (c == '\t') || (c == '\r'); }
+
+	// skips any spaces, and returns true if there are no more tokens on the line
+	bool atEndOfLine()
+	{
+		while ((pos != end) && isSpace(*pos))
+			++pos;
+		return (pos == end) || (*pos == '\n') || (*pos == '%');
+	}
+
+	void skipLine()
+	{
+		while ((pos != end) && (*pos != '\n'))
+			++pos;
+		if (pos != end)
+		{
+			++pos;
+			++line;
+			lineStart = pos;
+		}
+	}
+};
+
+bool SkeletonTextReader::parseDouble(const char *b, const char *e, double &x)
+{
+	// the exact powers of ten that a double can hold
+	static const double powersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char *p = b;
+	const bool negative = (p != e) && (*p == '-');
+	if ((p != e) && ((*p == '-') || (*p == '+')))
+		++p;
+
+	// the digits go into an integer mantissa (as many as it can take), and the
+	// decimal point and the exponent into a power of ten
+	unsigned long long mantissa = 0;
+	int numSignificant = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+	for (; (p != e) && (*p >= '0') && (*p <= '9'); ++p)
+	{
+		anyDigits = true;
+		if (numSignificant < 19)
+		{
+			mantissa = mantissa*10 + (*p - '0');
+			if (mantissa != 0) ++numSignificant;
+		}
+		else
+		{
+			++numSignificant;
+			++exponent;
+		}
+	}
+	if ((p != e) && (*p == '.'))
+	{
+		for (++p; (p != e) && (*p >= '0') && (*p <= '9'); ++p)
+		{
+			anyDigits = true;
+			if (numSignificant < 19)
+			{
+				mantissa = mantissa*10 + (*p - '0');
+				if (mantissa != 0) ++numSignificant;
+				--exponent;
+			}
+			else
+				++numSignificant;
+		}
+	}
+	if (!anyDigits)
+		return false;
+
+	if ((p != e) && ((*p == 'e') || (*p == 'E')))
+	{
+		++p;
+		const bool negativeExponent = (p != e) && (*p == '-');
+		if ((p != e) && ((*p == '-') || (*p == '+')))
+			++p;
+		if ((p == e) || (*p < '0') || (*p > '9'))
+			return false;
+		int n = 0;
+		for (; (p != e) && (*p >= '0') && (*p <= '9'); ++p)
+			n = std::min(n*10 + (*p - '0'), 100000);
+		exponent += negativeExponent ? -n : n;
+	}
+	if (p != e)
+		return false;
+
+	// with at most 15 significant digits, the mantissa and the power of ten are both exact,
+	// so one multiply or divide gives the correctly rounded result (the same as strtod);
+	// anything else is rare enough to be handed on to strtod
+	if ((numSignificant <= 15) && (exponent >= -22) && (exponent <= 22))
+	{
+		const double m = (double)(long long)mantissa;
+		x = (exponent < 0) ? (m / powersOf10[-exponent]) : (m * powersOf10[exponent]);
+	}
+	else
+	{
+		char buf[64];
+		if (e - b >= (int)sizeof(buf))
+			return false;
+		std::copy(b, e, buf);
+		buf[e - b] = 0;
+		x = std::strtod(buf, 0);
+		return true;
+	}
+
+	if (negative)
+		x = -x;
+	return true;
+}
+
+bool SkeletonTextReader::parseInt(const char *b, const char *e, int &n)
+{
+	const char *p = b;
+	const bool negative = (p != e) && (*p == '-');
+	if ((p != e) && ((*p == '-') || (*p == '+')))
+		++p;
+	if ((p == e) || (e - p > 9))
+		return false;
+
+	n = 0;
+	for (; p != e; ++p)
+	{
+		if ((*p < '0') || (*p > '9'))
+			return false;
+		n = n*10 + (*p - '0');
+	}
+	if (negative)
+		n = -n;
+	return true;
+}
+
+static bool tokenIs(const char *b, const char *e, const char *word)
+{
+	const size_t n = std::strlen(word);
+	return ((size_t)(e - b) == n) && (std::memcmp(b, word, n) == 0);
+}
+
+size_t readSkeletonFile(const std::string &fname, std::vector<double> &buf)
+{
+	std::ifstream fs(fname.c_str(), std::ios::in | std::ios::binary);
+	if (!fs.good())
+		throw std::runtime_error("Could not open skeleton file '" + fname + "'.");
+	fs.seekg(0, std::ios::end);
+	const size_t size = (size_t)fs.tellg();
+	fs.seekg(0, std::ios::beg);
+
+	buf.resize(std::max<size_t>((size + 7) / 8, 1));
+	fs.read(reinterpret_cast<char*>(&buf[0]), size);
+	if (!fs.good())
+		throw std::runtime_error("Could not read skeleton file '" + fname + "'.");
+	return size;
+}
+
+Skeleton::Skeleton()
+:	image(0)
+{
+	useOwnArrays();
+}
+
+Skeleton::Skeleton(const Skeleton &other)
+:	RefCounted(),
+	image(0)
+{
+	*this = other;
+}
+
+Skeleton &Skeleton::operator=(const Skeleton &other)
+{
+	if (&other == this)
+		return *this;
+
+	ownBones = other.ownBones;
+	ownJoints = other.ownJoints;
+	ownNames = other.ownNames;
+	ownTopology = other.ownTopology;
+	ownImage = other.ownImage;
+
+	if (other.image == 0)
+	{
+		image = 0;
+		useOwnArrays();
+		return *this;
+	}
+
+	// the arrays are in an image: the copy of the other's image file, if it kept one, or else the caller's
+	// image, which is shared; either way, they're at the same places relative to its start
+	const char *from = other.image;
+	image = other.ownImage.empty() ? other.image : reinterpret_cast<const char*>(&ownImage[0]);
+	boneCount = other.boneCount;
+	bones = reinterpret_cast<const Bone*>(image + (reinterpret_cast<const char*>(other.bones) - from));
+	joints = reinterpret_cast<const Bone::Connection*>(image + (reinterpret_cast<const char*>(other.joints) - from));
+	names = image + (other.names - from);
+	treeParents = reinterpret_cast<const int*>(image + (reinterpret_cast<const char*>(other.treeParents) - from));
+	treeDepths = reinterpret_cast<const int*>(image + (reinterpret_cast<const char*>(other.treeDepths) - from));
+	parentJointIdx = reinterpret_cast<const int*>(image + (reinterpret_cast<const char*>(other.parentJointIdx) - from));
+	childJointIdx = reinterpret_cast<const int*>(image + (reinterpret_cast<const char*>(other.childJointIdx) - from));
+	return *this;
+}
+
+void Skeleton::clear()
+{
+	ownBones.clear();
+	ownJoints.clear();
+	ownNames.clear();
+	ownTopology.clear();
+	ownImage.clear();
+	image = 0;
+	useOwnArrays();
+}
+
+void Skeleton::useOwnArrays()
+{
+	const int n = (int)ownBones.size();
+	boneCount = n;
+	bones = ownBones.empty() ? 0 : &ownBones[0];
+	joints = ownJoints.empty() ? 0 : &ownJoints[0];
+	names = ownNames.empty() ? 0 : &ownNames[0];
+
+	const int *topology = ownTopology.empty() ? 0 : &ownTopology[0];
+	treeParents = topology;
+	treeDepths = topology ? topology + n : 0;
+	parentJointIdx = topology ? topology + 2*n : 0;
+	childJointIdx = topology ? topology + 3*n : 0;
+}
+
+void Skeleton::loadFromFile(const std::string &fname)
+{
+	std::vector<double> buf;
+	const size_t size = readSkeletonFile(fname, buf);
+	if (SkeletonImage::hasMagic(&buf[0], size))
+	{
+		// read the image in place, and keep it (swapping the buffer in doesn't move it)
+		useImage(SkeletonImage(&buf[0], size));
+		ownImage.swap(buf);
+	}
+	else
+		loadFromText(reinterpret_cast<const char*>(&buf[0]), size, fname);
+}
+
+void Skeleton::loadFromMemory(const void *data, size_t size, const std::string &source)
+{
+	if (SkeletonImage::hasMagic(data, size))
+		loadFromImage(SkeletonImage(data, size));
+	else
+		loadFromText(static_cast<const char*>(data), size, source);
+}
+
+void Skeleton::loadFromText(const char *text, size_t size, const std::string &source)
+{
+	// reset the existing skeleton
+	clear();
+
+	SkeletonTextReader rd(text, size, source);
+	const char *cmdBegin, *cmdEnd;
+
+	if (!rd.nextCommand())
+		rd.fail(text, "bad header (it's empty).");
+	rd.readToken(cmdBegin, cmdEnd, "the header");
+	if (!tokenIs(cmdBegin, cmdEnd, "skeleton"))
+		rd.fail(cmdBegin, "bad header (it should start with 'skeleton').");
+	rd.endCommand();
+
+	std::vector<int> roots;
+	std::vector<int> fixedBones;
+	vec3d summedRootWorldPos(0.0, 0.0, 0.0);
+	JointLists lists;
+
+	// the bones are numbered in the file from 0 (the root bone, which is left out)
+	int fileBoneId = 0;
+
+	while (rd.nextCommand())
+	{
+		rd.readToken(cmdBegin, cmdEnd, "a command");
+
+		if (tokenIs(cmdBegin, cmdEnd, "bonecount"))
+		{
+			const int n = rd.readInt("the number of bones");
+			if (n < 1)
+				rd.fail(cmdBegin, "the number of bones has to be at least 1.");
+			ownBones.reserve(n - 1);
+			lists.reserve(n - 1);
+		}
+		else if (tokenIs(cmdBegin, cmdEnd, "bone"))
+		{
+			const char *nameBegin, *nameEnd;
+			rd.readToken(nameBegin, nameEnd, "the bone's name");
+
+			vec3d worldPos, displayVec;
+			worldPos.x = rd.readDouble("the bone's x position");
+			worldPos.y = rd.readDouble("the bone's y position");
+			worldPos.z = rd.readDouble("the bone's z position");
+			displayVec.x = rd.readDouble("the bone's x display vector");
+			displayVec.y = rd.readDouble("the bone's y display vector");
+			displayVec.z = rd.readDouble("the bone's z display vector");
+
+			const char *parentBegin, *parentEnd;
+			rd.readToken(parentBegin, parentEnd, "the bone's parent id");
+			int parentId;
+			if (!SkeletonTextReader::parseInt(parentBegin, parentEnd, parentId))
+				rd.fail(parentBegin, "expected the bone's parent id, not '" + std::string(parentBegin, parentEnd) + "'.");
+
+			// the first bone is the root, and the others' parents have to come before them
+			if ((fileBoneId == 0) && (parentId != -1))
+				rd.fail(parentBegin, "the first bone has to be the root bone, with a parent id of -1.");
+			if ((fileBoneId > 0) && ((parentId < 0) || (parentId >= fileBoneId)))
+			{
+				std::ostringstream ss;
+				ss << "bad parent id " << parentId << " (it has to be the id of a bone before this one, from 0 to " << (fileBoneId - 1) << ").";
+				rd.fail(parentBegin, ss.str());
+			}
+
+			const char *typeBegin, *typeEnd;
+			rd.readToken(typeBegin, typeEnd, "the bone's joint type");
+
+			bool isFixed = false;
+			JointConstraints constraints;
+
+			if (tokenIs(typeBegin, typeEnd, "fixed"))
+				isFixed = true;
+			else if (tokenIs(typeBegin, typeEnd, "ball"))
+				constraints = JointConstraints(JointConstraints::Ball);
+			else if (tokenIs(typeBegin, typeEnd, "saddle"))
+				constraints = JointConstraints(JointConstraints::Saddle);
+			else if (tokenIs(typeBegin, typeEnd, "hinge"))
+				constraints = JointConstraints(JointConstraints::Hinge);
+			else if (tokenIs(typeBegin, typeEnd, "pivot"))
+				constraints = JointConstraints(JointConstraints::Pivot);
+			else if (tokenIs(typeBegin, typeEnd, "custom"))
+			{
+				constraints.type = JointConstraints::Custom;
+				const double toRadians = M_PI/180.0;
+				constraints.minAzimuth = rd.readDouble("the minimum azimuth") * toRadians;
+				constraints.maxAzimuth = rd.readDouble("the maximum azimuth") * toRadians;
+				constraints.minElevation = rd.readDouble("the minimum elevation") * toRadians;
+				constraints.maxElevation = rd.readDouble("the maximum elevation") * toRadians;
+				constraints.minTwist = rd.readDouble("the minimum twist") * toRadians;
+				constraints.maxTwist = rd.readDouble("the maximum twist") * toRadians;
+				constraints.prepareLimits();
+			}
+			else
+				rd.fail(typeBegin, "unknown joint type '" + std::string(typeBegin, typeEnd) + "' (it should be fixed, ball, saddle, hinge, pivot or custom).");
+
+			// ignore the root bone itself...
+			if (fileBoneId > 0)
+			{
+				const int id = (int)ownBones.size();
+				ownBones.push_back(Bone(id));
+				lists.resize(id + 1);
+				Bone &b = ownBones.back();
+				b.nameOffset = (int)ownNames.size();
+				ownNames.insert(ownNames.end(), nameBegin, nameEnd);
+				ownNames.push_back(0);
+				b.worldPos = worldPos;
+				b.displayVec = displayVec;
+				b.constraints = constraints;
+
+				if (isFixed)
+					fixedBones.push_back(id);
+
+				if (parentId > 0)
+				{
+					const Bone &bp = ownBones[parentId - 1];
+					b.primaryJointIdx = 0;
+					lists[id].push_back(Bone::Connection(bp.id, vec3d(0.0, 0.0, 0.0)));
+					lists[bp.id].push_back(Bone::Connection(id, b.worldPos - bp.worldPos));
+				}
+				else
+				{
+					summedRootWorldPos += b.worldPos;
+					roots.push_back(id);
+				}
+			}
+			++fileBoneId;
+		}
+		else
+			rd.fail(cmdBegin, "unknown command '" + std::string(cmdBegin, cmdEnd) + "'.");
+
+		rd.endCommand();
+	}
+
+	if (roots.empty())
+		rd.fail(text + size, "there are no bones attached to the root bone.");
+
+	// fix up the root bones to all connect to each other
+	// and ensure they only connect in a single place
+	// (if they didn't, they'd need another bone to connect
+	// them all to give a known spatial relationship between
+	// the root joints, and so *that* bone would be the root bone)
+	vec3d rootWorldPos = summedRootWorldPos / (double)roots.size();
+
+	for (int i = 0; i < (int)roots.size(); ++i)
+	{
+		for (int j = 0; j < (int)roots.size(); ++j)
+		{
+			if (i != j)
+			{
+				Bone &a = ownBones[roots[i]];
+
+				a.primaryJointIdx = (int)lists[a.id].size();
+				lists[a.id].push_back(Bone::Connection(roots[j], vec3d(0.0, 0.0, 0.0)));
+				const vec3d shift = rootWorldPos - a.worldPos;
+				if (length(shift) > 0.0000001)
+					shiftBoneWorldPositions(lists, -1, a.id, shift);
+			}
+		}
+	}
+
+	// add an extra bone to represent each effector tip
+	const int numRealBones = (int)ownBones.size();
+	for (int i = 0; i < numRealBones; ++i)
+	{
+		const std::vector<Bone::Connection> &bj = lists[i];
+		const bool isEffector = (bj.size() == 1) && (bj[0].pos == vec3d(0.0, 0.0, 0.0));
+		if (isEffector && (length(ownBones[i].displayVec) > 0.0001))
+		{
+			const int tipId = (int)ownBones.size();
+			ownBones.push_back(Bone(tipId));
+			lists.resize(tipId + 1);
+			Bone &b = ownBones[i];
+			Bone &be = ownBones.back();
+
+			be.nameOffset = (int)ownNames.size();
+			const std::string tipName = std::string(&ownNames[b.nameOffset]) + "-tip";
+			ownNames.insert(ownNames.end(), tipName.begin(), tipName.end());
+			ownNames.push_back(0);
+			be.displayVec = vec3d(0.0, 0.0, 0.0);
+			be.worldPos = b.worldPos + b.displayVec;
+			be.primaryJointIdx = 0;
+			be.constraints = JointConstraints(JointConstraints::Fixed);
+
+			lists[tipId].push_back(Bone::Connection(i, vec3d(0.0, 0.0, 0.0)));
+			lists[i].push_back(Bone::Connection(tipId, b.displayVec));
+		}
+	}
+
+	packJoints(lists);
+	initTopology();
+	useOwnArrays();
+	initBoneMatrices();
+
+	for (int i = 0; i < (int)fixedBones.size(); ++i)
+	{
+		Bone &b = ownBones[fixedBones[i]];
+		const Bone *parent = getParent(b);
+		const mat3d rot =
+			(parent != 0)
+			?	(transpose(parent->defaultOrient) * b.defaultOrient)
+			:	b.defaultOrient;
+		vec3d dir;
+		double az, el, twist;
+		rotationToAzimuthElevationTwist(rot, dir, az, el, twist);
+		b.constraints.minAzimuth = b.constraints.maxAzimuth = az;
+		b.constraints.minElevation = b.constraints.maxElevation = el;
+		b.constraints.minTwist = b.constraints.maxTwist = twist;
+		b.constraints.prepareLimits();
+	}
+}
+
+void Skeleton::loadFromImage(const SkeletonImage &image)
+{
+	const int n = image.numBones();
+	const SkeletonImageHeader &h = image.header();
+
+	clear();
+
+	// the image's sections are already packed the same way as the skeleton's arrays
+	ownBones.assign(image.bones(), image.bones() + n);
+	ownJoints.assign(image.joints(), image.joints() + h.numJoints);
+	ownNames.assign(image.boneNames(), image.boneNames() + h.namesSize);
+	ownTopology.assign(image.topology(), image.topology() + 4*n);
+	useOwnArrays();
+}
+
+void Skeleton::useImage(const SkeletonImage &image)
+{
+	const int n = image.numBones();
+
+	clear();
+	this->image = reinterpret_cast<const char*>(&image.header());
+	boneCount = n;
+	bones = image.bones();
+	joints = image.joints();
+	names = image.boneNames();
+	treeParents = image.treeParents();
+	treeDepths = image.treeDepths();
+	parentJointIdx = image.parentJointIdx();
+	childJointIdx = image.childJointIdx();
+}
+
+void Skeleton::shiftBoneWorldPositions(const JointLists &lists, int from, int b, const vec3d &shift)
+{
+	ownBones[b].worldPos += shift;
+	for (int i = 1; i < (int)lists[b].size(); ++i)
+	{
+		const int c = lists[b][i].to;
+		if (c != from)
+			shiftBoneWorldPositions(lists, b, c, shift);
+	}
+}
+
+void Skeleton::packJoints(const JointLists &lists)
+{
+	int total = 0;
+	for (int i = 0; i < (int)lists.size(); ++i)
+		total += (int)lists[i].size();
+
+	ownJoints.clear();
+	ownJoints.reserve(total);
+	for (int i = 0; i < (int)lists.size(); ++i)
+	{
+		Bone &b = ownBones[i];
+		b.firstJoint = (int)ownJoints.size();
+		b.numJoints = (int)lists[i].size();
+		ownJoints.insert(ownJoints.end(), lists[i].begin(), lists[i].end());
+	}
+}
+
+int Skeleton::findJointWith(const Bone &from, const Bone &to) const
+{
+	const Bone::Connection *bj = getJoints(from);
+	for (int i = 0; i < from.numJoints; ++i)
+	{
+		if (bj[i].to == to.id)
+			return i;
+	}
+	return -1;
+}
+
+void Skeleton::initTopology()
+{
+	const int n = (int)ownBones.size();
+	ownTopology.assign(4*n, -1);
+	if (n == 0)
+		return;
+
+	int *parents = &ownTopology[0];
+	int *depths = parents + n;
+	int *parentJoints = parents + 2*n;
+	int *childJoints = parents + 3*n;
+	std::fill(depths, depths + n, 0);
+
+	// walk the tree outwards from bone 0
+	// (bones are added to the list in the order they're reached, so it's also the work queue)
+	std::vector<int> reached;
+	reached.reserve(n);
+	reached.push_back(0);
+
+	for (int k = 0; k < (int)reached.size(); ++k)
+	{
+		const Bone &b = ownBones[reached[k]];
+		const Bone::Connection *bj = &ownJoints[b.firstJoint];
+		for (int i = 0; i < b.numJoints; ++i)
+		{
+			const Bone &bn = ownBones[bj[i].to];
+			if (bn.id == parents[b.id])
+				continue;
+			if ((bn.id == 0) || (parents[bn.id] >= 0))
+				throw std::runtime_error("Invalid skeleton file: the bones form a loop.");
+
+			parents[bn.id] = b.id;
+			depths[bn.id] = depths[b.id] + 1;
+			childJoints[bn.id] = i;
+			const Bone::Connection *nj = &ownJoints[bn.firstJoint];
+			for (int j = 0; j < bn.numJoints; ++j)
+			{
+				if (nj[j].to == b.id)
+					parentJoints[bn.id] = j;
+			}
+			reached.push_back(bn.id);
+		}
+	}
+
+	if ((int)reached.size() != n)
+		throw std::runtime_error("Invalid skeleton file: the bones are not all connected.");
+}
+
+int Skeleton::findCommonAncestor(int a, int b) const
+{
+	while (treeDepths[a] > treeDepths[b])
+		a = treeParents[a];
+	while (treeDepths[b] > treeDepths[a])
+		b = treeParents[b];
+	while (a != b)
+	{
+		a = treeParents[a];
+		b = treeParents[b];
+	}
+	return a;
+}
+
+void Skeleton::findPath(const Bone &from, const Bone &to, std::vector<const Bone*> &path) const
+{
+	const int common = findCommonAncestor(from.id, to.id);
+	const int toSteps = treeDepths[to.id] - treeDepths[common];
+	const int fromSteps = treeDepths[from.id] - treeDepths[common];
+
+	// up from 'to' to the common ancestor, then down to 'from'
+	// (the second half is filled in backwards, going up from 'from')
+	path.resize(toSteps + fromSteps + 1);
+
+	int id = to.id;
+	for (int i = 0; i < toSteps; ++i, id = treeParents[id])
+		path[i] = &bones[id];
+	path[toSteps] = &bones[common];
+
+	id = from.id;
+	for (int i = toSteps + fromSteps; i > toSteps; --i, id = treeParents[id])
+		path[i] = &bones[id];
+}
+
+void Skeleton::initBoneMatrices()
+{
+	initBoneMatrix(0, ownBones[0]);
+}
+
+void Skeleton::initBoneMatrix(const Bone *parent, Bone &bone)
+{
+	// early-out for effectors (they keep the identity matrix)
+	if (isEffector(bone)) return;
+
+	Bone::Connection *bj = &ownJoints[bone.firstJoint];
+	vec3d dir;
+
+	if (bone.numJoints == 2)
+	{
+		vec3d a = bj[0].pos;
+		vec3d b = bj[1].pos;
+		if (bone.primaryJointIdx == 0)
+			dir = normalize(b - a);
+		else
+			dir = normalize(a - b);
+	}
+	else
+	{
+		// early-out if the bone has zero length
+		if (length_squared(bone.displayVec) < 0.0001)
+			return;
+		dir = normalize(bone.displayVec);
+	}
+
+	if (parent != 0)
+		dir = transpose(parent->defaultOrient) * dir;
+
+	bone.defaultOrient = calcDirectRotation(unitY, dir);
+
+	if (parent != 0)
+		bone.defaultOrient = parent->defaultOrient * bone.defaultOrient;
+
+	mat3d invOrient = transpose(bone.defaultOrient);
+	for (int i = 0; i < bone.numJoints; ++i)
+	{
+		Bone::Connection &c = bj[i];
+		c.pos = invOrient * c.pos;
+	}
+	bone.displayVec = invOrient * bone.displayVec;
+
+	for (int i = 0; i < bone.numJoints; ++i)
+	{
+		Bone &c = ownBones[bj[i].to];
+		if (&c != parent)
+			initBoneMatrix(&bone, c);
+	}
+}
+
+// ===== Skeleton Text Test ==================================================
+
+// checks that loading some text fails with an error at the given place ("line 3, column 12")
+static void expectTextError(const char *text, const char *where)
+{
+	std::string msg;
+	try
+	{
+		Skeleton skel;
+		skel.loadFromMemory(text, std::strlen(text), "test");
+	}
+	catch (std::runtime_error &e)
+	{
+		msg = e.what();
+	}
+	assert(msg.find(std::string("test, ") + where + ":") != std::string::npos);
+}
+
+void testSkeletonText()
+{
+	// the numbers come out exactly as strtod reads them
+	unsigned int seed = 12345;
+	for (int i = 0; i < 20000; ++i)
+	{
+		seed = seed*1664525u + 1013904223u;
+		const double x = (double)(int)seed / (double)(1 << (seed % 24));
+		static const char *const formats[] = { "%f", "%.3f", "%.17g", "%g", "%e", "%.20f" };
+
+		char buf[128];
+		std::sprintf(buf, formats[i % 6], x);
+		double parsed;
+		const bool ok = SkeletonTextReader::parseDouble(buf, buf + std::strlen(buf), parsed);
+		assert(ok);
+		assert(parsed == std::strtod(buf, 0));
+		(void)ok;
+	}
+	{
+		double x;
+		const char *bad[] = { "", "-", ".", "1.2.3", "1e", "1e+", "x1", "1x", "--1" };
+		for (int i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); ++i)
+		{
+			const bool ok = SkeletonTextReader::parseDouble(bad[i], bad[i] + std::strlen(bad[i]), x);
+			assert(!ok);
+			(void)ok;
+		}
+	}
+
+	// comments, blank lines, tabs and Windows line endings are all fine
+	{
+		const char *text =
+			"% a test skeleton\r\n"
+			"skeleton\r\n"
+			"\r\n"
+			"bonecount 3\t% (the root isn't counted)\r\n"
+			"bone Root  0 0 0   0 1 0  -1 fixed\r\n"
+			"bone\tA    0 0 0   0 1 0   0 custom 0 0 -70 70 0 0\r\n"
+			"bone B    0 1 0   0 1.5 0   1 hinge";
+		Skeleton skel;
+		skel.loadFromMemory(text, std::strlen(text), "test");
+		assert(skel.numBones() == 3);
+		assert(std::strcmp(skel.getName(skel[0]), "A") == 0);
+		assert(std::strcmp(skel.getName(skel[1]), "B") == 0);
+		assert(skel[1].constraints.type == JointConstraints::Hinge);
+		assert(std::strcmp(skel.getName(skel[2]), "B-tip") == 0);
+		assert(std::abs(skel[0].constraints.maxElevation - 70.0*M_PI/180.0) < 1e-12);
+
+		// a copy has its own bones, joints and names, linked up the same way
+		Skeleton copy(skel);
+		assert(copy.getParent(copy[1]) == &copy[0]);
+		assert(copy.getJoint(copy[1], copy[2]).pos == skel.getJoint(skel[1], skel[2]).pos);
+		assert(std::strcmp(copy.getName(copy[2]), "B-tip") == 0);
+	}
+
+	// errors say where they are
+	expectTextError("skeletn\n", "line 1, column 1");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\nbone A 0 0 x 0 1 0 0 ball\n", "line 3, column 12");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\nbone A 0 0 0 0 1 0\n", "line 3, column 19");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\nbone A 0 0 0 0 1 0 1 ball\n", "line 3, column 20");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 0 fixed\n", "line 2, column 23");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\nbone A 0 0 0 0 1 0 0 bal\n", "line 3, column 22");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\nbone A 0 0 0 0 1 0 0 ball 5\n", "line 3, column 27");
+	expectTextError("skeleton\r\n\r\nbones 3\r\n", "line 3, column 1");
+	expectTextError("skeleton\nbone Root 0 0 0 0 1 0 -1 fixed\n", "line 3, column 1");
+}
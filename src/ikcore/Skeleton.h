@@ -0,0 +1,301 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+// A Skeleton represents a set of bones and the joints between them
+// it provides methods to load the skeleton and get at the bone and joint information
+
+class SkeletonImage;
+
+class JointConstraints
+{
+public:
+	enum JointType
+	{
+		Fixed,  // a fixed joint doesn't allow any rotation
+		Custom,
+		Ball,   // a ball and socket joint allows reorientation, with twist
+		Saddle, // a ball and socket joint allows reorientation, but no twist
+		Hinge,  // a hinge joint only allows changes in elevation (eg, knee)
+		Pivot   // a pivot joint only allows twist (eg, neck, sort of...)
+	};
+
+	JointConstraints()
+	:	type(Ball),
+		minAzimuth(-M_PI), maxAzimuth(M_PI),
+		minElevation(-M_PI), maxElevation(M_PI),
+		minTwist(-M_PI), maxTwist(M_PI)
+	{
+		prepareLimits();
+	}
+
+	JointConstraints(
+		JointType type
+	)
+	:	type(type),
+		minAzimuth(0.0), maxAzimuth(0.0),
+		minElevation(0.0), maxElevation(0.0),
+		minTwist(0.0), maxTwist(0.0)
+	{
+		if (type == Ball)
+		{
+			minElevation = 0.0;
+			maxElevation = M_PI/2.0;
+			minTwist = minAzimuth = -M_PI;
+			maxTwist = maxAzimuth = M_PI;
+		}
+		else if (type == Saddle)
+		{
+			minElevation = 0.0;
+			maxElevation = M_PI/2.0;
+			minAzimuth = -M_PI;
+			maxAzimuth = M_PI;
+			minTwist = maxTwist = 0.0;
+		}
+		else if (type == Hinge)
+		{
+			minElevation = 0.0;
+			maxElevation = M_PI;
+			minAzimuth = maxAzimuth = 0.0;
+			minTwist = maxTwist = 0.0;
+		}
+		else if (type == Pivot)
+		{
+			minElevation = maxElevation = 0.0;
+			minAzimuth = maxAzimuth = 0.0;
+			minTwist = -M_PI;
+			maxTwist = M_PI;
+		}
+
+		prepareLimits();
+	}
+
+	JointConstraints(
+		JointType type,
+		double minAzimuth, double maxAzimuth,
+		double minElevation, double maxElevation,
+		double minTwist, double maxTwist
+	)
+	:	type(type),
+		minAzimuth(minAzimuth), maxAzimuth(maxAzimuth),
+		minElevation(minElevation), maxElevation(maxElevation),
+		minTwist(minTwist), maxTwist(maxTwist)
+	{
+		prepareLimits();
+	}
+
+	JointType type;
+
+	double minAzimuth, maxAzimuth;
+	double minElevation, maxElevation;
+	double minTwist, maxTwist;
+
+	// a limit angle as a point on the unit circle, so that it can be compared with
+	// other angles without any trig (see constrainRot in IkKernel.cpp)
+	// angles outside -pi..pi are wrapped, with the number of whole turns kept separately
+	// (the twist is relative to the azimuth, so its limits can be anywhere in -2pi..2pi)
+	struct AngleLimit
+	{
+		double c, s;
+		int turns;
+	};
+
+	// the limits above, as [min, max]
+	// these must be updated (with prepareLimits) whenever the angles are changed
+	AngleLimit azimuthLimits[2];
+	AngleLimit elevationLimits[2];
+	AngleLimit twistLimits[2];
+
+	void prepareLimits();
+};
+
+// a bone is plain data: its links to other bones are bone ids, and its joints and name are
+// kept by the skeleton, in arrays shared by all the bones (see Skeleton::getJoints)
+class Bone
+{
+public:
+	struct Connection
+	{
+		explicit Connection(int to, vec3d v)
+			: to(to), pos(v) {}
+
+		// the id of the bone that this connection goes to
+		int to;
+
+		// position of the joint in bone-space
+		// typically one joint will have a position of 0,0,0, but it's not required
+		vec3d pos;
+	};
+
+	explicit Bone(int id):
+		id(id), firstJoint(0), numJoints(0), nameOffset(0), primaryJointIdx(-1),
+		displayVec(0.0, 0.0, 0.0), worldPos(0.0, 0.0, 0.0), defaultOrient(1.0)
+	{}
+
+	int id;
+
+	// the bone's joints are [firstJoint, firstJoint + numJoints) in the skeleton's joints;
+	// joint indices (eg, primaryJointIdx) count from firstJoint
+	int firstJoint;
+	int numJoints;
+
+	// the bone's name, as an offset into the skeleton's names
+	int nameOffset;
+
+	// the skeleton has a tree of bones
+	// this may not be the same tree used by clients of the skeleton,
+	// (eg, the IkSolver can change the tree to set different bones as root),
+	// but the parent-child relationships in this tree are used
+	// when dealing with joint constraints and some other joint properties
+	// it is assumed that each bone has a 'primary' joint which links to its parent
+	int primaryJointIdx;
+	JointConstraints constraints;
+
+	// the bone is displayed going from its 0,0,0 point
+	// to the displayVec (in bone-space)
+	// (0,0,0 is usually the position of one of its connections)
+	vec3d displayVec;
+
+	// the default world position of the origin of the bone-space basis
+	vec3d worldPos;
+
+	// the default orientation of the bone
+	// this is a matrix which takes a vector from bone space to world space
+	// nb: this is the *absolute* orientation of the bone
+	// (which makes it independent of traversal order)
+	mat3d defaultOrient;
+
+	bool hasParent() const
+	{ return (primaryJointIdx >= 0) && (primaryJointIdx < numJoints); }
+};
+
+// A skeleton's bones, joints, names and topology tables are flat arrays, which are either the skeleton's own,
+// or the sections of a compiled image (see SkeletonImage.h), read in place without being copied or unpacked
+class Skeleton : public RefCounted
+{
+public:
+	Skeleton();
+
+	// (a copy has arrays of its own, unless the original reads a caller's image in place, which the copy shares)
+	Skeleton(const Skeleton &other);
+	Skeleton &operator=(const Skeleton &other);
+
+	// the file can be a text skeleton file, or a compiled image (see SkeletonImage.h);
+	// the skeleton keeps an image file's contents, and reads them in place
+	void loadFromFile(const std::string &fname);
+
+	// loads a skeleton from a file's contents in memory (either kind of file), which are copied;
+	// source names it in the error messages
+	void loadFromMemory(const void *data, size_t size, const std::string &source);
+
+	// loads a skeleton from a compiled image, which is already fully set up, copying its arrays
+	void loadFromImage(const SkeletonImage &image);
+
+	// reads a compiled image in place, without copying anything (eg, from a mapped file); the image's memory
+	// must stay put, and unchanged, for as long as the skeleton (or a copy of it) is in use, or until it's loaded again
+	void useImage(const SkeletonImage &image);
+
+	const Bone &operator[](int idx) const
+	{ return bones[idx]; }
+
+	int numBones() const
+	{ return boneCount; }
+
+	// a bone's joints (there are b.numJoints of them)
+	const Bone::Connection *getJoints(const Bone &b) const
+	{ return joints + b.firstJoint; }
+
+	const char *getName(const Bone &b) const
+	{ return &names[b.nameOffset]; }
+
+	// the bone at the other end of a bone's primary joint, or null
+	const Bone *getParent(const Bone &b) const
+	{ return b.hasParent() ? &bones[joints[b.firstJoint + b.primaryJointIdx].to] : 0; }
+
+	bool isEffector(const Bone &b) const
+	{ return (b.numJoints == 1) && (joints[b.firstJoint].pos == vec3d(0.0, 0.0, 0.0)); }
+
+	// the index of a bone's joint with another bone (among its own joints), or -1 if they aren't joined
+	int findJointWith(const Bone &from, const Bone &to) const;
+
+	// ----- topology -----
+	// the bones and joints form a tree; these tables flatten it (rooted at bone 0),
+	// and are built when the skeleton is loaded, so that walking between bones
+	// never has to search
+	// (this isn't necessarily the tree given by the primary joints: in that,
+	// the root bones are each other's parents)
+
+	// a bone's parent in the tree (-1 for bone 0), and its distance from bone 0
+	int getTreeParent(int id) const
+	{ return treeParents[id]; }
+	int getTreeDepth(int id) const
+	{ return treeDepths[id]; }
+
+	// the joint which connects two adjacent bones, as seen from the first of them
+	const Bone::Connection &getJoint(const Bone &from, const Bone &to) const
+	{
+		// one of the bones is the other's parent in the tree
+		const int idx = (treeParents[from.id] == to.id) ? parentJointIdx[from.id] : childJointIdx[to.id];
+		assert(joints[from.firstJoint + idx].to == to.id);
+		return joints[from.firstJoint + idx];
+	}
+
+	// the bone where the paths from two bones up to bone 0 meet
+	int findCommonAncestor(int a, int b) const;
+
+	// the path through the skeleton from one bone to another
+	// the path is given from the 'to' bone back to the 'from' bone (inclusive)
+	void findPath(const Bone &from, const Bone &to, std::vector<const Bone*> &path) const;
+
+private:
+	// the arrays in use: the bones, all of their joints (each bone's together), and all of their names
+	// (each terminated by a 0), and the topology tables; these point either at the skeleton's own arrays
+	// below, or into an image
+	int boneCount;
+	const Bone *bones;
+	const Bone::Connection *joints;
+	const char *names;
+
+	const int *treeParents;
+	const int *treeDepths;
+
+	// for each bone, the index of its joint with its parent, in its own joints
+	// and in its parent's joints (both -1 for bone 0)
+	const int *parentJointIdx;
+	const int *childJointIdx;
+
+	// the skeleton's own arrays (built by the text loader, or copied from an image)
+	std::vector<Bone> ownBones;
+	std::vector<Bone::Connection> ownJoints;
+	std::vector<char> ownNames;
+	std::vector<int> ownTopology;
+
+	// the start of the image that the arrays are in (null when they're the skeleton's own),
+	// and an image file's contents, when the skeleton keeps them itself (see loadFromFile)
+	const char *image;
+	std::vector<double> ownImage;
+
+	void clear();
+	void useOwnArrays();
+
+	// parses a text skeleton file; errors give the line and column
+	void loadFromText(const char *text, size_t size, const std::string &source);
+
+	void initTopology();
+
+	// (the text loader builds each bone's joints separately, then packs them together)
+	typedef std::vector<std::vector<Bone::Connection> > JointLists;
+	void shiftBoneWorldPositions(const JointLists &lists, int from, int b, const vec3d &shift);
+	void packJoints(const JointLists &lists);
+
+	void initBoneMatrices();
+	void initBoneMatrix(const Bone *parent, Bone &bone);
+};
+
+// reads a whole skeleton file (of either kind) into memory, returning its size in bytes
+// (it's read into doubles, so that a compiled skeleton is aligned)
+size_t readSkeletonFile(const std::string &fname, std::vector<double> &buf);
+
+// checks that the text skeleton parser reads numbers exactly, and reports errors in the right places
+void testSkeletonText();
+
+#endif
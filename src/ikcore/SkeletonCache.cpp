@@ -0,0 +1,164 @@
+#include "CoreGlobal.h"
+#include "SkeletonCache.h"
+
+#include <cstring>
+
+// ===== SkeletonCache =======================================================
+
+// (it's made before main, rather than on first use, so that the first uses can't race to make it)
+static SkeletonCache sharedCache;
+
+SkeletonCache &SkeletonCache::shared()
+{
+	return sharedCache;
+}
+
+RCPtr<const Skeleton> SkeletonCache::load(const std::string &fname)
+{
+	std::vector<double> buf;
+	const size_t size = readSkeletonFile(fname, buf);
+	return loadFromMemory(&buf[0], size, fname);
+}
+
+RCPtr<const Skeleton> SkeletonCache::loadFromMemory(const void *data, size_t size, const std::string &source)
+{
+	const unsigned int hash = MurmurHash2(data, (int)size, 0);
+	{
+		ScopedLock lk(lock);
+		RCPtr<const Skeleton> found = find(hash, data, size);
+		if (found)
+			return found;
+	}
+
+	// the skeleton is loaded without the lock held, so that different skeletons can be loaded at once
+	Skeleton *skel = new Skeleton();
+	RCPtr<const Skeleton> loaded(skel);
+	skel->loadFromMemory(data, size, source);
+
+	ScopedLock lk(lock);
+
+	// (another thread may have loaded the same skeleton in the meantime)
+	RCPtr<const Skeleton> found = find(hash, data, size);
+	if (found)
+		return found;
+
+	EntryMap::iterator it = entries.insert(std::make_pair(hash, Entry()));
+	it->second.content.assign(static_cast<const char*>(data), size);
+	it->second.skeleton = loaded;
+	return loaded;
+}
+
+RCPtr<const Skeleton> SkeletonCache::find(unsigned int hash, const void *data, size_t size) const
+{
+	std::pair<EntryMap::const_iterator, EntryMap::const_iterator> range = entries.equal_range(hash);
+	for (EntryMap::const_iterator it = range.first; it != range.second; ++it)
+	{
+		const std::string &content = it->second.content;
+		if ((content.size() == size) && (std::memcmp(content.data(), data, size) == 0))
+			return it->second.skeleton;
+	}
+	return RCPtr<const Skeleton>();
+}
+
+int SkeletonCache::purge()
+{
+	ScopedLock lk(lock);
+
+	int dropped = 0;
+	EntryMap::iterator it = entries.begin();
+	while (it != entries.end())
+	{
+		// (the cache's own reference is the only one; and nothing else can take one without the lock,
+		// so it's still the only one when it's dropped)
+		if (it->second.skeleton->refCount() == 1)
+		{
+			entries.erase(it++);
+			++dropped;
+		}
+		else
+			++it;
+	}
+	return dropped;
+}
+
+int SkeletonCache::size() const
+{
+	ScopedLock lk(lock);
+	return (int)entries.size();
+}
+
+// ===== Cache Test ==========================================================
+
+static const std::string cacheTestText =
+	"skeleton\n"
+	"bone Root  0 0 0   0 1 0  -1 fixed\n"
+	"bone A     0 0 0   0 1 0   0 ball\n"
+	"bone B     0 1 0   0 1 0   1 hinge\n";
+static const std::string cacheTestEdited =
+	"skeleton\n"
+	"bone Root  0 0 0   0 1 0  -1 fixed\n"
+	"bone A     0 0 0   0 1 0   0 ball\n"
+	"bone B     0 1 0   0 2 0   1 hinge\n";
+
+// loads the two test skeletons over and over, and takes and drops references to them
+static void cacheTestThread(void *arg)
+{
+	SkeletonCache &cache = *static_cast<SkeletonCache*>(arg);
+	for (int i = 0; i < 200; ++i)
+	{
+		const std::string &text = (i & 1) ? cacheTestEdited : cacheTestText;
+		RCPtr<const Skeleton> skel = cache.loadFromMemory(text.data(), text.size(), "thread.skl");
+		for (int j = 0; j < 1000; ++j)
+		{
+			RCPtr<const Skeleton> copy(skel);
+			assert(copy->numBones() == skel->numBones());
+		}
+	}
+}
+
+void testSkeletonCache()
+{
+	const std::string &text = cacheTestText;
+	const std::string &edited = cacheTestEdited;
+
+	SkeletonCache cache;
+
+	// the same content is shared, whatever it's called
+	RCPtr<const Skeleton> a = cache.loadFromMemory(text.data(), text.size(), "a.skl");
+	RCPtr<const Skeleton> b = cache.loadFromMemory(text.data(), text.size(), "b.skl");
+	assert(a.get() == b.get());
+	assert(cache.size() == 1);
+
+	// different content isn't
+	RCPtr<const Skeleton> c = cache.loadFromMemory(edited.data(), edited.size(), "a.skl");
+	assert(c.get() != a.get());
+	assert((*c)[1].displayVec != (*a)[1].displayVec);
+	assert(cache.size() == 2);
+
+	// only the skeletons nothing else is using are dropped
+	assert(cache.purge() == 0);
+	c.reset();
+	assert(cache.purge() == 1);
+	assert(cache.size() == 1);
+	a.reset();
+	assert(cache.purge() == 0);
+	b.reset();
+	assert(cache.purge() == 1);
+	assert(cache.size() == 0);
+
+	// several threads loading and releasing the same skeletons at once don't lose count of them
+	a = cache.loadFromMemory(text.data(), text.size(), "a.skl");
+	const int numThreads = 4;
+	Thread threads[numThreads];
+	for (int t = 0; t < numThreads; ++t)
+		threads[t].start(cacheTestThread, &cache);
+	for (int t = 0; t < numThreads; ++t)
+		threads[t].join();
+
+	assert(cache.size() == 2);
+	assert(a->refCount() == 2);
+	assert(cache.purge() == 1);
+	a.reset();
+	assert(cache.purge() == 1);
+	assert(cache.size() == 0);
+}
@@ -0,0 +1,61 @@
+#ifndef SKELETON_CACHE_H
+#define SKELETON_CACHE_H
+
+#include "Skeleton.h"
+#include "Thread.h"
+
+// Shared skeletons: a cache of loaded skeletons, keyed by the content of the file they were
+// loaded from (its MurmurHash2, then the bytes themselves, so that a hash collision can't mix
+// two rigs up). Loading a file whose content is already in the cache doesn't parse anything,
+// and gives back the same Skeleton, so any number of characters (and files, under any names)
+// using the same rig share one copy of it.
+// The skeletons are immutable once they're in the cache, so any number of solvers, on any
+// threads, can use one at once. The cache is locked, and the reference counts are atomic,
+// so any thread can load and release skeletons (though, as usual, one RCPtr mustn't be
+// changed by two threads at once).
+
+class SkeletonCache
+{
+public:
+	SkeletonCache() {}
+
+	// the process-wide cache
+	static SkeletonCache &shared();
+
+	// loads a skeleton file (text or compiled); the file is read again every time, so an
+	// edited file gives a new skeleton
+	RCPtr<const Skeleton> load(const std::string &fname);
+
+	// loads a skeleton from a file's contents in memory (see Skeleton::loadFromMemory)
+	RCPtr<const Skeleton> loadFromMemory(const void *data, size_t size, const std::string &source);
+
+	// drops the skeletons that aren't being used by anything else, and returns how many it dropped
+	int purge();
+
+	// the number of different skeletons in the cache
+	int size() const;
+
+private:
+	// non-copyable
+	SkeletonCache(const SkeletonCache &);
+	SkeletonCache &operator=(const SkeletonCache &);
+
+	struct Entry
+	{
+		std::string content;
+		RCPtr<const Skeleton> skeleton;
+	};
+	typedef std::multimap<unsigned int, Entry> EntryMap;
+
+	mutable Mutex lock;
+	EntryMap entries;
+
+	// returns the skeleton with the given content, or null if it isn't in the cache (call with the lock held)
+	RCPtr<const Skeleton> find(unsigned int hash, const void *data, size_t size) const;
+};
+
+// checks that identical skeletons are shared, and that different ones aren't,
+// and that several threads can load and release them at once
+void testSkeletonCache();
+
+#endif
@@ -0,0 +1,360 @@
+#include "CoreGlobal.h"
+#include "SkeletonImage.h"
+#include "Skeleton.h"
+
+#include <cstring>
+
+// ===== Image Layout ========================================================
+
+static const char imageMagic[8] = { 'I', 'K', 'S', 'K', 'E', 'L', 0, 0 };
+static const unsigned int imageByteOrder = 0x01020304;
+
+// (the header is read before anything else is known about the image, so its layout mustn't depend on the build;
+// the records' sizes are checked against the header's when an image is read)
+typedef char checkHeaderSize[(sizeof(SkeletonImageHeader) == 64) ? 1 : -1];
+
+static unsigned int alignTo8(unsigned int n)
+{
+	return (n + 7) & ~7u;
+}
+
+static unsigned int imageChecksum(const char *data, unsigned int size)
+{
+	const unsigned int start = sizeof(SkeletonImageHeader);
+	return MurmurHash2(data + start, (int)(size - start), 0);
+}
+
+static void invalidImage(const char *why)
+{
+	throw std::runtime_error(std::string("Invalid compiled skeleton: ") + why);
+}
+
+// ===== SkeletonImage =======================================================
+
+bool SkeletonImage::hasMagic(const void *data, size_t size)
+{
+	return (size >= sizeof(imageMagic)) && (std::memcmp(data, imageMagic, sizeof(imageMagic)) == 0);
+}
+
+SkeletonImage::SkeletonImage(const void *data, size_t size)
+:	data(static_cast<const char*>(data))
+{
+	assert((reinterpret_cast<size_t>(data) & 7) == 0);
+
+	if ((size < sizeof(SkeletonImageHeader)) || !hasMagic(data, size))
+		invalidImage("bad header.");
+
+	const SkeletonImageHeader &h = header();
+	if (h.byteOrder != imageByteOrder)
+		invalidImage("it was compiled on a machine with a different byte order.");
+	if (h.version != Version)
+		invalidImage("it was compiled for a different version; it needs compiling again.");
+	if ((h.boneSize != sizeof(Bone)) || (h.jointSize != sizeof(Bone::Connection)))
+		invalidImage("it was compiled by a build with a different record layout; it needs compiling again.");
+	if (h.size != size)
+		invalidImage("it's the wrong size.");
+	if (imageChecksum(this->data, h.size) != h.checksum)
+		invalidImage("it's corrupt.");
+
+	// the sections have to lie within the image, in order
+	const unsigned long long bonesEnd = h.bonesOffset + (unsigned long long)h.numBones * sizeof(Bone);
+	const unsigned long long jointsEnd = h.jointsOffset + (unsigned long long)h.numJoints * sizeof(Bone::Connection);
+	const unsigned long long topologyEnd = h.topologyOffset + (unsigned long long)h.numBones * 4 * sizeof(int);
+	if ((h.numBones < 1) || (h.numJoints < 0) ||
+		(h.bonesOffset < sizeof(SkeletonImageHeader)) || (h.bonesOffset % 8 != 0) ||
+		(h.jointsOffset < bonesEnd) || (h.jointsOffset % 8 != 0) ||
+		(h.topologyOffset < jointsEnd) || (h.topologyOffset % 8 != 0) ||
+		(h.namesOffset < topologyEnd) || ((unsigned long long)h.namesOffset + h.namesSize > h.size) ||
+		(h.namesSize == 0) || (this->data[h.namesOffset + h.namesSize - 1] != 0))
+		invalidImage("bad section offsets.");
+
+	// and every index in the records has to be in range
+	const int *parents = treeParents();
+	const int *depths = treeDepths();
+	const int *parentJoints = parentJointIdx();
+	const int *childJoints = childJointIdx();
+	for (int i = 0; i < h.numBones; ++i)
+	{
+		const Bone &b = bone(i);
+		const int type = b.constraints.type;
+		if ((b.id != i) ||
+			(b.firstJoint < 0) || (b.numJoints < 0) || (b.firstJoint > h.numJoints - b.numJoints) ||
+			(b.primaryJointIdx < -1) || (b.primaryJointIdx >= b.numJoints) ||
+			(b.nameOffset < 0) || ((unsigned int)b.nameOffset >= h.namesSize) ||
+			(type < JointConstraints::Fixed) || (type > JointConstraints::Pivot) ||
+			(parents[i] < -1) || (parents[i] >= h.numBones) || (depths[i] < 0) ||
+			(parentJoints[i] < -1) || (parentJoints[i] >= b.numJoints) ||
+			(childJoints[i] < -1) || ((parents[i] >= 0) && (childJoints[i] >= bone(parents[i]).numJoints)))
+			invalidImage("bad bone record.");
+
+		for (int j = b.firstJoint; j < b.firstJoint + b.numJoints; ++j)
+		{
+			if ((joint(j).to < 0) || (joint(j).to >= h.numBones))
+				invalidImage("bad joint record.");
+		}
+	}
+
+	// and the topology tables have to describe a tree rooted at bone 0, made of the bones' joints,
+	// so that walking up it always ends (the depths go down by one at each step), and walking
+	// between bones always finds the joints that it expects
+	for (int i = 0; i < h.numBones; ++i)
+	{
+		const Bone &b = bone(i);
+		bool ok;
+		if (i == 0)
+			ok = (parents[i] == -1) && (depths[i] == 0) && (parentJoints[i] == -1) && (childJoints[i] == -1);
+		else
+		{
+			ok = (parents[i] >= 0) && (parentJoints[i] >= 0) && (childJoints[i] >= 0);
+			if (ok)
+			{
+				const Bone &p = bone(parents[i]);
+				ok = (depths[i] == depths[p.id] + 1) &&
+					(joint(b.firstJoint + parentJoints[i]).to == p.id) &&
+					(joint(p.firstJoint + childJoints[i]).to == i);
+			}
+		}
+
+		// every joint goes either up the tree, or down it to a child that it's the joint with
+		for (int j = 0; ok && (j < b.numJoints); ++j)
+		{
+			const int to = joint(b.firstJoint + j).to;
+			ok = (to == parents[i]) || ((parents[to] == i) && (childJoints[to] == j));
+		}
+
+		if (!ok)
+			invalidImage("bad topology.");
+	}
+}
+
+// ===== Writing =============================================================
+
+static void writeAngleLimit(const JointConstraints::AngleLimit &a, JointConstraints::AngleLimit &rec)
+{
+	rec.c = a.c;
+	rec.s = a.s;
+	rec.turns = a.turns;
+}
+
+// copies a bone into a zeroed record, a field at a time, so that the padding stays zero
+// (and the same skeleton always compiles into the same bytes)
+static void writeBoneRecord(const Bone &b, Bone &rec)
+{
+	rec.id = b.id;
+	rec.firstJoint = b.firstJoint;
+	rec.numJoints = b.numJoints;
+	rec.nameOffset = b.nameOffset;
+	rec.primaryJointIdx = b.primaryJointIdx;
+
+	const JointConstraints &jc = b.constraints;
+	JointConstraints &rc = rec.constraints;
+	rc.type = jc.type;
+	rc.minAzimuth = jc.minAzimuth;
+	rc.maxAzimuth = jc.maxAzimuth;
+	rc.minElevation = jc.minElevation;
+	rc.maxElevation = jc.maxElevation;
+	rc.minTwist = jc.minTwist;
+	rc.maxTwist = jc.maxTwist;
+	for (int k = 0; k < 2; ++k)
+	{
+		writeAngleLimit(jc.azimuthLimits[k], rc.azimuthLimits[k]);
+		writeAngleLimit(jc.elevationLimits[k], rc.elevationLimits[k]);
+		writeAngleLimit(jc.twistLimits[k], rc.twistLimits[k]);
+	}
+
+	rec.displayVec = b.displayVec;
+	rec.worldPos = b.worldPos;
+	rec.defaultOrient = b.defaultOrient;
+}
+
+void writeSkeletonImage(const Skeleton &skel, std::ostream &os)
+{
+	const int n = skel.numBones();
+	int numJoints = 0;
+	unsigned int namesSize = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		numJoints += skel[i].numJoints;
+		namesSize = std::max(namesSize, (unsigned int)(skel[i].nameOffset + std::strlen(skel.getName(skel[i])) + 1));
+	}
+
+	SkeletonImageHeader h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, imageMagic, sizeof(imageMagic));
+	h.byteOrder = imageByteOrder;
+	h.version = SkeletonImage::Version;
+	h.numBones = n;
+	h.numJoints = numJoints;
+	h.bonesOffset = sizeof(SkeletonImageHeader);
+	h.jointsOffset = alignTo8(h.bonesOffset + n * sizeof(Bone));
+	h.topologyOffset = alignTo8(h.jointsOffset + numJoints * sizeof(Bone::Connection));
+	h.namesOffset = h.topologyOffset + n * 4 * sizeof(int);
+	h.namesSize = namesSize;
+	h.boneSize = sizeof(Bone);
+	h.jointSize = sizeof(Bone::Connection);
+	h.size = alignTo8(h.namesOffset + h.namesSize);
+
+	// put it together in memory first, for the checksum
+	// (the skeleton's arrays are written as they are, since the image's sections are the same arrays)
+	std::vector<char> image(h.size, 0);
+	Bone *bones = reinterpret_cast<Bone*>(&image[h.bonesOffset]);
+	Bone::Connection *joints = reinterpret_cast<Bone::Connection*>(&image[h.jointsOffset]);
+	int *topology = reinterpret_cast<int*>(&image[h.topologyOffset]);
+	for (int i = 0; i < n; ++i)
+	{
+		const Bone &b = skel[i];
+		writeBoneRecord(b, bones[i]);
+
+		const Bone::Connection *bj = skel.getJoints(b);
+		for (int j = 0; j < b.numJoints; ++j)
+		{
+			joints[b.firstJoint + j].to = bj[j].to;
+			joints[b.firstJoint + j].pos = bj[j].pos;
+		}
+
+		// (the joint indices aren't available directly, but they're easy to find again)
+		const int parent = skel.getTreeParent(i);
+		topology[i] = parent;
+		topology[n + i] = skel.getTreeDepth(i);
+		topology[2*n + i] = (parent >= 0) ? skel.findJointWith(b, skel[parent]) : -1;
+		topology[3*n + i] = (parent >= 0) ? skel.findJointWith(skel[parent], b) : -1;
+
+		const char *name = skel.getName(b);
+		std::memcpy(&image[h.namesOffset + b.nameOffset], name, std::strlen(name) + 1);
+	}
+	std::memcpy(&image[0], &h, sizeof(h));
+
+	h.checksum = imageChecksum(&image[0], h.size);
+	std::memcpy(&image[0], &h, sizeof(h));
+
+	os.write(&image[0], h.size);
+	if (!os.good())
+		throw std::runtime_error("Could not write the compiled skeleton.");
+}
+
+// ===== Image Test ==========================================================
+
+static void checkRejected(const std::vector<double> &buf, size_t size)
+{
+	bool rejected = false;
+	try
+	{
+		SkeletonImage image(&buf[0], size);
+	}
+	catch (std::runtime_error &)
+	{
+		rejected = true;
+	}
+	assert(rejected);
+	(void)rejected;
+}
+
+// the topology tables in an image being damaged, and the checksum to put right afterwards
+// (so that it's the checks on the records that have to catch the damage)
+static int *damageTopology(std::vector<double> &buf)
+{
+	const SkeletonImageHeader &h = *reinterpret_cast<const SkeletonImageHeader*>(&buf[0]);
+	return reinterpret_cast<int*>(reinterpret_cast<char*>(&buf[0]) + h.topologyOffset);
+}
+
+static void fixChecksum(std::vector<double> &buf)
+{
+	SkeletonImageHeader &h = *reinterpret_cast<SkeletonImageHeader*>(&buf[0]);
+	h.checksum = imageChecksum(reinterpret_cast<const char*>(&buf[0]), h.size);
+}
+
+static void checkSameSkeleton(const Skeleton &skel, const Skeleton &loaded)
+{
+	assert(loaded.numBones() == skel.numBones());
+	for (int i = 0; i < skel.numBones(); ++i)
+	{
+		const Bone &a = skel[i];
+		const Bone &b = loaded[i];
+		(void)b;
+		assert(std::strcmp(skel.getName(a), loaded.getName(b)) == 0);
+		assert(a.worldPos == b.worldPos);
+		assert(a.displayVec == b.displayVec);
+		assert(a.defaultOrient == b.defaultOrient);
+		assert(a.primaryJointIdx == b.primaryJointIdx);
+		assert(a.constraints.type == b.constraints.type);
+		assert(a.constraints.minTwist == b.constraints.minTwist);
+		assert(a.constraints.azimuthLimits[1].s == b.constraints.azimuthLimits[1].s);
+		assert(a.numJoints == b.numJoints);
+		for (int j = 0; j < a.numJoints; ++j)
+		{
+			assert(skel.getJoints(a)[j].to == loaded.getJoints(b)[j].to);
+			assert(skel.getJoints(a)[j].pos == loaded.getJoints(b)[j].pos);
+		}
+		assert(skel.getTreeParent(i) == loaded.getTreeParent(i));
+		assert(skel.getTreeDepth(i) == loaded.getTreeDepth(i));
+		if (skel.getTreeParent(i) >= 0)
+		{
+			const Bone &parent = loaded[loaded.getTreeParent(i)];
+			(void)parent;
+			assert(loaded.getJoint(b, parent).to == parent.id);
+			assert(loaded.getJoint(parent, b).to == b.id);
+		}
+	}
+}
+
+void testSkeletonImage(const Skeleton &skel)
+{
+	std::ostringstream ss;
+	writeSkeletonImage(skel, ss);
+	const std::string bytes = ss.str();
+
+	// the same skeleton always compiles into the same bytes
+	std::ostringstream again;
+	writeSkeletonImage(skel, again);
+	assert(again.str() == bytes);
+
+	// (a std::string's buffer isn't necessarily 8-byte aligned)
+	std::vector<double> buf((bytes.size() + 7) / 8);
+	std::memcpy(&buf[0], bytes.data(), bytes.size());
+
+	const SkeletonImage image(&buf[0], bytes.size());
+	Skeleton loaded;
+	loaded.loadFromImage(image);
+	checkSameSkeleton(skel, loaded);
+
+	// read in place, the skeleton's arrays are the image's own
+	Skeleton inPlace;
+	inPlace.useImage(image);
+	checkSameSkeleton(skel, inPlace);
+	assert(&inPlace[0] == &image.bone(0));
+	assert(inPlace.getJoints(inPlace[0]) == image.joints());
+	assert(inPlace.getName(inPlace[0]) == image.boneName(0));
+
+	// and a copy shares them, while a copy of a copied skeleton has arrays of its own
+	const Skeleton inPlaceCopy(inPlace);
+	assert(&inPlaceCopy[0] == &image.bone(0));
+	Skeleton loadedCopy;
+	loadedCopy = loaded;
+	assert(&loadedCopy[0] != &loaded[0]);
+	checkSameSkeleton(skel, loadedCopy);
+
+	// an image whose topology doesn't hang together is turned away, even with the right checksum:
+	// bone 0 with a parent, a bone at the wrong depth, and a bone whose parent's joint goes elsewhere
+	const int n = skel.numBones();
+	const int last = n - 1;
+	assert(skel.getTreeDepth(last) > 0);
+	std::vector<double> bad = buf;
+	damageTopology(bad)[0] = last;
+	fixChecksum(bad);
+	checkRejected(bad, bytes.size());
+
+	bad = buf;
+	damageTopology(bad)[n + last] += 1;
+	fixChecksum(bad);
+	checkRejected(bad, bytes.size());
+
+	bad = buf;
+	int &childJoint = damageTopology(bad)[3*n + last];
+	childJoint = (childJoint + 1) % skel[skel.getTreeParent(last)].numJoints;
+	fixChecksum(bad);
+	checkRejected(bad, bytes.size());
+
+	// and so is a damaged image
+	reinterpret_cast<char*>(&buf[0])[bytes.size() - 1] ^= 1;
+	checkRejected(buf, bytes.size());
+}
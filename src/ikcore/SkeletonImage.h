@@ -0,0 +1,106 @@
+#ifndef SKELETON_IMAGE_H
+#define SKELETON_IMAGE_H
+
+#include "Skeleton.h"
+
+// Compiled skeletons: a Skeleton, fully set up as the loader leaves it (with the roots joined up,
+// the effector tip bones added, the default orientations worked out and the fixed joints' limits filled
+// in), written out as one flat binary image. Loading an image doesn't parse or work anything out.
+// The image's sections are the skeleton's own arrays, byte for byte: the bone and joint records are Bone and
+// Bone::Connection objects, and the names and topology tables are packed the same way as the skeleton's. So a
+// skeleton can read an image in place, without copying anything (see Skeleton::useImage; loadFromFile does that
+// with the file's contents, and the image could just as well be a mapped file), or copy the arrays straight
+// out of it (see Skeleton::loadFromImage).
+// The image is position-independent: everything in it is found by byte offsets from its start. The records are
+// in the byte order and the layout of the build that wrote it, which the header records, so an image can only
+// be used by a build with the same ones (in practice, one for the same platform).
+// Images are versioned; an image with a different version number has to be compiled again from the text file.
+
+// the layout of an image (each section starting on an 8-byte boundary):
+//   the header
+//   numBones bone records
+//   numJoints joint records (each bone's joints are contiguous, as in the skeleton)
+//   the topology tables: numBones tree parents, then tree depths, parent joint indices
+//     and child joint indices (see Skeleton::getTreeParent)
+//   the bone names, each terminated by a 0
+
+struct SkeletonImageHeader
+{
+	char magic[8];             // "IKSKEL\0\0"
+	unsigned int byteOrder;    // 0x01020304, as written
+	unsigned int version;
+	unsigned int size;         // of the whole image, in bytes
+	unsigned int checksum;     // MurmurHash2 of everything after the header
+
+	int numBones;
+	int numJoints;
+	unsigned int bonesOffset;
+	unsigned int jointsOffset;
+	unsigned int topologyOffset;
+	unsigned int namesOffset;
+	unsigned int namesSize;
+
+	// sizeof(Bone) and sizeof(Bone::Connection) in the build that wrote it
+	unsigned int boneSize;
+	unsigned int jointSize;
+
+	unsigned int padding;
+};
+
+// a read-only view of an image in memory, which is checked when it's constructed
+// (it throws std::runtime_error if the image isn't valid); the memory must stay put while it's in use
+class SkeletonImage
+{
+public:
+	static const unsigned int Version = 2;
+
+	// data must be 8-byte aligned
+	SkeletonImage(const void *data, size_t size);
+
+	int numBones() const
+	{ return header().numBones; }
+
+	const SkeletonImageHeader &header() const
+	{ return *reinterpret_cast<const SkeletonImageHeader*>(data); }
+
+	// the sections, as the skeleton's arrays
+	const Bone *bones() const
+	{ return reinterpret_cast<const Bone*>(data + header().bonesOffset); }
+	const Bone::Connection *joints() const
+	{ return reinterpret_cast<const Bone::Connection*>(data + header().jointsOffset); }
+	const int *topology() const
+	{ return reinterpret_cast<const int*>(data + header().topologyOffset); }
+	const char *boneNames() const
+	{ return data + header().namesOffset; }
+
+	const Bone &bone(int id) const
+	{ return bones()[id]; }
+	const Bone::Connection &joint(int idx) const
+	{ return joints()[idx]; }
+	const char *boneName(int id) const
+	{ return boneNames() + bone(id).nameOffset; }
+
+	const int *treeParents() const
+	{ return topology(); }
+	const int *treeDepths() const
+	{ return topology() + numBones(); }
+	const int *parentJointIdx() const
+	{ return topology() + 2*numBones(); }
+	const int *childJointIdx() const
+	{ return topology() + 3*numBones(); }
+
+	// returns true if a block of memory starts like an image (so it's worth trying to read it as one)
+	static bool hasMagic(const void *data, size_t size);
+
+private:
+	const char *data;
+};
+
+// writes a skeleton out as an image
+void writeSkeletonImage(const Skeleton &skel, std::ostream &os);
+
+// compiles a skeleton, and checks that the image loads back into the same skeleton, both copied and in place,
+// and that damaged images (including ones with the right checksum) are turned away
+void testSkeletonImage(const Skeleton &skel);
+
+#endif
@@ -0,0 +1,154 @@
+#include "CoreGlobal.h"
+#include "TaskScheduler.h"
+
+// ===== TaskScheduler =======================================================
+
+TaskScheduler::TaskScheduler(int numThreads)
+:	task(0),
+	grain(1),
+	quit(false)
+{
+	if (numThreads <= 0)
+		numThreads = Thread::hardwareConcurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	queues.reserve(numThreads);
+	for (int i = 0; i < numThreads; ++i)
+		queues.push_back(new WorkQueue);
+
+	// worker 0 is whichever thread calls parallelFor
+	starts.resize(numThreads);
+	threads.reserve(numThreads - 1);
+	for (int i = 1; i < numThreads; ++i)
+	{
+		starts[i].scheduler = this;
+		starts[i].worker = i;
+		threads.push_back(new Thread);
+		threads.back()->start(&TaskScheduler::workerMain, &starts[i]);
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	quit = true;
+	wake.post((int)threads.size());
+
+	for (int i = 0; i < (int)threads.size(); ++i)
+	{
+		threads[i]->join();
+		delete threads[i];
+	}
+	for (int i = 0; i < (int)queues.size(); ++i)
+		delete queues[i];
+}
+
+void TaskScheduler::parallelFor(int count, int grain, RangeTask &task)
+{
+	if (count <= 0) return;
+	if (grain < 1) grain = 1;
+
+	const int N = numWorkers();
+
+	// if there's only enough work for one grain, don't bother waking anyone up
+	if (N == 1 || count <= grain)
+	{
+		task.run(0, count, 0);
+		return;
+	}
+
+	this->task = &task;
+	this->grain = grain;
+
+	// hand out equal contiguous shares
+	for (int i = 0; i < N; ++i)
+	{
+		WorkQueue &q = *queues[i];
+		ScopedLock lock(q.lock);
+		q.begin = (int)(((long long)count * i) / N);
+		q.end = (int)(((long long)count * (i + 1)) / N);
+	}
+
+	wake.post(N - 1);
+	runWorker(0);
+
+	// wait for everyone else to finish their last grain
+	for (int i = 1; i < N; ++i)
+		done.wait();
+
+	this->task = 0;
+}
+
+void TaskScheduler::workerMain(void *arg)
+{
+	WorkerStart &start = *static_cast<WorkerStart*>(arg);
+	TaskScheduler &sched = *start.scheduler;
+
+	while (true)
+	{
+		sched.wake.wait();
+		if (sched.quit)
+			break;
+
+		sched.runWorker(start.worker);
+		sched.done.post();
+	}
+}
+
+void TaskScheduler::runWorker(int worker)
+{
+	int begin, end;
+	while (true)
+	{
+		while (takeWork(worker, begin, end))
+			task->run(begin, end, worker);
+
+		// our own share is exhausted; try to steal some more
+		if (!stealWork(worker))
+			break;
+	}
+}
+
+bool TaskScheduler::takeWork(int worker, int &begin, int &end)
+{
+	WorkQueue &q = *queues[worker];
+	ScopedLock lock(q.lock);
+	if (q.begin >= q.end)
+		return false;
+
+	begin = q.begin;
+	end = std::min(q.begin + grain, q.end);
+	q.begin = end;
+	return true;
+}
+
+bool TaskScheduler::stealWork(int worker)
+{
+	const int N = numWorkers();
+	for (int i = 1; i < N; ++i)
+	{
+		WorkQueue &victim = *queues[(worker + i) % N];
+
+		int begin, end;
+		{
+			ScopedLock lock(victim.lock);
+			const int remaining = victim.end - victim.begin;
+			if (remaining <= 0)
+				continue;
+
+			// take the back half (rounded up, so a single remaining item can still be stolen)
+			const int n = (remaining + 1) / 2;
+			begin = victim.end - n;
+			end = victim.end;
+			victim.end = begin;
+		}
+
+		WorkQueue &q = *queues[worker];
+		ScopedLock lock(q.lock);
+		q.begin = begin;
+		q.end = end;
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,79 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include "Thread.h"
+
+// A range task is run over a set of independent items [0, count)
+// run() is called many times, from different threads, with disjoint sub-ranges;
+// the worker index identifies the calling thread (0 <= worker < numWorkers())
+// so that tasks can keep per-thread scratch space without any locking
+class RangeTask
+{
+public:
+	virtual ~RangeTask() {}
+	virtual void run(int begin, int end, int worker) = 0;
+};
+
+// A fixed pool of worker threads which runs range tasks with work stealing:
+// each worker starts with an equal contiguous share of the range and takes
+// 'grain' items at a time from the front of its share; a worker which runs
+// out steals the back half of another worker's remaining share
+// the thread calling parallelFor() takes part as worker 0
+class TaskScheduler
+{
+public:
+	// numThreads is the total number of workers (including the calling thread)
+	// zero means use one worker per hardware thread
+	explicit TaskScheduler(int numThreads = 0);
+	~TaskScheduler();
+
+	int numWorkers() const
+	{ return (int)queues.size(); }
+
+	// runs the task over [0, count) and returns once every item has been processed
+	void parallelFor(int count, int grain, RangeTask &task);
+
+private:
+	// the remaining share of the current range for one worker
+	// padded out so that different workers' queues don't share a cache line
+	struct WorkQueue
+	{
+		WorkQueue(): begin(0), end(0) {}
+
+		Mutex lock;
+		int begin;
+		int end;
+		char padding[64];
+	};
+
+	struct WorkerStart
+	{
+		TaskScheduler *scheduler;
+		int worker;
+	};
+
+	std::vector<WorkQueue*> queues;
+	std::vector<Thread*> threads;
+	std::vector<WorkerStart> starts;
+
+	// wakes the helper threads when there's a new range to process
+	Semaphore wake;
+	// posted by each helper thread once it has finished with the current range
+	Semaphore done;
+
+	RangeTask *task;
+	int grain;
+	bool quit;
+
+	static void workerMain(void *arg);
+	void runWorker(int worker);
+
+	bool takeWork(int worker, int &begin, int &end);
+	bool stealWork(int worker);
+
+	// non-copyable
+	TaskScheduler(const TaskScheduler &);
+	TaskScheduler &operator=(const TaskScheduler &);
+};
+
+#endif
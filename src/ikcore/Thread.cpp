@@ -0,0 +1,261 @@
+#include "CoreGlobal.h"
+#include "Thread.h"
+
+#ifdef _WIN32
+#define _WIN32_WINNT 0x0501
+#define STRICT
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+// ===== Mutex ===============================================================
+
+#ifdef _WIN32
+
+Mutex::Mutex()
+{
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	impl = cs;
+}
+
+Mutex::~Mutex()
+{
+	CRITICAL_SECTION *cs = static_cast<CRITICAL_SECTION*>(impl);
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void Mutex::lock()
+{
+	EnterCriticalSection(static_cast<CRITICAL_SECTION*>(impl));
+}
+
+void Mutex::unlock()
+{
+	LeaveCriticalSection(static_cast<CRITICAL_SECTION*>(impl));
+}
+
+#else
+
+Mutex::Mutex()
+{
+	pthread_mutex_t *m = new pthread_mutex_t;
+	pthread_mutex_init(m, 0);
+	impl = m;
+}
+
+Mutex::~Mutex()
+{
+	pthread_mutex_t *m = static_cast<pthread_mutex_t*>(impl);
+	pthread_mutex_destroy(m);
+	delete m;
+}
+
+void Mutex::lock()
+{
+	pthread_mutex_lock(static_cast<pthread_mutex_t*>(impl));
+}
+
+void Mutex::unlock()
+{
+	pthread_mutex_unlock(static_cast<pthread_mutex_t*>(impl));
+}
+
+#endif
+
+// ===== Semaphore ===========================================================
+
+#ifdef _WIN32
+
+Semaphore::Semaphore(int initialCount)
+{
+	impl = CreateSemaphore(0, initialCount, 0x7fffffff, 0);
+	if (impl == 0)
+		throw std::runtime_error("Could not create semaphore.");
+}
+
+Semaphore::~Semaphore()
+{
+	CloseHandle(static_cast<HANDLE>(impl));
+}
+
+void Semaphore::post(int count)
+{
+	ReleaseSemaphore(static_cast<HANDLE>(impl), count, 0);
+}
+
+void Semaphore::wait()
+{
+	WaitForSingleObject(static_cast<HANDLE>(impl), INFINITE);
+}
+
+#else
+
+// (unnamed POSIX semaphores aren't available everywhere, so build one)
+struct PosixSemaphore
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count;
+};
+
+Semaphore::Semaphore(int initialCount)
+{
+	PosixSemaphore *s = new PosixSemaphore;
+	pthread_mutex_init(&s->mutex, 0);
+	pthread_cond_init(&s->cond, 0);
+	s->count = initialCount;
+	impl = s;
+}
+
+Semaphore::~Semaphore()
+{
+	PosixSemaphore *s = static_cast<PosixSemaphore*>(impl);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	delete s;
+}
+
+void Semaphore::post(int count)
+{
+	PosixSemaphore *s = static_cast<PosixSemaphore*>(impl);
+	pthread_mutex_lock(&s->mutex);
+	s->count += count;
+	if (count == 1)
+		pthread_cond_signal(&s->cond);
+	else
+		pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+}
+
+void Semaphore::wait()
+{
+	PosixSemaphore *s = static_cast<PosixSemaphore*>(impl);
+	pthread_mutex_lock(&s->mutex);
+	while (s->count == 0)
+		pthread_cond_wait(&s->cond, &s->mutex);
+	--s->count;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+#endif
+
+// ===== Thread ==============================================================
+
+struct ThreadStart
+{
+	Thread::EntryPoint entry;
+	void *arg;
+};
+
+#ifdef _WIN32
+
+static unsigned __stdcall threadMain(void *p)
+{
+	ThreadStart start = *static_cast<ThreadStart*>(p);
+	delete static_cast<ThreadStart*>(p);
+	start.entry(start.arg);
+	return 0;
+}
+
+#else
+
+static void *threadMain(void *p)
+{
+	ThreadStart start = *static_cast<ThreadStart*>(p);
+	delete static_cast<ThreadStart*>(p);
+	start.entry(start.arg);
+	return 0;
+}
+
+#endif
+
+Thread::Thread(): impl(0)
+{
+}
+
+Thread::~Thread()
+{
+	if (isRunning())
+		join();
+}
+
+void Thread::start(EntryPoint entry, void *arg)
+{
+	assert(!isRunning());
+
+	ThreadStart *start = new ThreadStart;
+	start->entry = entry;
+	start->arg = arg;
+
+#ifdef _WIN32
+	uintptr_t h = _beginthreadex(0, 0, &threadMain, start, 0, 0);
+	if (h == 0)
+	{
+		delete start;
+		throw std::runtime_error("Could not start thread.");
+	}
+	impl = reinterpret_cast<void*>(h);
+#else
+	pthread_t *t = new pthread_t;
+	if (pthread_create(t, 0, &threadMain, start) != 0)
+	{
+		delete t;
+		delete start;
+		throw std::runtime_error("Could not start thread.");
+	}
+	impl = t;
+#endif
+}
+
+void Thread::join()
+{
+	assert(isRunning());
+
+#ifdef _WIN32
+	HANDLE h = static_cast<HANDLE>(impl);
+	WaitForSingleObject(h, INFINITE);
+	CloseHandle(h);
+#else
+	pthread_t *t = static_cast<pthread_t*>(impl);
+	pthread_join(*t, 0);
+	delete t;
+#endif
+
+	impl = 0;
+}
+
+int Thread::hardwareConcurrency()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int)n : 1;
+#endif
+}
+
+// ===== Clock ===============================================================
+
+double monotonicSeconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
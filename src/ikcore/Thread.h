@@ -0,0 +1,78 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+// Minimal threading primitives (Win32 threads or pthreads underneath), and a clock
+// only what the task scheduler (and the batch time budget) needs; the platform headers are kept
+// out of here so that including this doesn't drag in windows.h
+
+class Mutex
+{
+public:
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+private:
+	// non-copyable
+	Mutex(const Mutex &);
+	Mutex &operator=(const Mutex &);
+
+	void *impl;
+};
+
+class ScopedLock
+{
+public:
+	explicit ScopedLock(Mutex &m): m(m) { m.lock(); }
+	~ScopedLock() { m.unlock(); }
+private:
+	ScopedLock(const ScopedLock &);
+	ScopedLock &operator=(const ScopedLock &);
+
+	Mutex &m;
+};
+
+// counting semaphore
+class Semaphore
+{
+public:
+	explicit Semaphore(int initialCount = 0);
+	~Semaphore();
+
+	void post(int count = 1);
+	void wait();
+private:
+	Semaphore(const Semaphore &);
+	Semaphore &operator=(const Semaphore &);
+
+	void *impl;
+};
+
+class Thread
+{
+public:
+	typedef void (*EntryPoint)(void *arg);
+
+	Thread();
+	~Thread();
+
+	void start(EntryPoint entry, void *arg);
+	void join();
+
+	bool isRunning() const
+	{ return (impl != 0); }
+
+	// number of hardware threads available to the process
+	static int hardwareConcurrency();
+private:
+	Thread(const Thread &);
+	Thread &operator=(const Thread &);
+
+	void *impl;
+};
+
+// a monotonic clock, in seconds from an arbitrary starting point (for time budgets)
+double monotonicSeconds();
+
+#endif
@@ -97,18 +97,46 @@ private:
 	T *p;
 };
 
+// the reference counts are changed atomically, so that objects can be shared between threads
+// (eg, the skeletons in the SkeletonCache); each of these returns the new count
+#ifdef _MSC_VER
+extern "C" long __cdecl _InterlockedIncrement(long volatile *n);
+extern "C" long __cdecl _InterlockedDecrement(long volatile *n);
+#pragma intrinsic(_InterlockedIncrement, _InterlockedDecrement)
+
+inline long atomicIncrement(volatile long *n)
+{ return _InterlockedIncrement(n); }
+inline long atomicDecrement(volatile long *n)
+{ return _InterlockedDecrement(n); }
+#else
+inline long atomicIncrement(volatile long *n)
+{ return __sync_add_and_fetch(n, 1); }
+inline long atomicDecrement(volatile long *n)
+{ return __sync_sub_and_fetch(n, 1); }
+#endif
+
 class RefCounted
 {
 public:
 	RefCounted(): rc(0) {}
 	virtual ~RefCounted() {}
 
-	void AddRef()
-	{ ++rc; }
-	void Release()
-	{ if (!--rc) delete this; }
+	// (a copy is a new object, so nothing refers to it yet)
+	RefCounted(const RefCounted &): rc(0) {}
+	RefCounted &operator=(const RefCounted &)
+	{ return *this; }
+
+	// (these are const, so that const objects can be shared with an RCPtr<const T>)
+	void AddRef() const
+	{ atomicIncrement(&rc); }
+	void Release() const
+	{ if (!atomicDecrement(&rc)) delete this; }
+
+	// (another thread may change it straight afterwards, unless it's known that nothing else can take a reference)
+	unsigned int refCount() const
+	{ return (unsigned int)rc; }
 private:
-	unsigned int rc;
+	mutable volatile long rc;
 };
 
 struct dynamic_cast_tag {};
@@ -123,12 +151,17 @@ public:
 	template <typename Y>
 	explicit RCPtr(Y *p_): p(p_) { if (p) p->AddRef(); }
 
+	RCPtr(const RCPtr<T> &p_): p(p_.p) { if (p) p->AddRef(); }
+
 	template <typename Y>
-	explicit RCPtr(const RCPtr<Y> &p_): p(p_.p) { if (p) p->AddRef(); }
+	explicit RCPtr(const RCPtr<Y> &p_): p(p_.get()) { if (p) p->AddRef(); }
 
 	~RCPtr()
 	{ if (p) p->Release(); }
 
+	RCPtr<T> &operator = (const RCPtr<T> &p_)
+	{ RCPtr<T>(p_).swap(*this); return *this; }
+
 	template <typename Y>
 	RCPtr<T> &operator = (const RCPtr<Y> &p_)
 	{ RCPtr<T>(p_).swap(*this); return *this; }
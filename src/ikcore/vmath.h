@@ -37,6 +37,9 @@
 
 namespace vmath {
 
+using std::abs;
+using std::sqrt;
+
 template <typename T>
 inline T rsqrt(T x)
 {
@@ -490,7 +493,7 @@ struct mat4 {
 		elem[3][3] = m33;
 	}
 
-	explicit mat4(const vec4<T>& col0, const vec4<T>& col1, const vec4<T>& col2, const vec4<T>& v3)
+	explicit mat4(const vec4<T>& col0, const vec4<T>& col1, const vec4<T>& col2, const vec4<T>& col3)
 	{
 		elem[0][0] = col0[0];
 		elem[0][1] = col0[1];
@@ -1053,7 +1056,7 @@ inline quat<T> mat_to_quat(const mat4<T>& m)
 	const T t = m.elem[0][0] + m.elem[1][1] + m.elem[2][2] + T(1);
 	quat<T> q;
 
-	if ( t > 0 ) {
+	if ( t > T(1) ) {
 		const T s = T(0.5) / sqrt(t);
 		q[0] = (m.elem[1][2] - m.elem[2][1]) * s;
 		q[1] = (m.elem[2][0] - m.elem[0][2]) * s;
@@ -1066,7 +1069,7 @@ inline quat<T> mat_to_quat(const mat4<T>& m)
 			q[0] = T(0.25) * s;
 			q[1] = (m.elem[1][0] + m.elem[0][1] ) * invs;
 			q[2] = (m.elem[2][0] + m.elem[0][2] ) * invs;
-			q[3] = (m.elem[2][1] - m.elem[1][2] ) * invs;
+			q[3] = (m.elem[1][2] - m.elem[2][1] ) * invs;
 		} else if (m.elem[1][1] > m.elem[2][2]) {
 			const T s = T(2) * sqrt( T(1) + m.elem[1][1] - m.elem[0][0] - m.elem[2][2]);
 			const T invs = inv(s);
@@ -1080,7 +1083,7 @@ inline quat<T> mat_to_quat(const mat4<T>& m)
 			q[0] = (m.elem[2][0] + m.elem[0][2] ) * invs;
 			q[1] = (m.elem[2][1] + m.elem[1][2] ) * invs;
 			q[2] = T(0.25) * s;
-			q[3] = (m.elem[1][0] - m.elem[0][1] ) * invs;
+			q[3] = (m.elem[0][1] - m.elem[1][0] ) * invs;
 		}
 	}
 	
@@ -1193,4 +1196,7 @@ inline quat<T> squad(
 
 } // end namespace vmath
 
+// SSE/AVX versions of the most heavily used operations (define VMATH_NO_SIMD to disable)
+#include "vmath_simd.h"
+
 #endif
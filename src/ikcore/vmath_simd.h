@@ -0,0 +1,258 @@
+/**
+ *  SIMD versions of the hottest vmath operations, for float and double.
+ *
+ *  These are plain (non-template) overloads, so they're picked in preference
+ *  to the generic templates in vmath.h wherever the argument types match
+ *  exactly; nothing that uses vmath has to change.
+ *
+ *  - float uses SSE (4 floats per register)
+ *  - double uses AVX (4 doubles per register) if it's enabled for the build,
+ *    or pairs of SSE2 registers otherwise
+ *  - if SSE2 isn't available, or VMATH_NO_SIMD is defined, you just get
+ *    the generic templates
+ *
+ *  Every operation does its multiplies and adds in the same order as the
+ *  generic version, and never uses fused multiply-add, so the results are
+ *  bit-identical to the scalar code.
+ *
+ *  Nothing here assumes any alignment: vmath types are plain arrays of T.
+ *
+ *  Note: the vec3 functions (dot, cross, normalize) are deliberately left alone;
+ *  with only three lanes in use, the loads, shuffles and horizontal adds cost
+ *  more than the arithmetic they replace.
+ */
+
+#ifndef VMATH_SIMD_H
+#define VMATH_SIMD_H
+
+#ifndef VMATH_NO_SIMD
+#	if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#		define VMATH_SSE2
+#	endif
+#	if defined(VMATH_SSE2) && defined(__AVX__)
+#		define VMATH_AVX
+#	endif
+#endif
+
+#ifdef VMATH_SSE2
+
+#include <emmintrin.h>
+#ifdef VMATH_AVX
+#include <immintrin.h>
+#endif
+
+namespace vmath {
+
+namespace detail {
+
+	// a 4-lane register of T, and the handful of operations the kernels below need
+	// (arguments are passed by reference: 32-bit MSVC can't pass aligned types by value)
+	template <typename T> struct simd4;
+
+	template <>
+	struct simd4<float>
+	{
+		typedef __m128 reg;
+
+		static reg load(const float *p) { return _mm_loadu_ps(p); }
+		static void store(float *p, const reg &a) { _mm_storeu_ps(p, a); }
+		static reg set(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+		static reg splat(float x) { return _mm_set1_ps(x); }
+		static reg add(const reg &a, const reg &b) { return _mm_add_ps(a, b); }
+		static reg sub(const reg &a, const reg &b) { return _mm_sub_ps(a, b); }
+		static reg mul(const reg &a, const reg &b) { return _mm_mul_ps(a, b); }
+	};
+
+#ifdef VMATH_AVX
+	template <>
+	struct simd4<double>
+	{
+		typedef __m256d reg;
+
+		static reg load(const double *p) { return _mm256_loadu_pd(p); }
+		static void store(double *p, const reg &a) { _mm256_storeu_pd(p, a); }
+		static reg set(double x, double y, double z, double w) { return _mm256_set_pd(w, z, y, x); }
+		static reg splat(double x) { return _mm256_set1_pd(x); }
+		static reg add(const reg &a, const reg &b) { return _mm256_add_pd(a, b); }
+		static reg sub(const reg &a, const reg &b) { return _mm256_sub_pd(a, b); }
+		static reg mul(const reg &a, const reg &b) { return _mm256_mul_pd(a, b); }
+	};
+#else
+	template <>
+	struct simd4<double>
+	{
+		struct reg { __m128d lo, hi; };
+
+		static reg make(const __m128d &lo, const __m128d &hi) { reg r; r.lo = lo; r.hi = hi; return r; }
+
+		static reg load(const double *p) { return make(_mm_loadu_pd(p), _mm_loadu_pd(p + 2)); }
+		static void store(double *p, const reg &a) { _mm_storeu_pd(p, a.lo); _mm_storeu_pd(p + 2, a.hi); }
+		static reg set(double x, double y, double z, double w) { return make(_mm_set_pd(y, x), _mm_set_pd(w, z)); }
+		static reg splat(double x) { const __m128d v = _mm_set1_pd(x); return make(v, v); }
+		static reg add(const reg &a, const reg &b) { return make(_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)); }
+		static reg sub(const reg &a, const reg &b) { return make(_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)); }
+		static reg mul(const reg &a, const reg &b) { return make(_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)); }
+	};
+#endif
+
+	// ----- generic kernels (the overloads below just pick T) -----
+
+	// m * v, where the 4-lane v is given as its elements (v3 is the homogeneous coordinate)
+	// the result is accumulated a column at a time, in the same order as dot(row, v)
+	template <typename T>
+	inline typename simd4<T>::reg simd_mat4_mul(const mat4<T> &m, T v0, T v1, T v2, T v3)
+	{
+		typedef simd4<T> S;
+		typename S::reg r = S::mul(S::load(m.elem[0]), S::splat(v0));
+		r = S::add(r, S::mul(S::load(m.elem[1]), S::splat(v1)));
+		r = S::add(r, S::mul(S::load(m.elem[2]), S::splat(v2)));
+		r = S::add(r, S::mul(S::load(m.elem[3]), S::splat(v3)));
+		return r;
+	}
+
+	template <typename T>
+	inline mat4<T> simd_mat4_mul_mat4(const mat4<T> &a, const mat4<T> &b)
+	{
+		typedef simd4<T> S;
+		mat4<T> result;
+		for (int c = 0; c < 4; ++c)
+			S::store(result.elem[c], simd_mat4_mul(a, b.elem[c][0], b.elem[c][1], b.elem[c][2], b.elem[c][3]));
+		return result;
+	}
+
+	template <typename T>
+	inline vec4<T> simd_mat4_mul_vec4(const mat4<T> &m, const vec4<T> &v)
+	{
+		T r[4];
+		simd4<T>::store(r, simd_mat4_mul(m, v.x, v.y, v.z, v.w));
+		return vec4<T>(r[0], r[1], r[2], r[3]);
+	}
+
+	// (m * vec4(v, 1)) without the w component
+	// the generic version adds the translation after the 3-term dot product, which is what happens here too
+	template <typename T>
+	inline vec3<T> simd_transform_point(const mat4<T> &m, const vec3<T> &v)
+	{
+		typedef simd4<T> S;
+		typename S::reg r = S::mul(S::load(m.elem[0]), S::splat(v.x));
+		r = S::add(r, S::mul(S::load(m.elem[1]), S::splat(v.y)));
+		r = S::add(r, S::mul(S::load(m.elem[2]), S::splat(v.z)));
+		r = S::add(r, S::load(m.elem[3]));
+		T out[4];
+		S::store(out, r);
+		return vec3<T>(out[0], out[1], out[2]);
+	}
+
+	template <typename T>
+	inline vec3<T> simd_transform_vector(const mat4<T> &m, const vec3<T> &v)
+	{
+		typedef simd4<T> S;
+		typename S::reg r = S::mul(S::load(m.elem[0]), S::splat(v.x));
+		r = S::add(r, S::mul(S::load(m.elem[1]), S::splat(v.y)));
+		r = S::add(r, S::mul(S::load(m.elem[2]), S::splat(v.z)));
+		T out[4];
+		S::store(out, r);
+		return vec3<T>(out[0], out[1], out[2]);
+	}
+
+	// inverse of a rigid-body transform: transpose the rotation, and rotate the negated translation
+	template <typename T>
+	inline mat4<T> simd_fast_inverse(const mat4<T> &m)
+	{
+		typedef simd4<T> S;
+
+		// rows of the rotation part are the columns of the result
+		const typename S::reg r0 = S::set(m.elem[0][0], m.elem[1][0], m.elem[2][0], T(0));
+		const typename S::reg r1 = S::set(m.elem[0][1], m.elem[1][1], m.elem[2][1], T(0));
+		const typename S::reg r2 = S::set(m.elem[0][2], m.elem[1][2], m.elem[2][2], T(0));
+
+		// t' = -(transpose(R) * t), with each element summed in the same order as dot(col, t)
+		typename S::reg t = S::mul(r0, S::splat(m.elem[3][0]));
+		t = S::add(t, S::mul(r1, S::splat(m.elem[3][1])));
+		t = S::add(t, S::mul(r2, S::splat(m.elem[3][2])));
+		t = S::sub(S::splat(T(0)), t);
+
+		mat4<T> result;
+		S::store(result.elem[0], r0);
+		S::store(result.elem[1], r1);
+		S::store(result.elem[2], r2);
+		S::store(result.elem[3], t);
+		result.elem[3][3] = T(1);
+		return result;
+	}
+
+	// mat3 columns are only 3 elements, and packed, so they can't be loaded directly
+	// (the last column would read past the end); go through set() instead
+	template <typename T>
+	inline mat3<T> simd_mat3_mul_mat3(const mat3<T> &a, const mat3<T> &b)
+	{
+		typedef simd4<T> S;
+		const typename S::reg a0 = S::set(a.elem[0][0], a.elem[0][1], a.elem[0][2], T(0));
+		const typename S::reg a1 = S::set(a.elem[1][0], a.elem[1][1], a.elem[1][2], T(0));
+		const typename S::reg a2 = S::set(a.elem[2][0], a.elem[2][1], a.elem[2][2], T(0));
+
+		mat3<T> result;
+		for (int c = 0; c < 3; ++c)
+		{
+			typename S::reg r = S::mul(a0, S::splat(b.elem[c][0]));
+			r = S::add(r, S::mul(a1, S::splat(b.elem[c][1])));
+			r = S::add(r, S::mul(a2, S::splat(b.elem[c][2])));
+			T out[4];
+			S::store(out, r);
+			result.elem[c][0] = out[0];
+			result.elem[c][1] = out[1];
+			result.elem[c][2] = out[2];
+		}
+		return result;
+	}
+
+	// q * r = [(qw*rw - qv.rv), (qv x rv + rw*qv + qw*rv)]
+	template <typename T>
+	inline quat<T> simd_quat_mul(const quat<T> &q, const quat<T> &r)
+	{
+		typedef simd4<T> S;
+		const vec3<T> &a = q.v;
+		const vec3<T> &b = r.v;
+
+		// cross product, in the same form as vmath::cross
+		typename S::reg v = S::sub(
+			S::mul(S::set(a.y, a.z, a.x, T(0)), S::set(b.z, b.x, b.y, T(0))),
+			S::mul(S::set(a.z, a.x, a.y, T(0)), S::set(b.y, b.z, b.x, T(0))));
+		v = S::add(v, S::mul(S::splat(r.w), S::set(a.x, a.y, a.z, T(0))));
+		v = S::add(v, S::mul(S::splat(q.w), S::set(b.x, b.y, b.z, T(0))));
+
+		T out[4];
+		S::store(out, v);
+		return quat<T>(out[0], out[1], out[2], q.w * r.w - dot(a, b));
+	}
+
+} // end namespace detail
+
+// ----- overloads -----
+
+#define VMATH_SIMD_OVERLOADS(T) \
+	inline mat4<T> operator * (const mat4<T> &a, const mat4<T> &b) \
+	{ return detail::simd_mat4_mul_mat4(a, b); } \
+	inline vec4<T> operator * (const mat4<T> &m, const vec4<T> &v) \
+	{ return detail::simd_mat4_mul_vec4(m, v); } \
+	inline vec3<T> transform_point(const mat4<T> &m, const vec3<T> &v) \
+	{ return detail::simd_transform_point(m, v); } \
+	inline vec3<T> transform_vector(const mat4<T> &m, const vec3<T> &v) \
+	{ return detail::simd_transform_vector(m, v); } \
+	inline mat4<T> fast_inverse(const mat4<T> &m) \
+	{ return detail::simd_fast_inverse(m); } \
+	inline mat3<T> operator * (const mat3<T> &a, const mat3<T> &b) \
+	{ return detail::simd_mat3_mul_mat3(a, b); } \
+	inline quat<T> operator * (const quat<T> &q, const quat<T> &r) \
+	{ return detail::simd_quat_mul(q, r); }
+
+VMATH_SIMD_OVERLOADS(float)
+VMATH_SIMD_OVERLOADS(double)
+
+#undef VMATH_SIMD_OVERLOADS
+
+} // end namespace vmath
+
+#endif // VMATH_SSE2
+
+#endif
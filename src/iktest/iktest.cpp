@@ -0,0 +1,71 @@
+#include "CoreGlobal.h"
+#include "Skeleton.h"
+#include "SkeletonCache.h"
+#include "SkeletonImage.h"
+#include "IkSolver.h"
+#include "IkKernel.h"
+#include "IkJacobian.h"
+#include "IkBatch.h"
+#include "MathUtil.h"
+#include "Pose.h"
+
+// iktest: runs the solver core's tests (the test* functions declared alongside the code they test)
+// against each of the skeletons that ship in release/
+//
+// usage: iktest [skeleton directory]
+//
+// The tests check their results with assert, so this has to be built without NDEBUG (the Makefile's
+// test target does that); a failing test aborts with the assertion that failed.
+
+int main(int argc, char *argv[])
+{
+#ifdef NDEBUG
+	std::cerr << "iktest: built with NDEBUG, so the tests' assertions aren't checked" << std::endl;
+	return 1;
+#else
+	const std::string dir = (argc > 1) ? argv[1] : "release";
+
+	const char *const skeletonNames[] = { "simple", "snake", "human" };
+	const int numSkeletons = sizeof(skeletonNames) / sizeof(skeletonNames[0]);
+
+	try
+	{
+		testAzElRotation();
+		testQuaternionRotation();
+		testSinglePrecisionRotation();
+		testJointConstraints();
+		testJacobianKernels();
+		testSkeletonText();
+		testSkeletonCache();
+		std::cout << "iktest: core tests passed" << std::endl;
+
+		for (int s = 0; s < numSkeletons; ++s)
+		{
+			Skeleton skel;
+			skel.loadFromFile(dir + "/" + skeletonNames[s] + ".skl");
+
+			testSinglePrecisionSolver(skel);
+			testTwoBoneSolver(skel);
+			testJacobianSolver(skel);
+			testFABRIKSolver(skel);
+			testMultiEffectorSolver(skel);
+			testOrientationTargets(skel);
+			testWarmStart(skel);
+			testConvergence(skel);
+			testSolverStats(skel);
+			testSkeletonImage(skel);
+			testPose(skel);
+			testBatchSolver(skel);
+			testLockstepBatch(skel);
+			std::cout << "iktest: " << skeletonNames[s] << " tests passed" << std::endl;
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << "iktest: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+#endif
+}
@@ -0,0 +1,48 @@
+#include "CoreGlobal.h"
+#include "Skeleton.h"
+#include "SkeletonImage.h"
+
+// skelc: compiles a skeleton file into a binary image (see SkeletonImage.h), which loads without
+// any parsing or setting up; Skeleton::loadFromFile reads either kind of file
+//
+// usage: skelc input.skl output.sklb
+//
+// The image is only good for the version of ikcore that compiled it, and for builds with the
+// same byte order and record layout (in practice, the same platform); an image that doesn't
+// match is turned away when it's loaded, and has to be compiled again.
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		std::cerr << "usage: skelc input.skl output.sklb" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		Skeleton skel;
+		skel.loadFromFile(argv[1]);
+
+		std::ofstream fs(argv[2], std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!fs.is_open())
+			throw std::runtime_error(std::string("Could not open ") + argv[2] + " for writing.");
+		writeSkeletonImage(skel, fs);
+		fs.close();
+
+		// check that it loads back
+		Skeleton compiled;
+		compiled.loadFromFile(argv[2]);
+		if (compiled.numBones() != skel.numBones())
+			throw std::runtime_error("The compiled skeleton doesn't load back correctly.");
+
+		std::cout << argv[1] << ": " << skel.numBones() << " bones, compiled to " << argv[2] << std::endl;
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << "skelc: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}